@@ -0,0 +1,1081 @@
+/*
+ * apex_batch.c
+ * Batched runs of one program over many data memory images, for input
+ * sweeps. All images advance together in a lockstep functional engine that
+ * keeps the architectural state as structure-of-arrays, one lane per image:
+ * register r of every lane is one contiguous row, and so is data memory
+ * word a. Each step takes the lowest pc any running lane is at and executes
+ * that instruction for all lanes sitting there; lanes that branched
+ * elsewhere or halted are masked off and catch up, or join again, later.
+ *
+ * Lane state is processed eight lanes per AVX2 instruction: ALU ops,
+ * compares and flags, branches, loads as masked gathers and the pc update.
+ * Stores, DIV, jumps and vector instructions run lane by lane, AVX2 has no
+ * scatter or integer divide. Hosts without AVX2 run every lane in plain C.
+ * With fusion set, pairs the pipeline fuses run in one step.
+ *
+ * Cycle counts come from the pipeline itself. Every lane hashes the targets
+ * of its branches and jumps, and with neither the store buffer, a
+ * prefetcher nor the value predictor the pipeline's timing depends on
+ * nothing but that path, so the pipeline runs once per distinct path, on
+ * the first lane that took it, and that lane's final state is checked
+ * against the lockstep engine. With the store buffer or a prefetcher, whose
+ * timing depends on addresses, the value predictor, whose timing depends on
+ * loaded values, or with -c, every lane gets its own pipeline run and
+ * check.
+ *
+ * Image files list "<address> <value>" pairs, see load_data_image(). The
+ * results table has a row per image: status, instructions, cycles, path and
+ * the final registers.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_fusion.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BATCH_X86 1
+#endif
+
+#define BATCH_MAX_LANES 4096
+#define BATCH_BLOCK 8            /* Lanes per AVX2 register */
+
+/* Lane states */
+#define LANE_RUNNING 0
+#define LANE_HALTED 1
+#define LANE_LIMIT 2             /* No HALT within max_cycles */
+#define LANE_FAULT 3             /* Left data or code memory */
+
+#define FLAG_Z 0
+#define FLAG_P 1
+#define FLAG_N 2
+
+/* Path hashes, two 32-bit halves updated with every branch or jump target */
+#define PATH_SEED 0x811c9dc5u
+#define PATH_MUL0 0x01000193u
+#define PATH_MUL1 0x9e3779b1u
+
+typedef struct Batch
+{
+    int lanes;
+    int stride;                 /* lanes rounded up to BATCH_BLOCK */
+    const APEX_Instruction *code;
+    int code_size;
+    int vector_length;
+    int *pc;
+    int *state;                 /* LANE_* */
+    int *retired;               /* Instructions executed, NOPs excluded */
+    unsigned int *path[2];
+    int *flags;                 /* [FLAG_*][lane] */
+    int *regs;                  /* [register][lane] */
+    int *vregs;                 /* [register][element][lane] */
+    int *memory;                /* [address][lane] */
+} Batch;
+
+typedef struct Batch_Path
+{
+    int lane;                   /* First lane on the path */
+    int cycles;
+    int halted;
+} Batch_Path;
+
+static const char *state_names[] = {"running", "halted", "limit", "fault"};
+
+#define ROW(batch, array, index) ((batch)->array + (size_t)(index) * (batch)->stride)
+#define VROW(batch, reg, element) \
+    ROW(batch, vregs, (reg) * MAX_VECTOR_LENGTH + (element))
+
+static double
+now_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int
+host_has_avx2(void)
+{
+#ifdef BATCH_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return FALSE;
+#endif
+}
+
+static void
+batch_free(Batch *b)
+{
+    if (!b)
+    {
+        return;
+    }
+
+    free(b->pc);
+    free(b->state);
+    free(b->retired);
+    free(b->path[0]);
+    free(b->path[1]);
+    free(b->flags);
+    free(b->regs);
+    free(b->vregs);
+    free(b->memory);
+    free(b);
+}
+
+/* Lays lane l's image out at column l. Padding lanes start out halted */
+static Batch *
+batch_create(const APEX_Instruction *code, int code_size, int vector_length,
+             int lanes, int (*images)[DATA_MEMORY_SIZE])
+{
+    Batch *b = calloc(1, sizeof(Batch));
+    size_t stride;
+    int a, l;
+
+    if (!b)
+    {
+        return NULL;
+    }
+
+    stride = (lanes + BATCH_BLOCK - 1) / BATCH_BLOCK * BATCH_BLOCK;
+    b->lanes = lanes;
+    b->stride = stride;
+    b->code = code;
+    b->code_size = code_size;
+    b->vector_length = vector_length;
+    b->pc = calloc(stride, sizeof(int));
+    b->state = calloc(stride, sizeof(int));
+    b->retired = calloc(stride, sizeof(int));
+    b->path[0] = calloc(stride, sizeof(unsigned int));
+    b->path[1] = calloc(stride, sizeof(unsigned int));
+    b->flags = calloc(3 * stride, sizeof(int));
+    b->regs = calloc(REG_FILE_SIZE * stride, sizeof(int));
+    b->vregs = calloc(VEC_REG_FILE_SIZE * MAX_VECTOR_LENGTH * stride,
+                      sizeof(int));
+    b->memory = calloc(DATA_MEMORY_SIZE * stride, sizeof(int));
+    if (!b->pc || !b->state || !b->retired || !b->path[0] || !b->path[1]
+        || !b->flags || !b->regs || !b->vregs || !b->memory)
+    {
+        batch_free(b);
+        return NULL;
+    }
+
+    for (l = 0; l < (int)stride; ++l)
+    {
+        b->pc[l] = CODE_START_PC;
+        b->path[0][l] = PATH_SEED;
+        b->state[l] = l < lanes ? LANE_RUNNING : LANE_HALTED;
+    }
+
+    for (a = 0; a < DATA_MEMORY_SIZE; ++a)
+    {
+        for (l = 0; l < lanes; ++l)
+        {
+            ROW(b, memory, a)[l] = images[l][a];
+        }
+    }
+    return b;
+}
+
+static void
+set_flags(Batch *b, int l, int value)
+{
+    ROW(b, flags, FLAG_Z)[l] = (value == 0);
+    ROW(b, flags, FLAG_P)[l] = (value > 0);
+    ROW(b, flags, FLAG_N)[l] = (value < 0);
+}
+
+static int
+bad_address(int address)
+{
+    return address < 0 || address >= DATA_MEMORY_SIZE;
+}
+
+static void
+follow_path(Batch *b, int l, int target)
+{
+    b->path[0][l] = (b->path[0][l] * PATH_MUL0) ^ (unsigned int)target;
+    b->path[1][l] = b->path[1][l] * PATH_MUL1 + (unsigned int)target;
+}
+
+/* Executes insn, at pc, for lane l alone. Same semantics as apex_golden.c */
+static void
+step_lane(Batch *b, const APEX_Instruction *insn, int pc, int l)
+{
+    int a = ROW(b, regs, insn->rs1)[l];
+    int c = ROW(b, regs, insn->rs2)[l];
+    int *rd = &ROW(b, regs, insn->rd)[l];
+    int next = pc + 4, taken = -1, address, i;
+    unsigned int sum;
+
+    switch (insn->opcode)
+    {
+        case OPCODE_ADD:
+            *rd = (int)((unsigned int)a + (unsigned int)c);
+            set_flags(b, l, *rd);
+            break;
+
+        case OPCODE_ADDL:
+            *rd = (int)((unsigned int)a + (unsigned int)insn->imm);
+            set_flags(b, l, *rd);
+            break;
+
+        case OPCODE_SUB:
+            *rd = (int)((unsigned int)a - (unsigned int)c);
+            set_flags(b, l, *rd);
+            break;
+
+        case OPCODE_SUBL:
+            *rd = (int)((unsigned int)a - (unsigned int)insn->imm);
+            set_flags(b, l, *rd);
+            break;
+
+        case OPCODE_MUL:
+            *rd = (int)((unsigned int)a * (unsigned int)c);
+            set_flags(b, l, *rd);
+            break;
+
+        case OPCODE_DIV:
+            /* Zero for a zero divisor, INT_MIN / -1 wraps, as in the
+             * pipeline */
+            *rd = c == 0 ? 0 : c == -1 ? (int)(0u - (unsigned int)a) : a / c;
+            set_flags(b, l, *rd);
+            break;
+
+        case OPCODE_AND:
+            *rd = a & c;
+            ROW(b, flags, FLAG_Z)[l] = (*rd == 0);
+            break;
+
+        case OPCODE_OR:
+            *rd = a | c;
+            break;
+
+        case OPCODE_XOR:
+            *rd = a ^ c;
+            break;
+
+        case OPCODE_MOVC:
+            *rd = insn->imm;
+            ROW(b, flags, FLAG_Z)[l] = (insn->imm == 0);
+            break;
+
+        case OPCODE_CMP:
+            set_flags(b, l, (a > c) - (a < c));
+            break;
+
+        case OPCODE_CML:
+            set_flags(b, l, (a > insn->imm) - (a < insn->imm));
+            break;
+
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+            address = a + insn->imm;
+            if (bad_address(address))
+            {
+                b->state[l] = LANE_FAULT;
+                return;
+            }
+
+            /* The post-incremented base is written before rd */
+            if (insn->opcode == OPCODE_LOADP)
+            {
+                ROW(b, regs, insn->rs1)[l] = a + 4;
+            }
+            *rd = ROW(b, memory, address)[l];
+            break;
+
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+            address = a + insn->imm;
+            if (bad_address(address))
+            {
+                b->state[l] = LANE_FAULT;
+                return;
+            }
+
+            ROW(b, memory, address)[l] = c;
+            if (insn->opcode == OPCODE_STOREP)
+            {
+                ROW(b, regs, insn->rs1)[l] = a + 4;
+            }
+            break;
+
+        case OPCODE_BZ:
+            taken = ROW(b, flags, FLAG_Z)[l];
+            break;
+
+        case OPCODE_BNZ:
+            taken = !ROW(b, flags, FLAG_Z)[l];
+            break;
+
+        case OPCODE_BP:
+            taken = ROW(b, flags, FLAG_P)[l];
+            break;
+
+        case OPCODE_BNP:
+            taken = !ROW(b, flags, FLAG_P)[l];
+            break;
+
+        case OPCODE_BN:
+            taken = ROW(b, flags, FLAG_N)[l];
+            break;
+
+        case OPCODE_BNN:
+            taken = !ROW(b, flags, FLAG_N)[l];
+            break;
+
+        case OPCODE_JUMP:
+            next = a + insn->imm;
+            follow_path(b, l, next);
+            break;
+
+        case OPCODE_JALR:
+            *rd = pc + 4;
+            next = a + insn->imm;
+            follow_path(b, l, next);
+            break;
+
+        case OPCODE_VLOAD:
+        case OPCODE_VSTORE:
+            address = a + insn->imm;
+            if (bad_address(address)
+                || bad_address(address + 4 * (b->vector_length - 1)))
+            {
+                b->state[l] = LANE_FAULT;
+                return;
+            }
+
+            for (i = 0; i < MAX_VECTOR_LENGTH; ++i)
+            {
+                if (insn->opcode == OPCODE_VSTORE)
+                {
+                    if (i < b->vector_length)
+                    {
+                        ROW(b, memory, address + 4 * i)[l]
+                            = VROW(b, insn->rs2, i)[l];
+                    }
+                }
+                else
+                {
+                    VROW(b, insn->rd, i)[l]
+                        = i < b->vector_length
+                              ? ROW(b, memory, address + 4 * i)[l]
+                              : 0;
+                }
+            }
+            break;
+
+        case OPCODE_VADD:
+        case OPCODE_VMUL:
+            for (i = 0; i < MAX_VECTOR_LENGTH; ++i)
+            {
+                a = VROW(b, insn->rs1, i)[l];
+                c = VROW(b, insn->rs2, i)[l];
+                VROW(b, insn->rd, i)[l]
+                    = insn->opcode == OPCODE_VADD
+                          ? (int)((unsigned int)a + (unsigned int)c)
+                          : (int)((unsigned int)a * (unsigned int)c);
+            }
+            break;
+
+        case OPCODE_VRED:
+            sum = 0;
+            for (i = 0; i < MAX_VECTOR_LENGTH; ++i)
+            {
+                sum += (unsigned int)VROW(b, insn->rs1, i)[l];
+            }
+            *rd = (int)sum;
+            break;
+
+        case OPCODE_HALT:
+            b->state[l] = LANE_HALTED;
+            break;
+
+        case OPCODE_NOP:
+            b->pc[l] = next;
+            return;
+    }
+
+    if (taken >= 0)
+    {
+        next = taken ? pc + insn->imm : pc + 4;
+        follow_path(b, l, next);
+    }
+
+    b->pc[l] = next;
+    b->retired[l]++;
+}
+
+/* Opcodes step_block_avx2() handles */
+static int
+is_lockstep_opcode(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_MOVC:
+        case OPCODE_CMP:
+        case OPCODE_CML:
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        case OPCODE_HALT:
+        case OPCODE_NOP:
+            return TRUE;
+    }
+    return FALSE;
+}
+
+#ifdef BATCH_X86
+__attribute__((target("avx2"))) static void
+store_flags_avx2(Batch *b, int base, __m256i mask, __m256i zero, __m256i pos,
+                 __m256i neg)
+{
+    _mm256_maskstore_epi32(ROW(b, flags, FLAG_Z) + base, mask,
+                           _mm256_srli_epi32(zero, 31));
+    _mm256_maskstore_epi32(ROW(b, flags, FLAG_P) + base, mask,
+                           _mm256_srli_epi32(pos, 31));
+    _mm256_maskstore_epi32(ROW(b, flags, FLAG_N) + base, mask,
+                           _mm256_srli_epi32(neg, 31));
+}
+
+/* Flags of an arithmetic result */
+__attribute__((target("avx2"))) static void
+set_flags_avx2(Batch *b, int base, __m256i mask, __m256i value)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    store_flags_avx2(b, base, mask, _mm256_cmpeq_epi32(value, zero),
+                     _mm256_cmpgt_epi32(value, zero),
+                     _mm256_cmpgt_epi32(zero, value));
+}
+
+/*
+ * Executes insn, at pc, for the lanes of block base that are running and at
+ * pc. insn is one of is_lockstep_opcode().
+ */
+__attribute__((target("avx2"))) static void
+step_block_avx2(Batch *b, const APEX_Instruction *insn, int pc, int base)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    __m256i lane_pc = _mm256_loadu_si256((const __m256i *)(b->pc + base));
+    __m256i mask, a, c, imm, result, address, index, bad, next, taken, flag;
+    __m256i h0, h1;
+    int *rd = ROW(b, regs, insn->rd) + base;
+    int *rs1 = ROW(b, regs, insn->rs1) + base;
+
+    mask = _mm256_and_si256(
+        _mm256_cmpeq_epi32(lane_pc, _mm256_set1_epi32(pc)),
+        _mm256_cmpeq_epi32(
+            _mm256_loadu_si256((const __m256i *)(b->state + base)), zero));
+    if (_mm256_testz_si256(mask, mask))
+    {
+        return;
+    }
+
+    a = _mm256_loadu_si256((const __m256i *)rs1);
+    c = _mm256_loadu_si256((const __m256i *)(ROW(b, regs, insn->rs2) + base));
+    imm = _mm256_set1_epi32(insn->imm);
+    next = _mm256_add_epi32(lane_pc, _mm256_set1_epi32(4));
+
+    switch (insn->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+            result = _mm256_add_epi32(a, insn->opcode == OPCODE_ADD ? c : imm);
+            _mm256_maskstore_epi32(rd, mask, result);
+            set_flags_avx2(b, base, mask, result);
+            break;
+
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+            result = _mm256_sub_epi32(a, insn->opcode == OPCODE_SUB ? c : imm);
+            _mm256_maskstore_epi32(rd, mask, result);
+            set_flags_avx2(b, base, mask, result);
+            break;
+
+        case OPCODE_MUL:
+            result = _mm256_mullo_epi32(a, c);
+            _mm256_maskstore_epi32(rd, mask, result);
+            set_flags_avx2(b, base, mask, result);
+            break;
+
+        case OPCODE_AND:
+            result = _mm256_and_si256(a, c);
+            _mm256_maskstore_epi32(rd, mask, result);
+            _mm256_maskstore_epi32(
+                ROW(b, flags, FLAG_Z) + base, mask,
+                _mm256_srli_epi32(_mm256_cmpeq_epi32(result, zero), 31));
+            break;
+
+        case OPCODE_OR:
+            _mm256_maskstore_epi32(rd, mask, _mm256_or_si256(a, c));
+            break;
+
+        case OPCODE_XOR:
+            _mm256_maskstore_epi32(rd, mask, _mm256_xor_si256(a, c));
+            break;
+
+        case OPCODE_MOVC:
+            _mm256_maskstore_epi32(rd, mask, imm);
+            _mm256_maskstore_epi32(ROW(b, flags, FLAG_Z) + base, mask,
+                                   _mm256_set1_epi32(insn->imm == 0));
+            break;
+
+        case OPCODE_CMP:
+        case OPCODE_CML:
+            c = insn->opcode == OPCODE_CMP ? c : imm;
+            store_flags_avx2(b, base, mask, _mm256_cmpeq_epi32(a, c),
+                             _mm256_cmpgt_epi32(a, c), _mm256_cmpgt_epi32(c, a));
+            break;
+
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+            address = _mm256_add_epi32(a, imm);
+            bad = _mm256_and_si256(
+                mask,
+                _mm256_or_si256(
+                    _mm256_cmpgt_epi32(zero, address),
+                    _mm256_cmpgt_epi32(address,
+                                       _mm256_set1_epi32(DATA_MEMORY_SIZE - 1))));
+            _mm256_maskstore_epi32(b->state + base, bad,
+                                   _mm256_set1_epi32(LANE_FAULT));
+            mask = _mm256_andnot_si256(bad, mask);
+
+            /* Word a of lane l sits at a * stride + l */
+            index = _mm256_add_epi32(
+                _mm256_mullo_epi32(address, _mm256_set1_epi32(b->stride)),
+                _mm256_add_epi32(_mm256_set1_epi32(base),
+                                 _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+            index = _mm256_and_si256(index, mask);
+            result = _mm256_mask_i32gather_epi32(zero, b->memory, index, mask, 4);
+            if (insn->opcode == OPCODE_LOADP)
+            {
+                _mm256_maskstore_epi32(rs1, mask, _mm256_add_epi32(a, _mm256_set1_epi32(4)));
+            }
+            _mm256_maskstore_epi32(rd, mask, result);
+            break;
+
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+            flag = _mm256_loadu_si256((const __m256i *)(ROW(b, flags,
+                insn->opcode == OPCODE_BZ || insn->opcode == OPCODE_BNZ
+                    ? FLAG_Z
+                    : insn->opcode == OPCODE_BP || insn->opcode == OPCODE_BNP
+                          ? FLAG_P
+                          : FLAG_N) + base));
+            taken = _mm256_cmpeq_epi32(
+                flag, insn->opcode == OPCODE_BZ || insn->opcode == OPCODE_BP
+                              || insn->opcode == OPCODE_BN
+                          ? one
+                          : zero);
+            next = _mm256_blendv_epi8(next, _mm256_add_epi32(lane_pc, imm),
+                                      taken);
+
+            h0 = _mm256_loadu_si256((const __m256i *)(b->path[0] + base));
+            h1 = _mm256_loadu_si256((const __m256i *)(b->path[1] + base));
+            h0 = _mm256_xor_si256(
+                _mm256_mullo_epi32(h0, _mm256_set1_epi32((int)PATH_MUL0)), next);
+            h1 = _mm256_add_epi32(
+                _mm256_mullo_epi32(h1, _mm256_set1_epi32((int)PATH_MUL1)), next);
+            _mm256_maskstore_epi32((int *)b->path[0] + base, mask, h0);
+            _mm256_maskstore_epi32((int *)b->path[1] + base, mask, h1);
+            break;
+
+        case OPCODE_HALT:
+            _mm256_maskstore_epi32(b->state + base, mask,
+                                   _mm256_set1_epi32(LANE_HALTED));
+            break;
+
+        case OPCODE_NOP:
+            _mm256_maskstore_epi32(b->pc + base, mask, next);
+            return;
+    }
+
+    _mm256_maskstore_epi32(b->pc + base, mask, next);
+    _mm256_maskstore_epi32(
+        b->retired + base, mask,
+        _mm256_add_epi32(
+            _mm256_loadu_si256((const __m256i *)(b->retired + base)), one));
+}
+
+/* Lowest pc of a running lane, INT_MAX when none is left */
+__attribute__((target("avx2"))) static int
+group_pc_avx2(const Batch *b)
+{
+    const __m256i none = _mm256_set1_epi32(INT_MAX);
+    __m256i best = none, running;
+    __m128i m;
+    int base;
+
+    for (base = 0; base < b->stride; base += BATCH_BLOCK)
+    {
+        running = _mm256_cmpeq_epi32(
+            _mm256_loadu_si256((const __m256i *)(b->state + base)),
+            _mm256_setzero_si256());
+        best = _mm256_min_epi32(
+            best,
+            _mm256_blendv_epi8(
+                none, _mm256_loadu_si256((const __m256i *)(b->pc + base)),
+                running));
+    }
+
+    m = _mm_min_epi32(_mm256_castsi256_si128(best),
+                      _mm256_extracti128_si256(best, 1));
+    m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(m);
+}
+#endif
+
+static int
+group_pc(const Batch *b, int avx2)
+{
+    int best = INT_MAX, l;
+
+#ifdef BATCH_X86
+    if (avx2)
+    {
+        return group_pc_avx2(b);
+    }
+#endif
+
+    for (l = 0; l < b->stride; ++l)
+    {
+        if (b->state[l] == LANE_RUNNING && b->pc[l] < best)
+        {
+            best = b->pc[l];
+        }
+    }
+    return best;
+}
+
+/* Executes insn, at pc, for the lanes of block base that are running and at
+ * pc, eight at a time when avx2 and insn allow */
+static void
+step_block(Batch *b, const APEX_Instruction *insn, int pc, int base, int avx2)
+{
+    int l;
+
+#ifdef BATCH_X86
+    if (avx2 && is_lockstep_opcode(insn->opcode))
+    {
+        step_block_avx2(b, insn, pc, base);
+        return;
+    }
+#endif
+    for (l = base; l < base + BATCH_BLOCK; ++l)
+    {
+        if (b->state[l] == LANE_RUNNING && b->pc[l] == pc)
+        {
+            step_lane(b, insn, pc, l);
+        }
+    }
+}
+
+/*
+ * Runs all lanes to HALT, a fault or, with limit, limit instructions. A
+ * pair the pipeline fuses, see apex_fusion.c, runs in one step, head then
+ * tail block by block while the lanes are still hot; such a step counts as
+ * two. A lane retires at most one instruction per step counted, so none can
+ * reach the limit before step limit.
+ */
+static void
+run_lockstep(Batch *b, int limit, int fusion, int avx2)
+{
+    const APEX_Instruction *insn;
+    long steps = 0;
+    int pc, index, base, l, fused;
+
+    while ((pc = group_pc(b, avx2)) != INT_MAX)
+    {
+        index = PC_TO_CODE_INDEX(pc);
+        if (pc % 4 || index < 0 || index >= b->code_size)
+        {
+            for (l = 0; l < b->stride; ++l)
+            {
+                if (b->state[l] == LANE_RUNNING && b->pc[l] == pc)
+                {
+                    b->state[l] = LANE_FAULT;
+                }
+            }
+            continue;
+        }
+
+        insn = &b->code[index];
+        fused = index + 1 < b->code_size && (!limit || steps + 2 <= limit)
+                && APEX_fusion_match(fusion, insn, insn + 1) != FUSE_NONE;
+        for (base = 0; base < b->stride; base += BATCH_BLOCK)
+        {
+            step_block(b, insn, pc, base, avx2);
+            if (fused)
+            {
+                step_block(b, insn + 1, pc + 4, base, avx2);
+            }
+        }
+
+        steps += fused ? 2 : 1;
+        if (limit && steps >= limit)
+        {
+            for (l = 0; l < b->stride; ++l)
+            {
+                if (b->state[l] == LANE_RUNNING && b->retired[l] >= limit)
+                {
+                    b->state[l] = LANE_LIMIT;
+                }
+            }
+        }
+    }
+}
+
+/* Compares the final state of lane l with the pipeline that ran its image */
+static int
+check_lane(const Batch *b, int l, const APEX_CPU *cpu, const char *image)
+{
+    int i, j;
+
+    if (cpu->insn_completed != b->retired[l])
+    {
+        fprintf(stderr,
+                "APEX_Error: %s: pipeline retired %d instructions, lockstep "
+                "engine %d\n",
+                image, cpu->insn_completed, b->retired[l]);
+        return -1;
+    }
+
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        if (cpu->regs[i] != ROW(b, regs, i)[l])
+        {
+            fprintf(stderr,
+                    "APEX_Error: %s: R%d pipeline %d, lockstep engine %d\n",
+                    image, i, cpu->regs[i], ROW(b, regs, i)[l]);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < VEC_REG_FILE_SIZE; ++i)
+    {
+        for (j = 0; j < MAX_VECTOR_LENGTH; ++j)
+        {
+            if (cpu->vregs[i][j] != VROW(b, i, j)[l])
+            {
+                fprintf(stderr,
+                        "APEX_Error: %s: V%d lane %d pipeline %d, lockstep "
+                        "engine %d\n",
+                        image, i, j, cpu->vregs[i][j], VROW(b, i, j)[l]);
+                return -1;
+            }
+        }
+    }
+
+    if (cpu->zero_flag != ROW(b, flags, FLAG_Z)[l]
+        || cpu->pos_flag != ROW(b, flags, FLAG_P)[l]
+        || cpu->neg_flag != ROW(b, flags, FLAG_N)[l])
+    {
+        fprintf(stderr, "APEX_Error: %s: flags differ from the pipeline\n",
+                image);
+        return -1;
+    }
+
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        if (cpu->data_memory[i] != ROW(b, memory, i)[l])
+        {
+            fprintf(stderr,
+                    "APEX_Error: %s: M[%d] pipeline %d, lockstep engine %d\n",
+                    image, i, cpu->data_memory[i], ROW(b, memory, i)[l]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Runs the pipeline on image and checks it against lane l */
+static int
+run_pipeline(const char *program, const APEX_Config *config, const Batch *b,
+             int l, const int *image, const char *name, Batch_Path *path)
+{
+    APEX_CPU *cpu = APEX_cpu_init(program, config);
+    int status = 0;
+
+    if (!cpu)
+    {
+        fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+        return -1;
+    }
+
+    APEX_cpu_set_data_memory(cpu, image);
+    APEX_cpu_run(cpu);
+
+    path->cycles = cpu->clock;
+    path->halted = cpu->halted && !cpu->diverged;
+    if (cpu->diverged || (path->halted && check_lane(b, l, cpu, name)))
+    {
+        status = -1;
+    }
+
+    APEX_cpu_stop(cpu);
+    return status;
+}
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "APEX_Help: Usage %s [-o <results.csv>] [-c] [-f] "
+            "[<param>=<value> ...] <program.asm> <image> ...\n",
+            prog);
+    fprintf(stderr,
+            "APEX_Help: -c runs and checks the pipeline on every image, -f "
+            "skips the pipeline, no cycle counts\n");
+}
+
+int
+main(int argc, char const *argv[])
+{
+    APEX_Config config;
+    APEX_Instruction *code;
+    Batch *b;
+    Batch_Path *paths;
+    const char *output = "batch_results.csv";
+    const char *program = NULL;
+    const char **names;
+    int (*images)[DATA_MEMORY_SIZE];
+    int *lane_path;
+    int check_all = FALSE, functional = FALSE, avx2 = host_has_avx2();
+    int lanes = 0, num_paths = 0, code_size, failed = 0, i, l, p;
+    int stdout_fd, null_fd;
+    double start, lockstep_seconds, pipeline_seconds;
+    long long insns = 0;
+    FILE *fp;
+
+    APEX_config_defaults(&config);
+    names = calloc(argc, sizeof(char *));
+    if (!names)
+    {
+        exit(1);
+    }
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (strcmp(argv[i], "-c") == 0)
+        {
+            check_all = TRUE;
+        }
+        else if (strcmp(argv[i], "-f") == 0)
+        {
+            functional = TRUE;
+        }
+        else if (argv[i][0] == '-')
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+        else if (strchr(argv[i], '='))
+        {
+            if (APEX_config_parse(&config, argv[i]))
+            {
+                fprintf(stderr, "apex_batch: invalid parameter '%s'\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (!program)
+        {
+            program = argv[i];
+        }
+        else if (lanes < BATCH_MAX_LANES)
+        {
+            names[lanes++] = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "apex_batch: at most %d images\n", BATCH_MAX_LANES);
+            exit(1);
+        }
+    }
+
+    if (!program || !lanes)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+    config.debug_messages = FALSE;
+    config.single_step = FALSE;
+
+    code = create_code_memory(program, &code_size);
+    images = calloc(lanes, sizeof(*images));
+    lane_path = calloc(lanes, sizeof(int));
+    paths = calloc(lanes, sizeof(Batch_Path));
+    if (!code || !images || !lane_path || !paths)
+    {
+        fprintf(stderr, "APEX_Error: Unable to load %s\n", program);
+        exit(1);
+    }
+
+    for (l = 0; l < lanes; ++l)
+    {
+        if (load_data_image(names[l], images[l]))
+        {
+            exit(1);
+        }
+    }
+
+    b = batch_create(code, code_size, config.vector_length, lanes, images);
+    if (!b)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate %d lanes\n", lanes);
+        exit(1);
+    }
+
+    start = now_seconds();
+    run_lockstep(b, config.max_cycles, config.fusion, avx2);
+    lockstep_seconds = now_seconds() - start;
+
+    /* Lanes on the same path share a pipeline run, unless timing depends on
+     * addresses */
+    check_all |= config.store_buffer || config.prefetcher != PREFETCH_NONE
+                 || config.value_predictor != LVP_NONE;
+    for (l = 0; l < lanes; ++l)
+    {
+        insns += b->retired[l];
+        for (p = 0; !check_all && p < num_paths; ++p)
+        {
+            i = paths[p].lane;
+            if (b->state[i] == b->state[l] && b->retired[i] == b->retired[l]
+                && b->path[0][i] == b->path[0][l]
+                && b->path[1][i] == b->path[1][l])
+            {
+                break;
+            }
+        }
+
+        if (check_all || p == num_paths)
+        {
+            p = num_paths++;
+            paths[p].lane = l;
+        }
+        lane_path[l] = p;
+    }
+
+    /* The pipeline reports completion on stdout, keep it out of the way */
+    fflush(stdout);
+    stdout_fd = dup(STDOUT_FILENO);
+    null_fd = open("/dev/null", O_WRONLY);
+    if (stdout_fd >= 0 && null_fd >= 0)
+    {
+        dup2(null_fd, STDOUT_FILENO);
+    }
+
+    start = now_seconds();
+    for (p = 0; !functional && p < num_paths; ++p)
+    {
+        l = paths[p].lane;
+        if (b->state[l] != LANE_FAULT
+            && run_pipeline(program, &config, b, l, images[l], names[l],
+                            &paths[p]))
+        {
+            failed = 1;
+        }
+    }
+    pipeline_seconds = now_seconds() - start;
+
+    fflush(stdout);
+    if (stdout_fd >= 0 && null_fd >= 0)
+    {
+        dup2(stdout_fd, STDOUT_FILENO);
+        close(stdout_fd);
+        close(null_fd);
+    }
+
+    fp = fopen(output, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", output);
+        exit(1);
+    }
+
+    fprintf(fp, "lane,image,status,instructions,cycles,path");
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        fprintf(fp, ",R%d", i);
+    }
+    fprintf(fp, "\n");
+
+    for (l = 0; l < lanes; ++l)
+    {
+        p = lane_path[l];
+
+        /* A lane may halt in the engine but not within max_cycles cycles */
+        i = b->state[l];
+        if (i == LANE_HALTED && !functional && !paths[p].halted)
+        {
+            i = LANE_LIMIT;
+        }
+
+        fprintf(fp, "%d,%s,%s,%d,%d,%d", l, names[l], state_names[i],
+                b->retired[l], functional ? 0 : paths[p].cycles, p);
+        for (i = 0; i < REG_FILE_SIZE; ++i)
+        {
+            fprintf(fp, ",%d", ROW(b, regs, i)[l]);
+        }
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
+
+    printf("apex_batch: %d lanes, %d paths, %d pipeline runs\n", lanes,
+           num_paths, functional ? 0 : num_paths);
+    printf("lockstep   %10.2f ms  %.2f M lane-instructions/s (%s)\n",
+           lockstep_seconds * 1e3,
+           lockstep_seconds > 0 ? insns / lockstep_seconds * 1e-6 : 0.0,
+           avx2 ? "avx2" : "scalar");
+    if (!functional)
+    {
+        printf("pipeline   %10.2f ms\n", pipeline_seconds * 1e3);
+    }
+    printf("Results written to %s\n", output);
+
+    batch_free(b);
+    free(code);
+    free(images);
+    free(lane_path);
+    free(paths);
+    free(names);
+    return failed;
+}
@@ -0,0 +1,538 @@
+/*
+ * apex_bench.c
+ * Benchmark harness. Runs each kernel headless and reports simulated cycles,
+ * IPC and host simulation speed, and writes the same numbers as JSON so they
+ * can be tracked across commits.
+ *
+ * With repeats (-r) and warmup runs (-w) it doubles as the host speed
+ * regression gate behind 'make perf': every phase (parse, run, teardown) is
+ * timed separately, medians are reported, and the geometric means of host
+ * nanoseconds per simulated cycle and per retired instruction are compared
+ * against a stored baseline (-b).
+ * A missing baseline fails the gate rather than passing it silently.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_recorder.h"
+
+#define BENCH_MAX_REPEATS 64
+
+/* Simulator phases timed separately */
+#define PHASE_PARSE 0
+#define PHASE_RUN 1
+#define PHASE_TEARDOWN 2
+#define NUM_PHASES 3
+
+typedef struct Bench_Result
+{
+    const char *path;
+    char name[64];
+    int halted;
+    int cycles;
+    int insns;
+    double phase_seconds[NUM_PHASES]; /* Medians over the measured repeats */
+    double baseline_ns_per_cycle;     /* 0 when the baseline lacks the kernel */
+    double baseline_ns_per_insn;
+} Bench_Result;
+
+typedef struct Bench_Options
+{
+    const char *output;
+    const char *label;
+    const char *baseline;      /* Compare against this baseline file */
+    const char *save_baseline; /* Write measured numbers as the new baseline */
+    int repeats;
+    int warmup;
+    double threshold;          /* Allowed slowdown in percent */
+} Bench_Options;
+
+static const char *phase_names[NUM_PHASES] = {"parse", "run", "teardown"};
+
+static double
+now_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Kernel name without directory and extension */
+static void
+kernel_name(const char *path, char *buf, int size)
+{
+    const char *base = strrchr(path, '/');
+    const char *dot;
+
+    base = base ? base + 1 : path;
+    dot = strrchr(base, '.');
+    snprintf(buf, size, "%.*s", dot ? (int)(dot - base) : (int)strlen(base),
+             base);
+}
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double
+median(double *samples, int count)
+{
+    qsort(samples, count, sizeof(double), compare_doubles);
+    return count % 2 ? samples[count / 2]
+                     : 0.5 * (samples[count / 2 - 1] + samples[count / 2]);
+}
+
+/* One complete simulation, timing each phase */
+static int
+run_once(const char *path, const APEX_Config *config, Bench_Result *r,
+         double phase_seconds[NUM_PHASES])
+{
+    APEX_CPU *cpu;
+    APEX_Recorder *recorder;
+    double t0, t1, t2, t3;
+
+    /* Records every cycle as apex_sim does by default, so the gate times
+     * the configuration users actually run. Never armed or dumped here, and
+     * allocated before the clock starts so parse times only the parse */
+    recorder = APEX_recorder_create(FLIGHT_CYCLES, FLIGHT_FILE);
+    if (!recorder)
+    {
+        return -1;
+    }
+    t0 = now_seconds();
+    cpu = APEX_cpu_init(path, config);
+    if (!cpu)
+    {
+        APEX_recorder_free(recorder);
+        return -1;
+    }
+    cpu->recorder = recorder;
+
+    t1 = now_seconds();
+    APEX_cpu_run(cpu);
+    t2 = now_seconds();
+
+    r->halted = cpu->halted;
+    r->cycles = cpu->clock;
+    r->insns = cpu->insn_completed;
+
+    APEX_cpu_stop(cpu);
+    t3 = now_seconds();
+
+    phase_seconds[PHASE_PARSE] = t1 - t0;
+    phase_seconds[PHASE_RUN] = t2 - t1;
+    phase_seconds[PHASE_TEARDOWN] = t3 - t2;
+    return 0;
+}
+
+static int
+run_kernel(const char *path, const APEX_Config *config,
+           const Bench_Options *opts, Bench_Result *r)
+{
+    double samples[NUM_PHASES][BENCH_MAX_REPEATS];
+    double phase_seconds[NUM_PHASES];
+    int i, p;
+
+    r->path = path;
+    kernel_name(path, r->name, sizeof(r->name));
+
+    for (i = 0; i < opts->warmup + opts->repeats; ++i)
+    {
+        if (run_once(path, config, r, phase_seconds))
+        {
+            fprintf(stderr, "apex_bench: unable to load %s\n", path);
+            return -1;
+        }
+
+        if (i >= opts->warmup)
+        {
+            for (p = 0; p < NUM_PHASES; ++p)
+            {
+                samples[p][i - opts->warmup] = phase_seconds[p];
+            }
+        }
+    }
+
+    for (p = 0; p < NUM_PHASES; ++p)
+    {
+        r->phase_seconds[p] = median(samples[p], opts->repeats);
+    }
+    return 0;
+}
+
+static double
+host_mips(const Bench_Result *r)
+{
+    return r->phase_seconds[PHASE_RUN] > 0
+               ? r->insns / r->phase_seconds[PHASE_RUN] / 1e6
+               : 0.0;
+}
+
+static double
+ns_per_cycle(const Bench_Result *r)
+{
+    return r->cycles ? r->phase_seconds[PHASE_RUN] * 1e9 / r->cycles : 0.0;
+}
+
+static double
+ns_per_insn(const Bench_Result *r)
+{
+    return r->insns ? r->phase_seconds[PHASE_RUN] * 1e9 / r->insns : 0.0;
+}
+
+static double
+ipc(const Bench_Result *r)
+{
+    return r->cycles ? (double)r->insns / r->cycles : 0.0;
+}
+
+static int
+write_json(const Bench_Options *opts, const APEX_Config *config,
+           const Bench_Result *results, int count)
+{
+    FILE *fp;
+    char value[32];
+    static const char *params[] = {"btb_size", "predictor", "forwarding",
+                                   "mul_latency", "mem_latency",
+                                   "vector_length", "vector_latency",
+                                   "store_buffer", "prefetcher",
+                                   "prefetch_degree", "prefetch_distance",
+                                   "icache_sets", "icache_ways", "icache_line",
+                                   "icache_latency", "fetch_queue", "ftq_size",
+                                   "loop_buffer", "fetch_stages",
+                                   "execute_stages", "memory_stages",
+                                   "value_predictor", "lvp_size",
+                                   "lvp_confidence", "branch_stage", "fusion",
+                                   NULL};
+    int i, p;
+
+    fp = fopen(opts->output, "w");
+    if (!fp)
+    {
+        perror(opts->output);
+        return -1;
+    }
+
+    fprintf(fp, "{\n  \"label\": \"%s\",\n  \"timestamp\": %ld,\n", opts->label,
+            (long)time(NULL));
+    fprintf(fp, "  \"repeats\": %d,\n  \"warmup\": %d,\n", opts->repeats,
+            opts->warmup);
+    fprintf(fp, "  \"config\": {");
+    for (i = 0; params[i]; ++i)
+    {
+        APEX_config_format(config, params[i], value, sizeof(value));
+        fprintf(fp, "%s\"%s\": \"%s\"", i ? ", " : "", params[i], value);
+    }
+    fprintf(fp, "},\n  \"kernels\": [\n");
+
+    for (i = 0; i < count; ++i)
+    {
+        const Bench_Result *r = &results[i];
+
+        fprintf(fp,
+                "    {\"name\": \"%s\", \"halted\": %s, \"cycles\": %d, "
+                "\"instructions\": %d, \"ipc\": %.4f, \"host_mips\": %.3f, "
+                "\"ns_per_cycle\": %.3f, \"ns_per_insn\": %.3f",
+                r->name, r->halted ? "true" : "false", r->cycles, r->insns,
+                ipc(r), host_mips(r), ns_per_cycle(r), ns_per_insn(r));
+        for (p = 0; p < NUM_PHASES; ++p)
+        {
+            fprintf(fp, ", \"%s_seconds\": %.9f", phase_names[p],
+                    r->phase_seconds[p]);
+        }
+        fprintf(fp, "}%s\n", i + 1 < count ? "," : "");
+    }
+
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * Baseline files hold one "<kernel> <ns_per_cycle> <ns_per_insn>" line per
+ * kernel. They are host specific, record one with -s on the machine that
+ * runs the gate.
+ */
+static int
+save_baseline(const char *filename, const Bench_Result *results, int count)
+{
+    FILE *fp;
+    int i;
+
+    fp = fopen(filename, "w");
+    if (!fp)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        fprintf(fp, "%s %.4f %.4f\n", results[i].name, ns_per_cycle(&results[i]),
+                ns_per_insn(&results[i]));
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+static int
+load_baseline(const char *filename, Bench_Result *results, int count)
+{
+    FILE *fp;
+    char name[64];
+    double cycle_ns, insn_ns;
+    int i;
+
+    fp = fopen(filename, "r");
+    if (!fp)
+    {
+        return -1;
+    }
+
+    while (fscanf(fp, "%63s %lf %lf", name, &cycle_ns, &insn_ns) == 3)
+    {
+        for (i = 0; i < count; ++i)
+        {
+            if (strcmp(results[i].name, name) == 0)
+            {
+                results[i].baseline_ns_per_cycle = cycle_ns;
+                results[i].baseline_ns_per_insn = insn_ns;
+            }
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * Compares against the baseline. Individual kernels are too short to gate on
+ * reliably, so the geometric mean ratios decide: ns per cycle, and ns per
+ * instruction so a change that trades cycles for instructions is caught too.
+ * Returns non-zero when either regresses beyond the threshold, or when there
+ * is nothing to compare against.
+ */
+static int
+check_baseline(const Bench_Options *opts, Bench_Result *results, int count)
+{
+    double cycle_log_sum = 0.0, insn_log_sum = 0.0;
+    double cycle_change, insn_change;
+    int i, compared = 0;
+
+    if (load_baseline(opts->baseline, results, count))
+    {
+        fprintf(stderr,
+                "APEX_Error: No baseline at %s, record one with "
+                "'make perf-baseline'\n",
+                opts->baseline);
+        return 1;
+    }
+
+    printf("%-16s %12s %12s %8s %12s %12s %8s\n", "kernel", "base_ns/cyc",
+           "ns/cyc", "change", "base_ns/ins", "ns/ins", "change");
+    for (i = 0; i < count; ++i)
+    {
+        if (results[i].baseline_ns_per_cycle <= 0 || ns_per_cycle(&results[i]) <= 0
+            || results[i].baseline_ns_per_insn <= 0 || ns_per_insn(&results[i]) <= 0)
+        {
+            continue;
+        }
+
+        cycle_change = ns_per_cycle(&results[i]) / results[i].baseline_ns_per_cycle;
+        insn_change = ns_per_insn(&results[i]) / results[i].baseline_ns_per_insn;
+        cycle_log_sum += log(cycle_change);
+        insn_log_sum += log(insn_change);
+        compared++;
+        printf("%-16s %12.3f %12.3f %+7.1f%% %12.3f %12.3f %+7.1f%%\n",
+               results[i].name, results[i].baseline_ns_per_cycle,
+               ns_per_cycle(&results[i]), (cycle_change - 1.0) * 100.0,
+               results[i].baseline_ns_per_insn, ns_per_insn(&results[i]),
+               (insn_change - 1.0) * 100.0);
+    }
+
+    if (!compared)
+    {
+        fprintf(stderr, "APEX_Error: Baseline %s has none of these kernels\n",
+                opts->baseline);
+        return 1;
+    }
+
+    cycle_change = (exp(cycle_log_sum / compared) - 1.0) * 100.0;
+    insn_change = (exp(insn_log_sum / compared) - 1.0) * 100.0;
+    printf("Geometric mean change %+.1f%% per cycle, %+.1f%% per instruction "
+           "(threshold %.1f%%): %s\n",
+           cycle_change, insn_change, opts->threshold,
+           cycle_change > opts->threshold || insn_change > opts->threshold
+               ? "FAIL"
+               : "ok");
+    return cycle_change > opts->threshold || insn_change > opts->threshold;
+}
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "APEX_Help: Usage %s [-o <results.json>] [-l <label>] "
+            "[-r <repeats>] [-w <warmup>] [-b <baseline>] [-s <baseline>] "
+            "[-t <percent>] [<param>=<value> ...] <kernel.asm> ...\n",
+            prog);
+}
+
+int
+main(int argc, char const *argv[])
+{
+    APEX_Config config;
+    Bench_Options opts;
+    Bench_Result *results;
+    int i, count = 0, failed = 0;
+    int stdout_fd, null_fd;
+
+    APEX_config_defaults(&config);
+    config.debug_messages = FALSE;
+    config.single_step = FALSE;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.output = "bench_results.json";
+    opts.label = "";
+    opts.repeats = 1;
+    opts.threshold = 10.0;
+
+    results = calloc(argc, sizeof(Bench_Result));
+    if (!results)
+    {
+        exit(1);
+    }
+
+    /* First pass: options and parameters */
+    for (i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] == '-' && argv[i][1] && !argv[i][2] && i + 1 < argc)
+        {
+            switch (argv[i][1])
+            {
+                case 'o': opts.output = argv[++i]; continue;
+                case 'l': opts.label = argv[++i]; continue;
+                case 'b': opts.baseline = argv[++i]; continue;
+                case 's': opts.save_baseline = argv[++i]; continue;
+                case 'r': opts.repeats = atoi(argv[++i]); continue;
+                case 'w': opts.warmup = atoi(argv[++i]); continue;
+                case 't': opts.threshold = atof(argv[++i]); continue;
+            }
+            print_usage(argv[0]);
+            exit(1);
+        }
+
+        if (strchr(argv[i], '=') && APEX_config_parse(&config, argv[i]))
+        {
+            fprintf(stderr, "apex_bench: invalid parameter '%s'\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    if (opts.repeats < 1 || opts.repeats > BENCH_MAX_REPEATS || opts.warmup < 0)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    /* The simulator reports completion on stdout, keep it out of the table */
+    fflush(stdout);
+    stdout_fd = dup(STDOUT_FILENO);
+    null_fd = open("/dev/null", O_WRONLY);
+    if (stdout_fd >= 0 && null_fd >= 0)
+    {
+        dup2(null_fd, STDOUT_FILENO);
+    }
+
+    /* Second pass: kernels */
+    for (i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] == '-' && argv[i][1] && !argv[i][2])
+        {
+            i++;
+            continue;
+        }
+
+        if (strchr(argv[i], '='))
+        {
+            continue;
+        }
+
+        if (run_kernel(argv[i], &config, &opts, &results[count]) == 0)
+        {
+            failed |= !results[count].halted;
+            count++;
+        }
+        else
+        {
+            failed = 1;
+        }
+    }
+
+    fflush(stdout);
+    if (stdout_fd >= 0 && null_fd >= 0)
+    {
+        dup2(stdout_fd, STDOUT_FILENO);
+        close(stdout_fd);
+        close(null_fd);
+    }
+
+    if (count == 0)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    printf("%-16s %10s %10s %7s %10s %10s %10s %9s %9s %9s\n", "kernel",
+           "cycles", "insns", "ipc", "parse_us", "run_ms", "teardn_us",
+           "ns/cycle", "ns/insn", "host_mips");
+    for (i = 0; i < count; ++i)
+    {
+        const Bench_Result *r = &results[i];
+
+        printf("%-16s %10d %10d %7.3f %10.1f %10.2f %10.1f %9.2f %9.2f %9.3f%s\n",
+               r->name, r->cycles, r->insns, ipc(r),
+               r->phase_seconds[PHASE_PARSE] * 1e6,
+               r->phase_seconds[PHASE_RUN] * 1e3,
+               r->phase_seconds[PHASE_TEARDOWN] * 1e6, ns_per_cycle(r),
+               ns_per_insn(r), host_mips(r), r->halted ? "" : "  (no HALT)");
+    }
+
+    if (write_json(&opts, &config, results, count))
+    {
+        failed = 1;
+    }
+    else
+    {
+        printf("Results written to %s\n", opts.output);
+    }
+
+    if (opts.save_baseline)
+    {
+        failed |= save_baseline(opts.save_baseline, results, count);
+        printf("Baseline written to %s\n", opts.save_baseline);
+    }
+    else if (opts.baseline)
+    {
+        failed |= check_baseline(&opts, results, count);
+    }
+
+    free(results);
+    return failed;
+}
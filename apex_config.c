@@ -0,0 +1,384 @@
+/*
+ * apex_config.c
+ * Run time micro-architecture configuration of the APEX cpu. Parameters are
+ * addressed by name so that the simulator command line and the design-space
+ * exploration driver share one table.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Symbolic names accepted for the predictor parameter, indexed by PREDICTOR_* */
+static const char *predictor_names[] = {"none", "history", "bimodal", NULL};
+
+/* Symbolic names accepted for the value_predictor parameter, indexed by
+ * LVP_* */
+static const char *value_predictor_names[] = {"none", "last", "stride", NULL};
+
+/* Symbolic names accepted for the branch_stage parameter, indexed by
+ * BRANCH_* */
+static const char *branch_stage_names[] = {"execute", "decode", NULL};
+
+/* Idioms of the fusion parameter, indexed by the bit of their FUSE_* value.
+ * Values join them with '+', or are "none" */
+static const char *fusion_names[] = {"cmp_branch", "movc_add", "addl_load",
+                                     NULL};
+
+/* Symbolic names accepted for the prefetcher parameter, indexed by
+ * PREFETCH_* */
+static const char *prefetcher_names[] = {"none", "next_line", "stride",
+                                         "stream", NULL};
+
+typedef struct Config_Param
+{
+    const char *name;
+    size_t offset;      /* Offset of the int field inside APEX_Config */
+    int min;
+    int max;
+    const char **names; /* Optional symbolic values, index is the value */
+    int mask;           /* names are bits of the value instead */
+} Config_Param;
+
+static const Config_Param config_params[] = {
+    {"btb_size", offsetof(APEX_Config, btb_size), 1, MAX_BTB_SIZE, NULL},
+    {"predictor", offsetof(APEX_Config, predictor), PREDICTOR_NONE,
+     PREDICTOR_BIMODAL, predictor_names},
+    {"forwarding", offsetof(APEX_Config, forwarding), 0, 1, NULL},
+    {"mul_latency", offsetof(APEX_Config, mul_latency), 1, 64, NULL},
+    {"mem_latency", offsetof(APEX_Config, mem_latency), 1, 64, NULL},
+    {"vector_length", offsetof(APEX_Config, vector_length), 1,
+     MAX_VECTOR_LENGTH, NULL},
+    {"vector_latency", offsetof(APEX_Config, vector_latency), 1, 64, NULL},
+    {"store_buffer", offsetof(APEX_Config, store_buffer), 0,
+     MAX_STORE_BUFFER_SIZE, NULL},
+    {"prefetcher", offsetof(APEX_Config, prefetcher), PREFETCH_NONE,
+     PREFETCH_STREAM, prefetcher_names},
+    {"prefetch_degree", offsetof(APEX_Config, prefetch_degree), 1,
+     MAX_PREFETCH_DEGREE, NULL},
+    {"prefetch_distance", offsetof(APEX_Config, prefetch_distance), 1,
+     MAX_PREFETCH_DISTANCE, NULL},
+    {"icache_sets", offsetof(APEX_Config, icache_sets), 0, MAX_ICACHE_SETS,
+     NULL},
+    {"icache_ways", offsetof(APEX_Config, icache_ways), 1, MAX_ICACHE_WAYS,
+     NULL},
+    {"icache_line", offsetof(APEX_Config, icache_line), 1, MAX_ICACHE_LINE,
+     NULL},
+    {"icache_latency", offsetof(APEX_Config, icache_latency), 1, 64, NULL},
+    {"fetch_queue", offsetof(APEX_Config, fetch_queue), 0,
+     MAX_FETCH_QUEUE_SIZE, NULL},
+    {"ftq_size", offsetof(APEX_Config, ftq_size), 1, MAX_FETCH_QUEUE_SIZE,
+     NULL},
+    {"loop_buffer", offsetof(APEX_Config, loop_buffer), 0,
+     MAX_LOOP_BUFFER_SIZE, NULL},
+    {"fetch_stages", offsetof(APEX_Config, fetch_stages), 1, MAX_SUB_STAGES,
+     NULL},
+    {"execute_stages", offsetof(APEX_Config, execute_stages), 1,
+     MAX_SUB_STAGES, NULL},
+    {"memory_stages", offsetof(APEX_Config, memory_stages), 1,
+     MAX_SUB_STAGES, NULL},
+    {"value_predictor", offsetof(APEX_Config, value_predictor), LVP_NONE,
+     LVP_STRIDE, value_predictor_names},
+    {"lvp_size", offsetof(APEX_Config, lvp_size), 1, MAX_LVP_SIZE, NULL},
+    {"lvp_confidence", offsetof(APEX_Config, lvp_confidence), 0,
+     LVP_CONFIDENCE_MAX, NULL},
+    {"branch_stage", offsetof(APEX_Config, branch_stage), BRANCH_EXECUTE,
+     BRANCH_DECODE, branch_stage_names},
+    {"fusion", offsetof(APEX_Config, fusion), FUSE_NONE, FUSE_ALL,
+     fusion_names, TRUE},
+    {"max_cycles", offsetof(APEX_Config, max_cycles), 0, 0x7fffffff, NULL},
+    {"debug_messages", offsetof(APEX_Config, debug_messages), 0, 1, NULL},
+    {"single_step", offsetof(APEX_Config, single_step), 0, 1, NULL},
+    {"snapshot_interval", offsetof(APEX_Config, snapshot_interval), 0,
+     0x7fffffff, NULL},
+    {"history_mb", offsetof(APEX_Config, history_mb), 1, 65536, NULL},
+    {"cosim", offsetof(APEX_Config, cosim), 0, 1, NULL},
+    {"watchdog", offsetof(APEX_Config, watchdog), 0, 0x7fffffff, NULL},
+    {"variants", offsetof(APEX_Config, variants), 0, 1, NULL},
+    {NULL, 0, 0, 0, NULL},
+};
+
+static const Config_Param *
+find_param(const char *key)
+{
+    const Config_Param *p;
+
+    for (p = config_params; p->name; ++p)
+    {
+        if (strcmp(p->name, key) == 0)
+        {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+static int *
+param_field(APEX_Config *config, const Config_Param *p)
+{
+    return (int *)((char *)config + p->offset);
+}
+
+void
+APEX_config_defaults(APEX_Config *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->btb_size = BTB_SIZE;
+    config->predictor = PREDICTOR_HISTORY;
+    config->forwarding = ENABLE_FORWARDING;
+    config->mul_latency = MUL_LATENCY;
+    config->mem_latency = MEM_LATENCY;
+    config->vector_length = VECTOR_LENGTH;
+    config->vector_latency = VECTOR_LATENCY;
+    config->store_buffer = STORE_BUFFER_SIZE;
+    config->prefetcher = PREFETCH_NONE;
+    config->prefetch_degree = PREFETCH_DEGREE;
+    config->prefetch_distance = PREFETCH_DISTANCE;
+    config->icache_sets = ICACHE_SETS;
+    config->icache_ways = ICACHE_WAYS;
+    config->icache_line = ICACHE_LINE;
+    config->icache_latency = ICACHE_LATENCY;
+    config->fetch_queue = FETCH_QUEUE_SIZE;
+    config->ftq_size = FTQ_SIZE;
+    config->loop_buffer = LOOP_BUFFER_SIZE;
+    config->fetch_stages = FETCH_STAGES;
+    config->execute_stages = EXECUTE_STAGES;
+    config->memory_stages = MEMORY_STAGES;
+    config->value_predictor = LVP_NONE;
+    config->lvp_size = LVP_SIZE;
+    config->lvp_confidence = LVP_CONFIDENCE;
+    config->branch_stage = BRANCH_EXECUTE;
+    config->fusion = FUSE_NONE;
+    config->max_cycles = 0;
+    config->debug_messages = ENABLE_DEBUG_MESSAGES;
+    config->single_step = ENABLE_SINGLE_STEP;
+    config->snapshot_interval = SNAPSHOT_INTERVAL;
+    config->history_mb = HISTORY_MB;
+    config->cosim = ENABLE_COSIM;
+    config->watchdog = WATCHDOG_CYCLES;
+    config->variants = ENABLE_VARIANTS;
+}
+
+/* Value of a '+' separated list of the bit names of p, -1 if one is not */
+static int
+parse_mask(const Config_Param *p, const char *value)
+{
+    const char *end;
+    int v = 0, i;
+
+    if (strcmp(value, "none") == 0)
+    {
+        return 0;
+    }
+
+    for (;;)
+    {
+        end = strchr(value, '+');
+        if (!end)
+        {
+            end = value + strlen(value);
+        }
+
+        for (i = 0; p->names[i]; ++i)
+        {
+            if (strlen(p->names[i]) == (size_t)(end - value)
+                && strncmp(p->names[i], value, end - value) == 0)
+            {
+                break;
+            }
+        }
+
+        if (!p->names[i])
+        {
+            return -1;
+        }
+
+        v |= 1 << i;
+        if (!*end)
+        {
+            return v;
+        }
+        value = end + 1;
+    }
+}
+
+/*
+ * Sets parameter key from its textual value. Returns 0 on success, -1 on an
+ * unknown key or an out of range value.
+ */
+int
+APEX_config_set(APEX_Config *config, const char *key, const char *value)
+{
+    const Config_Param *p = find_param(key);
+    char *end;
+    long v;
+    int i;
+
+    if (!p || !value || !*value)
+    {
+        return -1;
+    }
+
+    if (p->mask && (i = parse_mask(p, value)) >= 0)
+    {
+        *param_field(config, p) = i;
+        return 0;
+    }
+
+    if (p->names && !p->mask)
+    {
+        for (i = 0; p->names[i]; ++i)
+        {
+            if (strcmp(p->names[i], value) == 0)
+            {
+                *param_field(config, p) = i;
+                return 0;
+            }
+        }
+    }
+
+    v = strtol(value, &end, 0);
+    if (*end != '\0' || v < p->min || v > p->max)
+    {
+        return -1;
+    }
+
+    *param_field(config, p) = (int)v;
+    return 0;
+}
+
+/* Applies a "key=value" assignment */
+int
+APEX_config_parse(APEX_Config *config, const char *assignment)
+{
+    char key[64];
+    const char *eq = strchr(assignment, '=');
+
+    if (!eq || eq == assignment || eq - assignment >= (int)sizeof(key))
+    {
+        return -1;
+    }
+
+    memcpy(key, assignment, eq - assignment);
+    key[eq - assignment] = '\0';
+    return APEX_config_set(config, key, eq + 1);
+}
+
+/* Formats mask value v of p as the '+' separated names of its bits */
+static void
+format_mask(const Config_Param *p, int v, char *buf, int size)
+{
+    int i, len = 0;
+
+    snprintf(buf, size, "none");
+    for (i = 0; p->names[i] && len < size; ++i)
+    {
+        if (v & (1 << i))
+        {
+            len += snprintf(buf + len, size - len, "%s%s", len ? "+" : "",
+                            p->names[i]);
+        }
+    }
+}
+
+/* Formats the current value of parameter key, symbolic when it has a name */
+void
+APEX_config_format(const APEX_Config *config, const char *key, char *buf,
+                   int size)
+{
+    const Config_Param *p = find_param(key);
+    int v;
+
+    if (!p)
+    {
+        snprintf(buf, size, "?");
+        return;
+    }
+
+    v = *param_field((APEX_Config *)config, p);
+    if (p->mask && v >= p->min && v <= p->max)
+    {
+        format_mask(p, v, buf, size);
+    }
+    else if (p->names && v >= p->min && v <= p->max)
+    {
+        snprintf(buf, size, "%s", p->names[v]);
+    }
+    else
+    {
+        snprintf(buf, size, "%d", v);
+    }
+}
+
+/*
+ * Relative hardware cost of a configuration, used to rank design points.
+ * Units are roughly "one BTB entry": predictor state adds half an entry per
+ * BTB slot, the forwarding network is worth sixteen entries, a unit costs
+ * more the fewer cycles it takes, every vector lane past the first is worth
+ * four entries and a store buffer entry, searched by every load, two. A
+ * prefetcher costs its buffer plus a little per word of degree. An I-cache
+ * costs a quarter entry per instruction it holds, a fetch queue entry one
+ * and a loop buffer entry, which holds a decoded latch, two. So does every
+ * extra sub-stage; the clock rate a deeper pipeline buys is not modelled. A
+ * value predictor entry holds two words, worth one, and replaying on a
+ * misprediction needs four more. Resolving branches in decode takes a
+ * comparator, an adder for the target and the flag bypass, worth four, and
+ * each fusion idiom two for its detector and the second result it writes.
+ */
+double
+APEX_config_cost(const APEX_Config *config)
+{
+    double cost = 0.0;
+    int idioms;
+
+    if (config->predictor != PREDICTOR_NONE)
+    {
+        cost += 1.5 * config->btb_size;
+    }
+
+    if (config->forwarding)
+    {
+        cost += 16.0;
+    }
+
+    cost += 16.0 / config->mul_latency;
+    cost += 16.0 / config->mem_latency;
+    cost += 4.0 * (config->vector_length - 1) + 16.0 / config->vector_latency;
+    cost += 2.0 * config->store_buffer;
+
+    if (config->prefetcher != PREFETCH_NONE)
+    {
+        cost += 8.0 + config->prefetch_degree;
+    }
+
+    cost += 0.25 * config->icache_sets * config->icache_ways
+            * config->icache_line;
+    cost += config->fetch_queue;
+    cost += 2.0 * config->loop_buffer;
+    cost += 2.0 * (config->fetch_stages + config->execute_stages
+                   + config->memory_stages - 3);
+
+    if (config->value_predictor != LVP_NONE)
+    {
+        cost += 4.0 + config->lvp_size;
+    }
+
+    if (config->branch_stage == BRANCH_DECODE)
+    {
+        cost += 4.0;
+    }
+
+    for (idioms = config->fusion; idioms; idioms &= idioms - 1)
+    {
+        cost += 2.0;
+    }
+    return cost;
+}
@@ -10,8 +10,133 @@
 #include <stdlib.h>
 #include <string.h>
 
+/*
+ * The Makefile builds this file once more for every specialised variant in
+ * apex_variants.cfg, with APEX_VARIANT set to the variant's name and
+ * FIXED_<param> to each parameter it fixes. Those builds keep only the
+ * stages and the cycle loop, whose entry points get the variant's name.
+ */
+#ifdef APEX_VARIANT
+#define VARIANT_PASTE(a, b) a##_##b
+#define VARIANT_NAME(a, b) VARIANT_PASTE(a, b)
+#define VARIANT_QUOTE(a) #a
+#define VARIANT_STRING(a) VARIANT_QUOTE(a)
+#define APEX_cpu_step VARIANT_NAME(APEX_cpu_step, APEX_VARIANT)
+#define detect_data_hazards VARIANT_NAME(detect_data_hazards, APEX_VARIANT)
+#endif
+
 #include "apex_cpu.h"
 #include "apex_macros.h"
+#include "apex_fusion.h"
+#include "apex_golden.h"
+#include "apex_icache.h"
+#include "apex_interval.h"
+#include "apex_lvp.h"
+#include "apex_prefetch.h"
+#include "apex_profile.h"
+#include "apex_recorder.h"
+#include "apex_trace.h"
+#include "apex_vector.h"
+#include "apex_warm.h"
+
+/*
+ * Parameters a variant may fix. Fixed ones read as constants, so the code
+ * of features they turn off compiles away; the rest come from cpu->config.
+ */
+#ifdef FIXED_predictor
+#define CFG_PREDICTOR(cpu) (FIXED_predictor)
+#else
+#define CFG_PREDICTOR(cpu) ((cpu)->config.predictor)
+#endif
+
+#ifdef FIXED_forwarding
+#define CFG_FORWARDING(cpu) (FIXED_forwarding)
+#else
+#define CFG_FORWARDING(cpu) ((cpu)->config.forwarding)
+#endif
+
+#ifdef FIXED_store_buffer
+#define CFG_STORE_BUFFER(cpu) (FIXED_store_buffer)
+#else
+#define CFG_STORE_BUFFER(cpu) ((cpu)->config.store_buffer)
+#endif
+
+#ifdef FIXED_prefetcher
+#define CFG_PREFETCHER(cpu) (FIXED_prefetcher)
+#else
+#define CFG_PREFETCHER(cpu) ((cpu)->config.prefetcher)
+#endif
+
+#ifdef FIXED_icache_sets
+#define CFG_ICACHE_SETS(cpu) (FIXED_icache_sets)
+#else
+#define CFG_ICACHE_SETS(cpu) ((cpu)->config.icache_sets)
+#endif
+
+#ifdef FIXED_fetch_queue
+#define CFG_FETCH_QUEUE(cpu) (FIXED_fetch_queue)
+#else
+#define CFG_FETCH_QUEUE(cpu) ((cpu)->config.fetch_queue)
+#endif
+
+#ifdef FIXED_loop_buffer
+#define CFG_LOOP_BUFFER(cpu) (FIXED_loop_buffer)
+#else
+#define CFG_LOOP_BUFFER(cpu) ((cpu)->config.loop_buffer)
+#endif
+
+#ifdef FIXED_fetch_stages
+#define CFG_FETCH_STAGES(cpu) (FIXED_fetch_stages)
+#else
+#define CFG_FETCH_STAGES(cpu) ((cpu)->config.fetch_stages)
+#endif
+
+#ifdef FIXED_execute_stages
+#define CFG_EXECUTE_STAGES(cpu) (FIXED_execute_stages)
+#else
+#define CFG_EXECUTE_STAGES(cpu) ((cpu)->config.execute_stages)
+#endif
+
+#ifdef FIXED_memory_stages
+#define CFG_MEMORY_STAGES(cpu) (FIXED_memory_stages)
+#else
+#define CFG_MEMORY_STAGES(cpu) ((cpu)->config.memory_stages)
+#endif
+
+#ifdef FIXED_value_predictor
+#define CFG_VALUE_PREDICTOR(cpu) (FIXED_value_predictor)
+#else
+#define CFG_VALUE_PREDICTOR(cpu) ((cpu)->config.value_predictor)
+#endif
+
+#ifdef FIXED_branch_stage
+#define CFG_BRANCH_STAGE(cpu) (FIXED_branch_stage)
+#else
+#define CFG_BRANCH_STAGE(cpu) ((cpu)->config.branch_stage)
+#endif
+
+#ifdef FIXED_fusion
+#define CFG_FUSION(cpu) (FIXED_fusion)
+#else
+#define CFG_FUSION(cpu) ((cpu)->config.fusion)
+#endif
+
+/* Whether latch holds a fused pair. Reads as FALSE where fusion is fixed to
+ * none, so the pair handling folds away from that variant's cycle loop */
+#define LATCH_FUSED(cpu, latch) \
+    (CFG_FUSION(cpu) != FUSE_NONE && (latch)->fused)
+
+/* LATCH_TAIL() for the cycle loop, NULL wherever LATCH_FUSED() is FALSE */
+#define FUSED_TAIL(cpu, latch) \
+    (LATCH_FUSED(cpu, &(cpu)->latch) ? &(cpu)->insns[(cpu)->latch.tail] : NULL)
+
+/* probes=0 compiles out debug output, traces, profiles, interval
+ * statistics, branch profiles for warm-start files and co-simulation */
+#ifdef FIXED_probes
+#define CFG_PROBES (FIXED_probes)
+#else
+#define CFG_PROBES TRUE
+#endif
 
 /* Converts the PC(4000 series) into array index for code memory
  *
@@ -23,9 +148,13 @@ get_code_memory_index_from_pc(const int pc)
     return (pc - 4000) / 4;
 }
 
-static void
-print_instruction(const CPU_Stage *stage)
+#ifndef APEX_VARIANT
+/* Formats the assembly text of the instruction in stage into buf */
+void
+APEX_format_instruction(const CPU_Stage *stage, char *buf, int size)
 {
+    buf[0] = '\0';
+
     switch (stage->opcode)
     {
         case OPCODE_ADD:
@@ -36,27 +165,27 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_OR:
         case OPCODE_XOR:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
+            snprintf(buf, size, "%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
                    stage->rs2);
             break;
         }
 
         case OPCODE_MOVC:
         {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
+            snprintf(buf, size, "%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
             break;
         }
 
         case OPCODE_LOAD:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+            snprintf(buf, size, "%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
                    stage->imm);
             break;
         }
 
         case OPCODE_LOADP:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+            snprintf(buf, size, "%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
                 stage->imm);
             break;
         }
@@ -64,14 +193,14 @@ print_instruction(const CPU_Stage *stage)
 
         case OPCODE_STORE:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
+            snprintf(buf, size, "%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
                    stage->imm);
             break;
         }
 
         case OPCODE_STOREP:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
+            snprintf(buf, size, "%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
                    stage->imm);
             break;
         }
@@ -84,57 +213,95 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_BN:
         case OPCODE_BNN:
         {
-            printf("%s,#%d ", stage->opcode_str, stage->imm);
+            snprintf(buf, size, "%s,#%d ", stage->opcode_str, stage->imm);
             break;
         }
 
         case OPCODE_HALT:
         {
-            printf("%s", stage->opcode_str);
+            snprintf(buf, size, "%s", stage->opcode_str);
             break;
         }
 
         case OPCODE_NOP:
         {
-            printf("%s", stage->opcode_str);
+            snprintf(buf, size, "%s", stage->opcode_str);
             break;
         }
 
         case OPCODE_ADDL:
         case OPCODE_SUBL:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+            snprintf(buf, size, "%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
                    stage->imm);
             break;
         }
 
         case OPCODE_CMP:
         {
-            printf("%s,R%d,R%d ", stage->opcode_str, stage->rs1, stage->rs2);
+            snprintf(buf, size, "%s,R%d,R%d ", stage->opcode_str, stage->rs1, stage->rs2);
             break;
         }
 
         case OPCODE_CML:
         {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rs1, stage->imm);
+            snprintf(buf, size, "%s,R%d,#%d ", stage->opcode_str, stage->rs1, stage->imm);
             break;
         }
 
         case OPCODE_JUMP:
         {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rs1, stage->imm);
+            snprintf(buf, size, "%s,R%d,#%d ", stage->opcode_str, stage->rs1, stage->imm);
             break;
         }
 
         case OPCODE_JALR:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+            snprintf(buf, size, "%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+                   stage->imm);
+            break;
+        }
+
+        case OPCODE_VADD:
+        case OPCODE_VMUL:
+        {
+            snprintf(buf, size, "%s,V%d,V%d,V%d ", stage->opcode_str, stage->rd, stage->rs1,
+                   stage->rs2);
+            break;
+        }
+
+        case OPCODE_VLOAD:
+        {
+            snprintf(buf, size, "%s,V%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+                   stage->imm);
+            break;
+        }
+
+        case OPCODE_VSTORE:
+        {
+            snprintf(buf, size, "%s,R%d,V%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
                    stage->imm);
             break;
         }
 
+        case OPCODE_VRED:
+        {
+            snprintf(buf, size, "%s,R%d,V%d ", stage->opcode_str, stage->rd, stage->rs1);
+            break;
+        }
+
     }
 }
+#endif
+
+static void
+print_instruction(const CPU_Stage *stage)
+{
+    char buf[160];
+
+    APEX_format_instruction(stage, buf, sizeof(buf));
+    printf("%s", buf);
+}
 
 /* Debug function which prints the CPU stage content
  *
@@ -174,34 +341,209 @@ print_reg_file(const APEX_CPU *cpu)
     printf("\n");
 }
 
-void initialize_BTB() {
-    for (int i = 0; i < BTB_SIZE; ++i) {
-        btb[i].instruction_address = -1; // Indicates an empty entry
-        btb[i].history_bits = 0; // Initialize based on the branch type
-        btb[i].target_address = -1;
+#ifndef APEX_VARIANT
+/* Prints the vector registers in use, those with a non-zero lane */
+static void
+print_vector_reg_file(const APEX_CPU *cpu)
+{
+    int i, j, used;
+
+    for (i = 0; i < VEC_REG_FILE_SIZE; ++i)
+    {
+        used = FALSE;
+        for (j = 0; j < MAX_VECTOR_LENGTH; ++j)
+        {
+            used |= cpu->vregs[i][j] != 0;
+        }
+
+        if (!used)
+        {
+            continue;
+        }
+
+        printf("V%-3d[", i);
+        for (j = 0; j < cpu->config.vector_length; ++j)
+        {
+            printf(j ? " %d" : "%d", cpu->vregs[i][j]);
+        }
+        printf("]\n");
+    }
+}
+
+static void
+initialize_BTB(APEX_CPU *cpu)
+{
+    for (int i = 0; i < MAX_BTB_SIZE; ++i) {
+        cpu->btb[i].instruction_address = -1; // Indicates an empty entry
+        cpu->btb[i].history_bits = 0; // Initialize based on the branch type
+        cpu->btb[i].target_address = -1;
+    }
+    cpu->btb_victim = 0;
+}
+#endif
+
+static int
+find_in_BTB(const APEX_CPU *cpu, int pc)
+{
+    for (int i = 0; i < cpu->config.btb_size; ++i) {
+        if (cpu->btb[i].instruction_address == pc) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int
+is_conditional_branch(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Instructions execute sets some of the flags for */
+static int
+sets_flags(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_AND:
+        case OPCODE_MOVC:
+        case OPCODE_CMP:
+        case OPCODE_CML:
+            return 1;
+        default:
+            return 0;
     }
 }
 
-int is_write_to_reg_instruction(int opcode)
+static int is_write_to_reg_instruction(int opcode)
 {
     switch (opcode)
     {
         case OPCODE_ADD:
         case OPCODE_SUB:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         case OPCODE_AND:
         case OPCODE_OR:
         case OPCODE_XOR:
         case OPCODE_MOVC:
         case OPCODE_ADDL:
         case OPCODE_SUBL:
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+        case OPCODE_JALR:
+        case OPCODE_VRED:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* LOADP and STOREP post-increment their base register rs1 */
+static int
+writes_base_register(int opcode)
+{
+    return opcode == OPCODE_LOADP || opcode == OPCODE_STOREP;
+}
+
+static int
+is_load(int opcode)
+{
+    return opcode == OPCODE_LOAD || opcode == OPCODE_LOADP
+           || opcode == OPCODE_VLOAD;
+}
+
+static int
+is_store(int opcode)
+{
+    return opcode == OPCODE_STORE || opcode == OPCODE_STOREP
+           || opcode == OPCODE_VSTORE;
+}
+
+/* Vector register operands, see the OPCODE_V* definitions */
+static int
+writes_vector_register(int opcode)
+{
+    return opcode == OPCODE_VLOAD || opcode == OPCODE_VADD
+           || opcode == OPCODE_VMUL;
+}
+
+static int
+reads_vector_rs1(int opcode)
+{
+    return opcode == OPCODE_VADD || opcode == OPCODE_VMUL
+           || opcode == OPCODE_VRED;
+}
+
+static int
+reads_vector_rs2(int opcode)
+{
+    return opcode == OPCODE_VADD || opcode == OPCODE_VMUL
+           || opcode == OPCODE_VSTORE;
+}
+
+static int
+reads_rs1(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_MOVC:
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        case OPCODE_HALT:
+        case OPCODE_NOP:
+        case OPCODE_VADD:
+        case OPCODE_VMUL:
+        case OPCODE_VRED:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+static int
+reads_rs2(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+        case OPCODE_CMP:
             return 1;
         default:
             return 0;
     }
 }
 
-int should_take_branch(int history_bits, int branch_type) {
+static int should_take_branch(int history_bits, int branch_type) {
     // Check branch type and make prediction based on history bits
     switch (branch_type) {
         case OPCODE_BNZ: // Fall through
@@ -211,8 +553,8 @@ int should_take_branch(int history_bits, int branch_type) {
 
         case OPCODE_BZ: // Fall through
         case OPCODE_BNP:
-            // Predict not taken if any of the last two were not taken (i.e., if any bit is 0)
-            return !((history_bits & 0b01) && (history_bits & 0b10));
+            // Predict taken only if both of the last two were taken
+            return (history_bits & 0b01) && (history_bits & 0b10);
 
         default:
             // For other types of branches or instructions, handle accordingly
@@ -221,240 +563,1832 @@ int should_take_branch(int history_bits, int branch_type) {
     }
 }
 
-
 /*
- * Fetch Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Predicts the direction of the branch at pc. Returns TRUE and sets *target
+ * when fetch should follow the BTB to the branch target.
  */
+static int
+predict_branch(const APEX_CPU *cpu, int pc, int opcode, int *target)
+{
+    int btb_index;
+    const BTB_Entry *entry;
+    int taken;
+
+    if (CFG_PREDICTOR(cpu) == PREDICTOR_NONE)
+    {
+        return FALSE;
+    }
+
+    btb_index = find_in_BTB(cpu, pc);
+    if (btb_index == -1)
+    {
+        return FALSE;
+    }
+
+    entry = &cpu->btb[btb_index];
+    if (CFG_PREDICTOR(cpu) == PREDICTOR_BIMODAL)
+    {
+        taken = entry->history_bits >= 2;
+    }
+    else
+    {
+        taken = should_take_branch(entry->history_bits, opcode);
+    }
+
+    if (taken)
+    {
+        *target = entry->target_address;
+    }
+    return taken;
+}
+
+/* Trains the BTB with a resolved branch, allocating an entry on first use */
 static void
-APEX_fetch(APEX_CPU *cpu)
+update_BTB(APEX_CPU *cpu, int pc, int opcode, int taken, int target)
 {
-    if (cpu->fetch.stall) {
-        // Skip fetching new instruction
-        // printf("Fetch stage stall flag before fetch: %d\n", cpu->fetch.stall);
-        // printf("Decode stage stall flag before fetch: %d\n", cpu->decode.stall);
-        detect_data_hazards(cpu);
+    int btb_index;
+    BTB_Entry *entry;
 
+    if (CFG_PREDICTOR(cpu) == PREDICTOR_NONE)
+    {
         return;
     }
-    APEX_Instruction *current_ins;
 
-    if (cpu->fetch.opcode == OPCODE_BZ ||
-        cpu->fetch.opcode == OPCODE_BNZ ||
-        cpu->fetch.opcode == OPCODE_BP ||
-        cpu->fetch.opcode == OPCODE_BNP) {
-        int btb_index = find_in_BTB(cpu->fetch.pc);
+    btb_index = find_in_BTB(cpu, pc);
+    if (btb_index == -1)
+    {
+        btb_index = cpu->btb_victim;
+        cpu->btb_victim = (cpu->btb_victim + 1) % cpu->config.btb_size;
 
-    if (btb_index != -1) {
-        // Get the opcode (branch type) of the current instruction
-        int branch_type = cpu->fetch.opcode;
+        entry = &cpu->btb[btb_index];
+        entry->instruction_address = pc;
+        entry->target_address = target;
 
-        // Check if the branch should be taken based on the history bits and branch type
-        if (should_take_branch(btb[btb_index].history_bits, branch_type)) {
-            // Branch is predicted to be taken
-            cpu->pc = btb[btb_index].target_address;
-        } else {
-            // Branch is predicted not to be taken
-            cpu->pc += 4; // Move to the next instruction
+        if (CFG_PREDICTOR(cpu) == PREDICTOR_BIMODAL)
+        {
+            entry->history_bits = taken ? 2 : 1;
         }
-    }
+        else
+        {
+            /* BNZ/BP start out predicted taken, the others not taken */
+            entry->history_bits
+                = (opcode == OPCODE_BNZ || opcode == OPCODE_BP) ? 0b11 : 0b00;
+            entry->history_bits = ((entry->history_bits << 1) | taken) & 0b11;
         }
+        return;
+    }
 
-    if (cpu->fetch.has_insn)
+    entry = &cpu->btb[btb_index];
+    entry->target_address = target;
+
+    if (CFG_PREDICTOR(cpu) == PREDICTOR_BIMODAL)
     {
-        /* This fetches new branch target instruction from next cycle */
-        if (cpu->fetch_from_next_cycle == TRUE)
+        if (taken && entry->history_bits < 3)
         {
-            cpu->fetch_from_next_cycle = FALSE;
-
-            /* Skip this cycle*/
-            return;
+            entry->history_bits++;
+        }
+        else if (!taken && entry->history_bits > 0)
+        {
+            entry->history_bits--;
         }
+    }
+    else
+    {
+        entry->history_bits = ((entry->history_bits << 1) | taken) & 0b11;
+    }
+}
 
+/* Records why the empty latch next is empty, unless it holds an instruction */
+static void
+mark_bubble(CPU_Latch *next, int reason, int pc)
+{
+    if (!next->has_insn)
+    {
+        next->bubble_reason = reason;
+        next->bubble_pc = pc;
+    }
+}
+
+/*
+ * Latches fetch, decode and execute hand their instruction to: the first
+ * sub-stage of the next stage, an extra one when it is split.
+ */
+static CPU_Latch *
+decode_entry(APEX_CPU *cpu)
+{
+    return CFG_FETCH_STAGES(cpu) > 1 ? &cpu->fetch_pipe[0] : &cpu->decode;
+}
 
-        /* Store current PC in fetch latch */
-        cpu->fetch.pc = cpu->pc;
+static CPU_Latch *
+execute_entry(APEX_CPU *cpu)
+{
+    return CFG_EXECUTE_STAGES(cpu) > 1 ? &cpu->execute_pipe[0]
+                                          : &cpu->execute;
+}
 
-        /* Index into code memory using this pc and copy all instruction fields
-         * into fetch latch  */
-        current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-        cpu->fetch.opcode = current_ins->opcode;
-        cpu->fetch.rd = current_ins->rd;
-        cpu->fetch.rs1 = current_ins->rs1;
-        cpu->fetch.rs2 = current_ins->rs2;
-        cpu->fetch.imm = current_ins->imm;
+static CPU_Latch *
+memory_entry(APEX_CPU *cpu)
+{
+    return CFG_MEMORY_STAGES(cpu) > 1 ? &cpu->memory_pipe[0]
+                                         : &cpu->memory;
+}
 
-        /* Update PC for next instruction */
-        cpu->pc += 4;
+/* The instruction latch holds that memory works on: the second of a fused
+ * pair, whose first never accesses memory */
+#define MEMORY_INSN(cpu, latch) \
+    (&(cpu)->insns[LATCH_FUSED(cpu, latch) ? (latch)->tail : (latch)->insn])
 
-        /* Copy data from fetch latch to decode latch*/
-        cpu->decode = cpu->fetch;
+/*
+ * Moves the instructions in the count extra sub-stages of pipe one sub-stage
+ * on, oldest first, wherever the next one is free; the oldest moves into
+ * last, the stage's own latch. An empty sub-stage passes its bubble on like
+ * an empty stage does. Returns TRUE when an instruction reached last.
+ */
+static int
+advance_sub_stages(CPU_Latch *pipe, int count, CPU_Latch *last)
+{
+    CPU_Latch *next;
+    int i, arrived = FALSE;
 
-        if (ENABLE_DEBUG_MESSAGES)
+    for (i = count - 1; i >= 0; --i)
+    {
+        next = (i == count - 1) ? last : &pipe[i + 1];
+        if (next->has_insn)
         {
-            print_stage_content("Fetch", &cpu->fetch);
+            continue;
         }
 
-        /* Stop fetching new instructions if HALT is fetched */
-        if (cpu->fetch.opcode == OPCODE_HALT)
+        if (pipe[i].has_insn)
         {
-            cpu->fetch.has_insn = FALSE;
+            *next = pipe[i];
+            pipe[i].has_insn = FALSE;
+            arrived |= (next == last);
         }
-
-        if (cpu->fetch.opcode == OPCODE_NOP)
+        else
         {
-            cpu->decode.has_insn = FALSE;
+            mark_bubble(next, pipe[i].bubble_reason, pipe[i].bubble_pc);
         }
     }
+    return arrived;
 }
 
-/*
- * Decode Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
- */
+/* Squashes the wrong-path instruction, or fused pair, in latch, if any */
 static void
-APEX_decode(APEX_CPU *cpu)
+squash_latch(APEX_CPU *cpu, CPU_Latch *latch, int branch_pc)
 {
-    if (cpu->decode.stall) {
-        // Skip fetching new instruction
-        return;
-    }
-    if (cpu->decode.has_insn)
+    if (latch->has_insn)
     {
-        if (is_write_to_reg_instruction(cpu->execute.opcode) && 
-            (cpu->decode.rs1 == cpu->execute.rd || cpu->decode.rs2 == cpu->execute.rd)) {
-            // Forward data from Execute stage
-            if (cpu->decode.rs1 == cpu->execute.rd) {
-                cpu->decode.rs1_value = cpu->execute.result_buffer;
-            }
-            if (cpu->decode.rs2 == cpu->execute.rd) {
-                cpu->decode.rs2_value = cpu->execute.result_buffer;
-            }
-        }
-
-        /* Check for data forwarding from Memory stage */
-        if (is_write_to_reg_instruction(cpu->memory.opcode) && 
-            (cpu->decode.rs1 == cpu->memory.rd || cpu->decode.rs2 == cpu->memory.rd)) {
-            // Forward data from Memory stage
-            if (cpu->decode.rs1 == cpu->memory.rd) {
-                cpu->decode.rs1_value = cpu->memory.result_buffer;
-            }
-            if (cpu->decode.rs2 == cpu->memory.rd) {
-                cpu->decode.rs2_value = cpu->memory.result_buffer;
-            }
-        }
-        /* Read operands from register file based on the instruction type */
-        switch (cpu->decode.opcode)
+        cpu->stats.squashed += LATCH_FUSED(cpu, latch) ? 2 : 1;
+        if (CFG_PROBES && cpu->trace)
         {
-            case OPCODE_ADD:
-            case OPCODE_ADDL:
-            {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                break;
-            }
-
-            case OPCODE_SUB:
-            case OPCODE_SUBL:
+            APEX_trace_flush(cpu->trace, &cpu->insns[latch->insn]);
+            if (LATCH_FUSED(cpu, latch))
             {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                break;
+                APEX_trace_flush(cpu->trace, &cpu->insns[latch->tail]);
             }
+        }
+    }
+    latch->has_insn = FALSE;
+    latch->stall = FALSE;
+    mark_bubble(latch, CYCLE_FLUSH, branch_pc);
+}
 
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            case OPCODE_AND:
-            {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                break;
+/*
+ * Sends fetch to new_pc on behalf of the instruction at branch_pc, which is
+ * in decode or past it, and squashes the wrong-path instructions in the
+ * front end: the fetch queues and the sub-stages of fetch. Fetch resumes
+ * from the next cycle.
+ */
+static void
+restart_fetch(APEX_CPU *cpu, int branch_pc, int new_pc)
+{
+    int i;
+
+    /* Calculate new PC, and send it to fetch unit */
+    cpu->pc = new_pc;
+    cpu->redirect_pc = branch_pc;
+
+    /* Since we are using reverse callbacks for pipeline stages,
+     * this will prevent the new instruction from being fetched in the current cycle*/
+    cpu->fetch_from_next_cycle = TRUE;
+
+    /* Flush previous stages. Fetch targets were never fetched, queued
+     * instructions were */
+    cpu->stats.squashed += cpu->fq_count;
+    cpu->ftq_count = cpu->fq_count = 0;
+    cpu->fetch_ready_cycle = -1;
+    cpu->loop_buffer.active = FALSE;
+
+    for (i = 0; i < CFG_FETCH_STAGES(cpu) - 1; ++i)
+    {
+        squash_latch(cpu, &cpu->fetch_pipe[i], branch_pc);
+    }
+
+    /* Make sure fetch stage is enabled to start fetching from new PC */
+    cpu->fetch.has_insn = TRUE;
+    cpu->fetch.stall = FALSE;
+}
+
+/*
+ * Sends fetch to new_pc on behalf of the instruction at branch_pc, which is
+ * in the last execute sub-stage, and squashes the wrong-path instructions
+ * behind it: those in decode and in the sub-stages of fetch and execute.
+ * Fetch resumes from the next cycle.
+ */
+static void
+redirect_fetch(APEX_CPU *cpu, int branch_pc, int new_pc)
+{
+    int i;
+
+    for (i = 0; i < CFG_EXECUTE_STAGES(cpu) - 1; ++i)
+    {
+        squash_latch(cpu, &cpu->execute_pipe[i], branch_pc);
+    }
+    squash_latch(cpu, &cpu->decode, branch_pc);
+    restart_fetch(cpu, branch_pc, new_pc);
+}
+
+/* Sets the zero, positive and negative flags from an arithmetic result */
+static void
+set_flags(APEX_CPU *cpu, int result)
+{
+    cpu->zero_flag = (result == 0) ? TRUE : FALSE;
+    cpu->pos_flag = (result > 0) ? TRUE : FALSE;
+    cpu->neg_flag = (result < 0) ? TRUE : FALSE;
+}
+
+/*
+ * Checks whether the instruction in slot, in a latch of stage, writes
+ * register reg. Returns -1 when it does not, otherwise whether its value
+ * can be forwarded from stage (results exist from memory on, loaded values
+ * from writeback on).
+ */
+static int
+forward_from(const APEX_CPU *cpu, int slot, int stage, int reg, int *value,
+             int *predicted_by)
+{
+    const CPU_Stage *p = &cpu->insns[slot];
+
+    if (is_write_to_reg_instruction(p->opcode) && p->rd == reg)
+    {
+        /* Not computed yet, or a load still waiting on memory. A confident
+         * value prediction stands in for the load until it completes */
+        if (!CFG_FORWARDING(cpu) || stage == TRACE_EXECUTE
+            || (stage == TRACE_MEMORY && is_load(p->opcode)))
+        {
+            if (CFG_VALUE_PREDICTOR(cpu) != LVP_NONE && CFG_FORWARDING(cpu)
+                && stage != TRACE_WRITEBACK && is_load(p->opcode)
+                && p->value_predicted)
+            {
+                *value = p->predicted_value;
+                *predicted_by = slot;
+                return TRUE;
             }
+            return FALSE;
+        }
+
+        *value = p->result_buffer;
+        return TRUE;
+    }
+
+    if (writes_base_register(p->opcode) && p->rs1 == reg)
+    {
+        if (!CFG_FORWARDING(cpu) || stage == TRACE_EXECUTE)
+        {
+            return FALSE;
+        }
+
+        *value = p->rs1_new_value;
+        return TRUE;
+    }
+    return -1;
+}
+
+/* forward_from() for the instruction, or fused pair, latch holds */
+static int
+forward_register(const APEX_CPU *cpu, const CPU_Latch *latch, int stage,
+                 int reg, int *value, int *predicted_by)
+{
+    int found;
+
+    if (!latch->has_insn)
+    {
+        return -1;
+    }
+
+    /* The second instruction of a pair is the younger writer */
+    if (LATCH_FUSED(cpu, latch))
+    {
+        found = forward_from(cpu, latch->tail, stage, reg, value,
+                             predicted_by);
+        if (found >= 0)
+        {
+            return found;
+        }
+    }
+    return forward_from(cpu, latch->insn, stage, reg, value, predicted_by);
+}
+
+/*
+ * Reads register reg for the instruction in decode. The youngest in-flight
+ * writer of reg wins; its result is forwarded when forwarding is enabled and
+ * the value has already been produced. A predicted load value sets
+ * *predicted_by to the load's slot. Returns FALSE when decode must wait.
+ */
+static int
+read_register(const APEX_CPU *cpu, int reg, int *value, int *predicted_by)
+{
+    int i, found;
+
+    /* Youngest first */
+    for (i = 0; i < CFG_EXECUTE_STAGES(cpu) - 1; ++i)
+    {
+        found = forward_register(cpu, &cpu->execute_pipe[i], TRACE_EXECUTE,
+                                 reg, value, predicted_by);
+        if (found >= 0)
+        {
+            return found;
+        }
+    }
+
+    found = forward_register(cpu, &cpu->execute, TRACE_EXECUTE, reg, value,
+                             predicted_by);
+    if (found >= 0)
+    {
+        return found;
+    }
+
+    for (i = 0; i < CFG_MEMORY_STAGES(cpu) - 1; ++i)
+    {
+        found = forward_register(cpu, &cpu->memory_pipe[i], TRACE_MEMORY,
+                                 reg, value, predicted_by);
+        if (found >= 0)
+        {
+            return found;
+        }
+    }
+
+    found = forward_register(cpu, &cpu->memory, TRACE_MEMORY, reg, value,
+                             predicted_by);
+    if (found < 0)
+    {
+        found = forward_register(cpu, &cpu->writeback, TRACE_WRITEBACK, reg,
+                                 value, predicted_by);
+    }
+    if (found >= 0)
+    {
+        return found;
+    }
+
+    *value = cpu->regs[reg];
+    return TRUE;
+}
+
+/* Vector counterpart of forward_register */
+static int
+forward_vector_register(const APEX_CPU *cpu, const CPU_Latch *latch,
+                        int stage, int reg, int *value)
+{
+    const CPU_Stage *p;
+
+    if (!latch->has_insn)
+    {
+        return -1;
+    }
+
+    p = &cpu->insns[latch->insn];
+    if (!writes_vector_register(p->opcode) || p->rd != reg)
+    {
+        return -1;
+    }
+
+    if (!CFG_FORWARDING(cpu) || stage == TRACE_EXECUTE
+        || (stage == TRACE_MEMORY && is_load(p->opcode)))
+    {
+        return FALSE;
+    }
+
+    memcpy(value, INSN_LANES(cpu, p)->vresult, sizeof(cpu->lanes[0].vresult));
+    return TRUE;
+}
+
+/*
+ * Vector counterpart of read_register. Vector results are forwarded the same
+ * way, with VLOAD waiting on memory like a scalar load.
+ */
+static int
+read_vector_register(const APEX_CPU *cpu, int reg, int *value)
+{
+    int i, found;
+
+    for (i = 0; i < CFG_EXECUTE_STAGES(cpu) - 1; ++i)
+    {
+        found = forward_vector_register(cpu, &cpu->execute_pipe[i],
+                                        TRACE_EXECUTE, reg, value);
+        if (found >= 0)
+        {
+            return found;
+        }
+    }
+
+    found = forward_vector_register(cpu, &cpu->execute, TRACE_EXECUTE, reg,
+                                    value);
+    if (found >= 0)
+    {
+        return found;
+    }
+
+    for (i = 0; i < CFG_MEMORY_STAGES(cpu) - 1; ++i)
+    {
+        found = forward_vector_register(cpu, &cpu->memory_pipe[i],
+                                        TRACE_MEMORY, reg, value);
+        if (found >= 0)
+        {
+            return found;
+        }
+    }
+
+    found = forward_vector_register(cpu, &cpu->memory, TRACE_MEMORY, reg,
+                                    value);
+    if (found < 0)
+    {
+        found = forward_vector_register(cpu, &cpu->writeback,
+                                        TRACE_WRITEBACK, reg, value);
+    }
+    if (found >= 0)
+    {
+        return found;
+    }
+
+    memcpy(value, cpu->vregs[reg], sizeof(cpu->lanes[0].vresult));
+    return TRUE;
+}
+
+/* Cycles an instruction occupies the execute stage */
+static int
+execute_latency(const APEX_CPU *cpu, int opcode)
+{
+    if (opcode == OPCODE_MUL || opcode == OPCODE_DIV)
+    {
+        return cpu->config.mul_latency;
+    }
+    if (opcode == OPCODE_VADD || opcode == OPCODE_VMUL || opcode == OPCODE_VRED)
+    {
+        return cpu->config.vector_latency;
+    }
+    return 1;
+}
+
+/* Slot of the youngest buffered store to address, -1 if there is none */
+static int
+find_buffered_store(const APEX_CPU *cpu, int address)
+{
+    int i, slot;
+
+    for (i = cpu->sb_count - 1; i >= 0; --i)
+    {
+        slot = (cpu->sb_head + i) % MAX_STORE_BUFFER_SIZE;
+        if (cpu->store_buffer[slot].address == address)
+        {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/* LOAD/LOADP that has to read data memory, as opposed to the store buffer */
+static int
+reads_memory_port(const APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    return (stage->opcode == OPCODE_LOAD || stage->opcode == OPCODE_LOADP)
+           && find_buffered_store(cpu, stage->memory_address) < 0;
+}
+
+/* Cycles an instruction occupies the memory stage */
+static int
+memory_latency(const APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    /* Stores only enter the buffer, forwarded loads skip data memory */
+    if (CFG_STORE_BUFFER(cpu)
+        && (stage->opcode == OPCODE_STORE || stage->opcode == OPCODE_STOREP
+            || ((stage->opcode == OPCODE_LOAD || stage->opcode == OPCODE_LOADP)
+                && !reads_memory_port(cpu, stage))))
+    {
+        return 1;
+    }
+
+    if (is_load(stage->opcode) || is_store(stage->opcode))
+    {
+        return cpu->config.mem_latency;
+    }
+    return 1;
+}
+
+/*
+ * Writes the oldest buffered store to data memory once it has spent
+ * mem_latency cycles on the memory port. The port is shared with loads,
+ * so draining pauses while a load reads data memory.
+ */
+static void
+drain_store_buffer(APEX_CPU *cpu)
+{
+    const Store_Buffer_Entry *entry;
+
+    cpu->stats.sb_occupancy += cpu->sb_count;
+    if (!cpu->sb_count
+        || (cpu->memory.has_insn
+            && reads_memory_port(cpu, MEMORY_INSN(cpu, &cpu->memory))))
+    {
+        return;
+    }
+
+    if (--cpu->sb_cycles_left > 0)
+    {
+        return;
+    }
+
+    entry = &cpu->store_buffer[cpu->sb_head];
+    cpu->data_memory[entry->address] = entry->value;
+    if (cpu->recorder)
+    {
+        APEX_recorder_access(cpu->recorder, entry->address, entry->value,
+                             TRUE);
+    }
+    cpu->sb_head = (cpu->sb_head + 1) % MAX_STORE_BUFFER_SIZE;
+    cpu->sb_count--;
+    cpu->sb_cycles_left = cpu->config.mem_latency;
+}
+
+static void
+buffer_store(APEX_CPU *cpu, int address, int value)
+{
+    Store_Buffer_Entry *entry;
+
+    if (!cpu->sb_count)
+    {
+        cpu->sb_cycles_left = cpu->config.mem_latency;
+    }
+
+    entry = &cpu->store_buffer[(cpu->sb_head + cpu->sb_count)
+                               % MAX_STORE_BUFFER_SIZE];
+    entry->address = address;
+    entry->value = value;
+    cpu->sb_count++;
+
+    if (cpu->sb_count > cpu->stats.sb_max)
+    {
+        cpu->stats.sb_max = cpu->sb_count;
+    }
+}
+
+/*
+ * TRUE when the instruction in memory has to wait on the store buffer: a
+ * store finding it full, or HALT and vector accesses, which wait for it to
+ * drain since they are not matched against buffered stores.
+ */
+static int
+store_buffer_blocks(const APEX_CPU *cpu)
+{
+    switch (MEMORY_INSN(cpu, &cpu->memory)->opcode)
+    {
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+            return cpu->sb_count == CFG_STORE_BUFFER(cpu);
+
+        case OPCODE_HALT:
+        case OPCODE_VLOAD:
+        case OPCODE_VSTORE:
+            return cpu->sb_count > 0;
+    }
+    return FALSE;
+}
+
+/* Copies the instruction at pc from code memory into stage */
+static void
+load_instruction(const APEX_CPU *cpu, int pc, CPU_Stage *stage)
+{
+    const APEX_Instruction *current_ins
+        = &cpu->code_memory[get_code_memory_index_from_pc(pc)];
+
+    /* Store current PC in the record */
+    stage->pc = pc;
+
+    /* Copy all instruction fields into the record */
+    stage->opcode_str = current_ins->opcode_str;
+    stage->opcode = current_ins->opcode;
+    stage->rd = current_ins->rd;
+    stage->rs1 = current_ins->rs1;
+    stage->rs2 = current_ins->rs2;
+    stage->imm = current_ins->imm;
+    stage->predicted_taken = FALSE;
+    stage->resolved_early = FALSE;
+    stage->redirect_cycle = -1;
+}
+
+/* Whether latch holds the record in slot, alone or in a fused pair */
+static int
+holds_slot(const APEX_CPU *cpu, const CPU_Latch *latch, int slot)
+{
+    return latch->has_insn
+           && (latch->insn == slot
+               || (LATCH_FUSED(cpu, latch) && latch->tail == slot));
+}
+
+/* Whether a latch past fetch holds the record in slot */
+static int
+insn_in_flight(const APEX_CPU *cpu, int slot)
+{
+    int i;
+
+    for (i = 0; i < CFG_FETCH_STAGES(cpu) - 1; ++i)
+    {
+        if (holds_slot(cpu, &cpu->fetch_pipe[i], slot))
+        {
+            return TRUE;
+        }
+    }
+
+    if (holds_slot(cpu, &cpu->decode, slot))
+    {
+        return TRUE;
+    }
+
+    for (i = 0; i < CFG_EXECUTE_STAGES(cpu) - 1; ++i)
+    {
+        if (holds_slot(cpu, &cpu->execute_pipe[i], slot))
+        {
+            return TRUE;
+        }
+    }
+
+    for (i = 0; i < CFG_MEMORY_STAGES(cpu) - 1; ++i)
+    {
+        if (holds_slot(cpu, &cpu->memory_pipe[i], slot))
+        {
+            return TRUE;
+        }
+    }
+
+    return holds_slot(cpu, &cpu->execute, slot) || holds_slot(cpu, &cpu->memory, slot)
+           || holds_slot(cpu, &cpu->writeback, slot);
+}
+
+/*
+ * Claims a record for the next fetched instruction and points the fetch
+ * latch at it. The record fetch held before has moved on or was dropped, so
+ * only the latches past fetch need checking.
+ */
+static CPU_Stage *
+allocate_insn(APEX_CPU *cpu)
+{
+    int slot;
+
+    do
+    {
+        slot = cpu->next_insn;
+        cpu->next_insn = (slot + 1) % INSN_RING_SIZE;
+    } while (insn_in_flight(cpu, slot));
+
+    cpu->fetch.insn = slot;
+    cpu->insns[slot].seq = cpu->fetch_seq++;
+    return &cpu->insns[slot];
+}
+
+/* Copies the instruction at pc from code memory into a new record */
+static CPU_Stage *
+fetch_instruction(APEX_CPU *cpu, int pc)
+{
+    CPU_Stage *insn = allocate_insn(cpu);
+
+    load_instruction(cpu, pc, insn);
+    return insn;
+}
+
+/* Hands the instruction in the fetch latch to decode, dropping NOPs */
+static void
+send_to_decode(APEX_CPU *cpu)
+{
+    const CPU_Stage *insn = LATCH_INSN(cpu, fetch);
+    CPU_Latch *next = decode_entry(cpu);
+
+    /* Copy data from fetch latch to decode latch. Fetch may already have
+     * stopped behind a HALT the predictor saw */
+    *next = cpu->fetch;
+    next->has_insn = TRUE;
+
+    if (CFG_PROBES && cpu->trace)
+    {
+        APEX_trace_fetch(cpu->trace, insn);
+    }
+
+    if (CFG_PROBES && cpu->debug_messages)
+    {
+        print_stage_content("Fetch", insn);
+    }
+
+    if (insn->opcode == OPCODE_NOP)
+    {
+        next->has_insn = FALSE;
+        mark_bubble(next, CYCLE_FETCH, insn->pc);
+    }
+}
+
+/*
+ * The FUSE_* idiom the instruction just sent to next forms with the one at
+ * pc, which fetch reads along with it, from the same fetch block, when they
+ * fuse
+ */
+static int
+fusion_idiom(const APEX_CPU *cpu, const CPU_Latch *next, int pc)
+{
+    int index = get_code_memory_index_from_pc(pc);
+
+    if (CFG_FUSION(cpu) == FUSE_NONE || !next->has_insn
+        || pc != cpu->insns[next->insn].pc + 4 || index < 1
+        || index >= cpu->code_memory_size)
+    {
+        return FUSE_NONE;
+    }
+    return APEX_fusion_match(CFG_FUSION(cpu), &cpu->code_memory[index - 1],
+                             &cpu->code_memory[index]);
+}
+
+/* Sends the instruction in the fetch latch to decode as the second of the
+ * pair the one in next heads */
+static void
+send_fused(APEX_CPU *cpu, CPU_Latch *next, int idiom)
+{
+    const CPU_Stage *insn = LATCH_INSN(cpu, fetch);
+
+    next->fused = idiom;
+    next->tail = cpu->fetch.insn;
+
+    if (CFG_PROBES && cpu->trace)
+    {
+        APEX_trace_fetch(cpu->trace, insn);
+    }
+
+    if (CFG_PROBES && cpu->debug_messages)
+    {
+        print_stage_content("Fetch", insn);
+    }
+}
+
+/*
+ * Loop stream detector. A conditional branch that is taken back to at most
+ * loop_buffer instructions before it, LOOP_DETECT_ITERATIONS times in a
+ * row, marks a loop. If its body holds no other control flow the loop is
+ * captured, ready made records and all, and fetch streams it from the loop
+ * buffer: no code memory, I-cache or predictor accesses, and the backward
+ * branch predicted taken every time. The exit mispredicts, and that or any
+ * other redirect stops the stream.
+ */
+static void
+capture_loop(APEX_CPU *cpu)
+{
+    APEX_Loop_Buffer *lsd = &cpu->loop_buffer;
+    int pc, i;
+
+    /* Fetch must still be inside the loop to stream it */
+    if (cpu->pc < lsd->start || cpu->pc > lsd->end)
+    {
+        return;
+    }
+
+    for (pc = lsd->start, i = 0; pc < lsd->end; pc += 4, ++i)
+    {
+        switch (cpu->code_memory[get_code_memory_index_from_pc(pc)].opcode)
+        {
+            case OPCODE_BZ:
+            case OPCODE_BNZ:
+            case OPCODE_BP:
+            case OPCODE_BNP:
+            case OPCODE_BN:
+            case OPCODE_BNN:
+            case OPCODE_JUMP:
+            case OPCODE_JALR:
+            case OPCODE_HALT:
+                return;
+        }
+        load_instruction(cpu, pc, &lsd->insns[i]);
+    }
+
+    load_instruction(cpu, lsd->end, &lsd->insns[i]);
+    lsd->insns[i].predicted_taken = TRUE;
+    lsd->active = TRUE;
+    cpu->stats.lsd_loops++;
+}
+
+/* Trains the loop stream detector with a resolved conditional branch */
+static void
+train_loop_buffer(APEX_CPU *cpu, int pc, int target, int taken)
+{
+    APEX_Loop_Buffer *lsd = &cpu->loop_buffer;
+
+    if (!taken || target > pc || pc - target >= 4 * CFG_LOOP_BUFFER(cpu))
+    {
+        if (pc == lsd->end)
+        {
+            lsd->iterations = 0;
+        }
+        return;
+    }
+
+    if (pc != lsd->end || target != lsd->start)
+    {
+        lsd->start = target;
+        lsd->end = pc;
+        lsd->iterations = 0;
+    }
+
+    lsd->iterations++;
+    if (!lsd->active && lsd->iterations >= LOOP_DETECT_ITERATIONS)
+    {
+        capture_loop(cpu);
+    }
+}
+
+/* Copies the record for the instruction at pc out of the loop buffer */
+static void
+replay_insn(APEX_CPU *cpu)
+{
+    APEX_Loop_Buffer *lsd = &cpu->loop_buffer;
+    CPU_Stage *insn = allocate_insn(cpu);
+    int seq = insn->seq;
+
+    *insn = lsd->insns[(cpu->pc - lsd->start) / 4];
+    insn->seq = seq;
+    cpu->pc = cpu->pc == lsd->end ? lsd->start : cpu->pc + 4;
+    cpu->stats.lsd_replays++;
+}
+
+/* Fetches the instruction at pc from the loop buffer */
+static void
+replay_loop(APEX_CPU *cpu)
+{
+    CPU_Latch *next = decode_entry(cpu);
+    int idiom;
+
+    replay_insn(cpu);
+    send_to_decode(cpu);
+    if (CFG_FUSION(cpu) && (idiom = fusion_idiom(cpu, next, cpu->pc)))
+    {
+        replay_insn(cpu);
+        send_fused(cpu, next, idiom);
+    }
+}
+
+/* Pushes the pc to fetch onto the fetch target queue and predicts the next */
+static void
+predict_fetch_target(APEX_CPU *cpu)
+{
+    Fetch_Entry *entry;
+    int code_index, opcode, target;
+
+    if (!cpu->fetch.has_insn || cpu->ftq_count == cpu->config.ftq_size
+        || cpu->loop_buffer.active)
+    {
+        return;
+    }
+
+    /* Off the end of code memory, only a redirect can recover */
+    code_index = get_code_memory_index_from_pc(cpu->pc);
+    if (code_index < 0 || code_index >= cpu->code_memory_size)
+    {
+        return;
+    }
+
+    entry = &cpu->ftq[(cpu->ftq_head + cpu->ftq_count) % MAX_FETCH_QUEUE_SIZE];
+    cpu->ftq_count++;
+    entry->pc = cpu->pc;
+    entry->predicted_taken = FALSE;
+
+    /* Branches are predicted from predecoded opcodes */
+    opcode = cpu->code_memory[code_index].opcode;
+    if (is_conditional_branch(opcode)
+        && predict_branch(cpu, cpu->pc, opcode, &target))
+    {
+        entry->predicted_taken = TRUE;
+        cpu->pc = target;
+    }
+    else
+    {
+        cpu->pc += 4;
+    }
+
+    /* Stop predicting past HALT */
+    if (opcode == OPCODE_HALT)
+    {
+        cpu->fetch.has_insn = FALSE;
+    }
+
+    /* Targets queued behind the one being fetched prefetch their lines */
+    if (cpu->ftq_count > 1)
+    {
+        APEX_icache_prefetch(cpu, entry->pc);
+    }
+}
+
+/*
+ * Reads the instruction at the head of the fetch target queue from the
+ * I-cache into the fetch queue. Besides its fetch_queue entries the queue
+ * holds the instruction coupled fetch would keep in the fetch latch while
+ * decode stalls, so without a queue the front end still has that one.
+ */
+static void
+fetch_from_icache(APEX_CPU *cpu)
+{
+    if (!cpu->ftq_count)
+    {
+        return;
+    }
+
+    if (cpu->fetch_ready_cycle < 0)
+    {
+        cpu->fetch_ready_cycle
+            = APEX_icache_access(cpu, cpu->ftq[cpu->ftq_head].pc);
+    }
+
+    if (cpu->clock < cpu->fetch_ready_cycle)
+    {
+        cpu->stats.ic_stalls++;
+        return;
+    }
+
+    if (cpu->fq_count == CFG_FETCH_QUEUE(cpu) + 1)
+    {
+        cpu->stats.fq_full++;
+        return;
+    }
+
+    cpu->fetch_queue[(cpu->fq_head + cpu->fq_count) % FETCH_QUEUE_RING]
+        = cpu->ftq[cpu->ftq_head];
+    cpu->fq_count++;
+    cpu->ftq_head = (cpu->ftq_head + 1) % MAX_FETCH_QUEUE_SIZE;
+    cpu->ftq_count--;
+    cpu->fetch_ready_cycle = -1;
+}
+
+/* Takes the oldest instruction off the fetch queue into the fetch latch */
+static void
+dequeue_insn(APEX_CPU *cpu)
+{
+    const Fetch_Entry *entry = &cpu->fetch_queue[cpu->fq_head];
+
+    cpu->fq_head = (cpu->fq_head + 1) % FETCH_QUEUE_RING;
+    cpu->fq_count--;
+
+    /* The fetch latch keeps the instruction last handed to decode */
+    fetch_instruction(cpu, entry->pc)->predicted_taken = entry->predicted_taken;
+}
+
+/* Moves the oldest instruction in the fetch queue into an empty decode */
+static void
+deliver_to_decode(APEX_CPU *cpu)
+{
+    CPU_Latch *next = decode_entry(cpu);
+    int idiom;
+
+    if (next->has_insn)
+    {
+        return;
+    }
+
+    if (!cpu->fq_count)
+    {
+        if (cpu->ftq_count && cpu->clock < cpu->fetch_ready_cycle)
+        {
+            mark_bubble(next, CYCLE_ICACHE, cpu->ftq[cpu->ftq_head].pc);
+        }
+        else
+        {
+            mark_bubble(next, CYCLE_FETCH, cpu->pc);
+        }
+
+        if (cpu->fetch.has_insn || cpu->ftq_count)
+        {
+            cpu->stats.fetch_bubbles++;
+        }
+        return;
+    }
+
+    dequeue_insn(cpu);
+    send_to_decode(cpu);
+
+    /* The second of a pair only fuses if it is queued already */
+    if (CFG_FUSION(cpu) && cpu->fq_count
+        && (idiom = fusion_idiom(cpu, next,
+                                 cpu->fetch_queue[cpu->fq_head].pc)))
+    {
+        dequeue_insn(cpu);
+        send_fused(cpu, next, idiom);
+    }
+}
+
+/*
+ * Decoupled front end, used with an I-cache or a fetch queue. Every cycle
+ * the branch predictor queues the next pc on the fetch target queue, the
+ * I-cache reads the oldest target into the fetch queue and the oldest
+ * instruction there moves on to decode. With both queues empty that takes
+ * one cycle, like coupled fetch. The predictor runs ahead while the I-cache
+ * misses or decode stalls, until the fetch target queue fills up, and the
+ * I-cache keeps filling the fetch queue while decode stalls, so misses
+ * behind a stall overlap it. A streaming loop buffer takes over once both
+ * queues have drained.
+ */
+static void
+fetch_decoupled(APEX_CPU *cpu)
+{
+    /* This fetches new branch target instruction from next cycle */
+    if (cpu->fetch_from_next_cycle == TRUE)
+    {
+        cpu->fetch_from_next_cycle = FALSE;
+        cpu->stats.flush_bubbles++;
+        mark_bubble(decode_entry(cpu), CYCLE_FLUSH, cpu->redirect_pc);
+    }
+    else if (cpu->loop_buffer.active && !cpu->ftq_count && !cpu->fq_count)
+    {
+        if (!decode_entry(cpu)->has_insn)
+        {
+            replay_loop(cpu);
+        }
+    }
+    else
+    {
+        predict_fetch_target(cpu);
+        fetch_from_icache(cpu);
+        deliver_to_decode(cpu);
+    }
+
+    cpu->stats.fq_occupancy += cpu->fq_count;
+    cpu->stats.ftq_occupancy += cpu->ftq_count;
+    if ((unsigned long long)cpu->fq_count > cpu->stats.fq_max)
+    {
+        cpu->stats.fq_max = cpu->fq_count;
+    }
+}
+
+/* Fetches the instruction at pc and moves pc on, following the BTB on a
+ * predicted taken branch */
+static CPU_Stage *
+fetch_next(APEX_CPU *cpu)
+{
+    CPU_Stage *insn = fetch_instruction(cpu, cpu->pc);
+    int target;
+
+    if (is_conditional_branch(insn->opcode)
+        && predict_branch(cpu, insn->pc, insn->opcode, &target))
+    {
+        insn->predicted_taken = TRUE;
+        cpu->pc = target;
+    }
+    else
+    {
+        cpu->pc += 4;
+    }
+    return insn;
+}
+
+/*
+ * Fetch Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_fetch(APEX_CPU *cpu)
+{
+    const CPU_Stage *insn;
+    CPU_Latch *next;
+    int code_index, idiom;
+
+    if (CFG_ICACHE_SETS(cpu) || CFG_FETCH_QUEUE(cpu))
+    {
+        fetch_decoupled(cpu);
+        return;
+    }
+
+    next = decode_entry(cpu);
+    if (!cpu->fetch.has_insn)
+    {
+        mark_bubble(next, CYCLE_FETCH, cpu->pc);
+    }
+
+    if (cpu->fetch.has_insn)
+    {
+        /* This fetches new branch target instruction from next cycle */
+        if (cpu->fetch_from_next_cycle == TRUE)
+        {
+            cpu->fetch_from_next_cycle = FALSE;
+            cpu->stats.flush_bubbles++;
+            mark_bubble(next, CYCLE_FLUSH, cpu->redirect_pc);
+
+            /* Skip this cycle*/
+            return;
+        }
+
+        /* Decode, or the next fetch sub-stage, still holds the previous
+         * instruction */
+        if (next->has_insn)
+        {
+            cpu->fetch.stall = TRUE;
+            return;
+        }
+        cpu->fetch.stall = FALSE;
+
+        if (cpu->loop_buffer.active)
+        {
+            replay_loop(cpu);
+            return;
+        }
+
+        /* Off the end of code memory, only a redirect can recover */
+        code_index = get_code_memory_index_from_pc(cpu->pc);
+        if (code_index < 0 || code_index >= cpu->code_memory_size)
+        {
+            mark_bubble(next, CYCLE_FETCH, cpu->pc);
+            return;
+        }
+
+        insn = fetch_next(cpu);
+        send_to_decode(cpu);
+
+        /* Stop fetching new instructions if HALT is fetched */
+        if (insn->opcode == OPCODE_HALT)
+        {
+            cpu->fetch.has_insn = FALSE;
+        }
+
+        if (CFG_FUSION(cpu) && (idiom = fusion_idiom(cpu, next, cpu->pc)))
+        {
+            fetch_next(cpu);
+            send_fused(cpu, next, idiom);
+        }
+    }
+}
+
+/* Loads past decode that have not completed in memory yet, at pc */
+static int
+loads_in_flight(const APEX_CPU *cpu, int pc)
+{
+    const CPU_Latch *latches[] = {&cpu->execute, &cpu->memory};
+    int i, count = 0;
+
+    for (i = 0; i < CFG_EXECUTE_STAGES(cpu) - 1; ++i)
+    {
+        count += cpu->execute_pipe[i].has_insn
+                 && MEMORY_INSN(cpu, &cpu->execute_pipe[i])->pc == pc;
+    }
+
+    for (i = 0; i < CFG_MEMORY_STAGES(cpu) - 1; ++i)
+    {
+        count += cpu->memory_pipe[i].has_insn
+                 && MEMORY_INSN(cpu, &cpu->memory_pipe[i])->pc == pc;
+    }
+
+    for (i = 0; i < 2; ++i)
+    {
+        count += latches[i]->has_insn
+                 && MEMORY_INSN(cpu, latches[i])->pc == pc;
+    }
+    return count;
+}
+
+/*
+ * Looks the LOAD/LOADP leaving decode up in the value predictor, guessing
+ * past the older instances of it still in flight. A confident guess is
+ * handed to dependents from now on.
+ */
+static void
+predict_load(APEX_CPU *cpu, CPU_Stage *insn)
+{
+    cpu->stats.lvp_loads++;
+    insn->lvp_first_use = -1;
+    insn->value_predicted
+        = APEX_lvp_predict(cpu, insn->pc, 1 + loads_in_flight(cpu, insn->pc),
+                           &insn->predicted_value);
+    if (insn->value_predicted)
+    {
+        cpu->stats.lvp_predicted++;
+    }
+}
+
+/* Notes that the instruction leaving decode took the predicted value of the
+ * load in slot, if any */
+static void
+take_predicted_value(APEX_CPU *cpu, int slot)
+{
+    if (slot >= 0 && cpu->insns[slot].lvp_first_use < 0)
+    {
+        cpu->insns[slot].lvp_first_use = cpu->clock;
+    }
+}
+
+/* Outcome of the conditional branch opcode against the flags */
+static int
+branch_taken(int opcode, int zero, int pos, int neg)
+{
+    switch (opcode)
+    {
+        case OPCODE_BZ:
+            return zero;
+        case OPCODE_BNZ:
+            return !zero;
+        case OPCODE_BP:
+            return pos;
+        case OPCODE_BNP:
+            return !pos;
+        case OPCODE_BN:
+            return neg;
+        default:
+            return !neg;
+    }
+}
+
+/*
+ * Resolves the conditional branch insn against the fetch-time prediction,
+ * training the BTB and the loop buffer with the outcome. A mispredict from
+ * decode only has the front end to squash, one from execute decode and the
+ * execute sub-stages as well. Returns whether it mispredicted.
+ */
+static int
+resolve_branch(APEX_CPU *cpu, const CPU_Stage *insn, int taken, int in_decode)
+{
+    int actual_pc = taken ? insn->pc + insn->imm : insn->pc + 4;
+    int predicted_pc = insn->predicted_taken ? insn->pc + insn->imm
+                                             : insn->pc + 4;
+
+    cpu->stats.branches++;
+    if (taken)
+    {
+        cpu->stats.taken++;
+    }
+
+    update_BTB(cpu, insn->pc, insn->opcode, taken, insn->pc + insn->imm);
+    if (CFG_PROBES && cpu->warm)
+    {
+        APEX_warm_branch(cpu->warm, insn->pc, taken);
+    }
+
+    if (actual_pc != predicted_pc)
+    {
+        cpu->stats.mispredicts++;
+        if (in_decode)
+        {
+            restart_fetch(cpu, insn->pc, actual_pc);
+        }
+        else
+        {
+            redirect_fetch(cpu, insn->pc, actual_pc);
+        }
+    }
+
+    if (CFG_LOOP_BUFFER(cpu))
+    {
+        train_loop_buffer(cpu, insn->pc, insn->pc + insn->imm, taken);
+    }
+    return actual_pc != predicted_pc;
+}
+
+/*
+ * Applies older, an instruction ahead of a branch in decode, to the flags
+ * the branch will see: a CMP or CML sets all three from operands it read in
+ * decode, which the decode comparator compares again, any other instruction
+ * setting flags leaves them unknown until execute. Returns FALSE if older
+ * may yet redirect fetch past the branch.
+ */
+static int
+bypass_older(const CPU_Stage *older, int *known, int *zero, int *pos,
+             int *neg)
+{
+    int order;
+
+    if (older->opcode == OPCODE_JUMP || older->opcode == OPCODE_JALR
+        || (is_conditional_branch(older->opcode) && !older->resolved_early))
+    {
+        return FALSE;
+    }
+
+    if (older->opcode == OPCODE_CMP || older->opcode == OPCODE_CML)
+    {
+        order = older->opcode == OPCODE_CMP ? older->rs2_value : older->imm;
+        order = (older->rs1_value > order) - (older->rs1_value < order);
+        *zero = order == 0;
+        *pos = order > 0;
+        *neg = order < 0;
+        *known = TRUE;
+    }
+    else if (sets_flags(older->opcode))
+    {
+        *known = FALSE;
+    }
+    return TRUE;
+}
 
-            case OPCODE_MUL:
+/*
+ * The flags a conditional branch leaving decode would see in execute, if
+ * decode can tell already. Execute has run this cycle, so the flags hold
+ * whatever it just executed; the instructions still in execute, oldest
+ * first, and head, the first of the branch's fused pair if it has one, go
+ * through bypass_older(). Returns FALSE when that leaves the flags unknown
+ * or an older instruction may redirect fetch; the branch then resolves in
+ * execute as usual.
+ */
+static int
+bypass_flags(const APEX_CPU *cpu, const CPU_Stage *head, int *zero, int *pos,
+             int *neg)
+{
+    const CPU_Latch *latch;
+    int known = TRUE;
+    int i;
+
+    *zero = cpu->zero_flag;
+    *pos = cpu->pos_flag;
+    *neg = cpu->neg_flag;
+
+    for (i = CFG_EXECUTE_STAGES(cpu) - 1; i >= 0; --i)
+    {
+        latch = i < CFG_EXECUTE_STAGES(cpu) - 1 ? &cpu->execute_pipe[i]
+                                                : &cpu->execute;
+        if (!latch->has_insn)
+        {
+            continue;
+        }
+
+        if (!bypass_older(&cpu->insns[latch->insn], &known, zero, pos, neg)
+            || (LATCH_FUSED(cpu, latch)
+                && !bypass_older(&cpu->insns[latch->tail], &known, zero, pos,
+                                 neg)))
+        {
+            return FALSE;
+        }
+    }
+
+    if (head && !bypass_older(head, &known, zero, pos, neg))
+    {
+        return FALSE;
+    }
+    return known;
+}
+
+/*
+ * TRUE if insn, the tail of the fused pair in decode, takes reg straight
+ * from its head rather than from the register file or forwarding
+ */
+static int
+reads_head(const APEX_CPU *cpu, const CPU_Stage *insn, int reg)
+{
+    const CPU_Stage *head = LATCH_INSN(cpu, decode);
+
+    return CFG_FUSION(cpu) != FUSE_NONE && insn != head
+           && is_write_to_reg_instruction(head->opcode)
+           && head->rd == reg;
+}
+
+/* TRUE if every source operand of insn in decode is available */
+static int
+operands_ready(const APEX_CPU *cpu, const CPU_Stage *insn)
+{
+    int value, predicted_by;
+    int vector[MAX_VECTOR_LENGTH];
+
+    if (reads_rs1(insn->opcode) && !reads_head(cpu, insn, insn->rs1)
+        && !read_register(cpu, insn->rs1, &value, &predicted_by))
+    {
+        return FALSE;
+    }
+
+    if (reads_rs2(insn->opcode) && !reads_head(cpu, insn, insn->rs2)
+        && !read_register(cpu, insn->rs2, &value, &predicted_by))
+    {
+        return FALSE;
+    }
+
+    if (reads_vector_rs1(insn->opcode)
+        && !read_vector_register(cpu, insn->rs1, vector))
+    {
+        return FALSE;
+    }
+
+    if (reads_vector_rs2(insn->opcode)
+        && !read_vector_register(cpu, insn->rs2, vector))
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Reads the source operands of insn, leaving decode, from the register file
+ * or the forwarding paths, and looks a load up in the value predictor.
+ * Operands the tail of a fused pair takes from its head are filled in by
+ * execute instead.
+ */
+static void
+read_operands(APEX_CPU *cpu, CPU_Stage *insn)
+{
+    CPU_Lanes *lanes = INSN_LANES(cpu, insn);
+    int predicted_by[2] = {-1, -1};
+
+    if (reads_rs1(insn->opcode) && !reads_head(cpu, insn, insn->rs1))
+    {
+        read_register(cpu, insn->rs1, &insn->rs1_value, &predicted_by[0]);
+    }
+
+    if (reads_rs2(insn->opcode) && !reads_head(cpu, insn, insn->rs2))
+    {
+        read_register(cpu, insn->rs2, &insn->rs2_value, &predicted_by[1]);
+    }
+
+    if (reads_vector_rs1(insn->opcode))
+    {
+        read_vector_register(cpu, insn->rs1, lanes->vs1_value);
+    }
+
+    if (reads_vector_rs2(insn->opcode))
+    {
+        read_vector_register(cpu, insn->rs2, lanes->vs2_value);
+    }
+
+    if (CFG_VALUE_PREDICTOR(cpu) != LVP_NONE)
+    {
+        take_predicted_value(cpu, predicted_by[0]);
+        take_predicted_value(cpu, predicted_by[1]);
+        if (insn->opcode == OPCODE_LOAD || insn->opcode == OPCODE_LOADP)
+        {
+            predict_load(cpu, insn);
+        }
+    }
+}
+
+/*
+ * Resolves the conditional branch insn in decode if bypass_flags() knows
+ * the flags it will see; head is the first of its fused pair, if any
+ */
+static void
+resolve_early(APEX_CPU *cpu, CPU_Stage *insn, const CPU_Stage *head)
+{
+    int zero, pos, neg;
+
+    if (!bypass_flags(cpu, head, &zero, &pos, &neg))
+    {
+        return;
+    }
+
+    insn->resolved_early = TRUE;
+    cpu->stats.early_branches++;
+    if (resolve_branch(cpu, insn, branch_taken(insn->opcode, zero, pos, neg),
+                       TRUE))
+    {
+        insn->redirect_cycle = cpu->clock;
+        cpu->stats.early_mispredicts++;
+    }
+}
+
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_decode(APEX_CPU *cpu)
+{
+    CPU_Stage *insn = LATCH_INSN(cpu, decode);
+    CPU_Stage *tail = FUSED_TAIL(cpu, decode);
+    CPU_Latch *next = execute_entry(cpu);
+
+    if (!cpu->decode.has_insn)
+    {
+        mark_bubble(next, cpu->decode.bubble_reason, cpu->decode.bubble_pc);
+    }
+
+    if (cpu->decode.has_insn)
+    {
+        /* First instruction back after a value replay */
+        if (CFG_VALUE_PREDICTOR(cpu) != LVP_NONE && cpu->lvp.replay_cycle >= 0)
+        {
+            cpu->stats.lvp_cycles_lost += cpu->clock - cpu->lvp.replay_cycle;
+            cpu->lvp.replay_cycle = -1;
+        }
+
+        detect_data_hazards(cpu);
+        if (cpu->decode.stall)
+        {
+            cpu->stats.raw_stalls++;
+            mark_bubble(next, CYCLE_RAW, insn->pc);
+            if (CFG_PROBES && cpu->trace)
             {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                break;
+                APEX_trace_stall(cpu->trace, insn, CYCLE_RAW);
             }
+            return;
+        }
 
-            case OPCODE_LOAD:
+        /* Execute is still busy with a multi-cycle instruction */
+        if (next->has_insn)
+        {
+            if (CFG_PROBES && cpu->trace)
             {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                printf("hi");
-                // cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                break;
+                APEX_trace_stall(cpu->trace, insn, CYCLE_EXEC);
             }
+            return;
+        }
 
-            case OPCODE_STORE:
+        /* Read operands from register file or forwarding paths. Hazard
+         * detection above guarantees both are available. */
+        read_operands(cpu, insn);
+        if (tail)
+        {
+            read_operands(cpu, tail);
+        }
+
+        /* Resolve conditional branches here when the flags are known */
+        if (CFG_BRANCH_STAGE(cpu) == BRANCH_DECODE)
+        {
+            if (is_conditional_branch(insn->opcode))
             {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                printf("%d",cpu->decode.rs1_value);
-                printf("%d",cpu->decode.rs2_value);
-                break;
+                resolve_early(cpu, insn, NULL);
             }
-
-            case OPCODE_STOREP:
+            else if (tail && is_conditional_branch(tail->opcode))
             {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                // printf("%d",cpu->decode.rs1_value);
-                // printf("%d",cpu->decode.rs2_value);
-                break;
+                resolve_early(cpu, tail, insn);
             }
+        }
 
-            case OPCODE_LOADP:
+        /* Copy data from decode latch to execute latch*/
+        *next = cpu->decode;
+        insn->cycles_left = execute_latency(cpu, insn->opcode);
+        cpu->decode.has_insn = FALSE;
+
+        if (CFG_PROBES && cpu->trace)
+        {
+            APEX_trace_stage(cpu->trace, insn, TRACE_EXECUTE);
+            if (tail)
             {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rd_value = cpu->regs[cpu->decode.rd];
-                break;
+                APEX_trace_stage(cpu->trace, tail, TRACE_EXECUTE);
             }
+        }
 
-            case OPCODE_MOVC:
+        if (CFG_PROBES && cpu->debug_messages)
+        {
+            print_stage_content("Decode/RF", insn);
+            if (tail)
             {
-                /* MOVC doesn't have register operands */
-                break;
+                print_stage_content("Decode/RF", tail);
             }
+        }
+    }
+}
+
+/*
+ * Sets the cycles insn occupies the memory stage as it reaches the last
+ * memory sub-stage, where the access happens
+ */
+static void
+start_memory_access(APEX_CPU *cpu, CPU_Stage *insn)
+{
+    insn->cycles_left = memory_latency(cpu, insn);
+    if (CFG_PREFETCHER(cpu) != PREFETCH_NONE && reads_memory_port(cpu, insn))
+    {
+        insn->cycles_left
+            = APEX_prefetch_access(cpu, insn->pc, insn->memory_address);
+    }
+}
+
+/*
+ * Executes insn on the functional units: computes its result or memory
+ * address, updates the flags and resolves branches
+ */
+static void
+execute_operation(APEX_CPU *cpu, CPU_Stage *insn)
+{
+    CPU_Lanes *lanes = INSN_LANES(cpu, insn);
+
+    /* Execute logic based on instruction type */
+    switch (insn->opcode)
+    {
+        case OPCODE_ADD:
+        {
+            /* Sums and differences wrap, computed as unsigned to keep the
+             * overflow defined */
+            insn->result_buffer = (int)((unsigned int)insn->rs1_value
+                                        + (unsigned int)insn->rs2_value);
+
+            /* Set the flags based on the result buffer */
+            set_flags(cpu, insn->result_buffer);
+            break;
+        }
+
+        case OPCODE_ADDL:
+        {
+            insn->result_buffer = (int)((unsigned int)insn->rs1_value
+                                        + (unsigned int)insn->imm);
+            set_flags(cpu, insn->result_buffer);
+            break;
+        }
+
+        case OPCODE_SUB:
+        {
+            insn->result_buffer = (int)((unsigned int)insn->rs1_value
+                                        - (unsigned int)insn->rs2_value);
+            set_flags(cpu, insn->result_buffer);
+            break;
+        }
+
+        case OPCODE_SUBL:
+        {
+            insn->result_buffer = (int)((unsigned int)insn->rs1_value
+                                        - (unsigned int)insn->imm);
+            set_flags(cpu, insn->result_buffer);
+            break;
+        }
+
+        case OPCODE_MUL:
+        {
+            /* Wraps, computed as unsigned to keep the overflow defined */
+            insn->result_buffer = (int)((unsigned int)insn->rs1_value
+                                        * (unsigned int)insn->rs2_value);
+            set_flags(cpu, insn->result_buffer);
+            break;
+        }
 
-            case OPCODE_CMP:
+        case OPCODE_DIV:
+        {
+            /* Division by zero yields zero. Dividing by -1 negates, which
+             * wraps for INT_MIN instead of trapping on the host */
+            if (insn->rs2_value == 0)
             {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                break;
+                insn->result_buffer = 0;
+            }
+            else if (insn->rs2_value == -1)
+            {
+                insn->result_buffer
+                    = (int)(0u - (unsigned int)insn->rs1_value);
+            }
+            else
+            {
+                insn->result_buffer = insn->rs1_value / insn->rs2_value;
             }
+            set_flags(cpu, insn->result_buffer);
+            break;
+        }
+
+        case OPCODE_LOAD:
+        {
+            insn->memory_address = insn->rs1_value + insn->imm;
+            break;
+        }
+
+        case OPCODE_LOADP:
+        {
+            /* Calculate the memory address, then post-increment the base */
+            insn->memory_address = insn->rs1_value + insn->imm;
+            insn->rs1_new_value = insn->rs1_value + 4;
+            break;
+        }
+
+        case OPCODE_STORE:
+        {
+            insn->memory_address = insn->rs1_value + insn->imm;
+            insn->result_buffer = insn->rs2_value;
+            break;
+        }
+
+        case OPCODE_STOREP:
+        {
+            insn->memory_address = insn->rs1_value + insn->imm;
+            insn->result_buffer = insn->rs2_value;
+            insn->rs1_new_value = insn->rs1_value + 4;
+            break;
+        }
+
+        case OPCODE_JUMP:
+        {
+            insn->memory_address = insn->rs1_value + insn->imm;
+            cpu->stats.jumps++;
+            redirect_fetch(cpu, insn->pc, insn->memory_address);
+            break;
+        }
+
+        case OPCODE_JALR:
+        {
+            /* Link value is written back to rd in writeback */
+            insn->memory_address = insn->rs1_value + insn->imm;
+            insn->result_buffer = insn->pc + 4;
+            cpu->stats.jumps++;
+            redirect_fetch(cpu, insn->pc, insn->memory_address);
+            break;
+        }
+
+        case OPCODE_CMP:
+        {
+            set_flags(cpu, (insn->rs1_value > insn->rs2_value)
+                               - (insn->rs1_value < insn->rs2_value));
+            break;
+        }
 
-            case OPCODE_CML:
+        case OPCODE_CML:
+        {
+            set_flags(cpu, (insn->rs1_value > insn->imm)
+                               - (insn->rs1_value < insn->imm));
+            break;
+        }
+
+        case OPCODE_MOVC: 
+        {
+            insn->result_buffer = insn->imm;
+
+            /* Set the zero flag based on the result buffer */
+            if (insn->result_buffer == 0)
             {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                break;
+                cpu->zero_flag = TRUE;
+            } 
+            else 
+            {
+                cpu->zero_flag = FALSE;
             }
+            break;
+        }
+
+        case OPCODE_OR:
+        {
+            insn->result_buffer = insn->rs1_value | insn->rs2_value;
+            break;
+        }
+
+        case OPCODE_XOR:
+        {
+            insn->result_buffer = insn->rs1_value ^ insn->rs2_value;
+            break;
+        }
+
+        case OPCODE_VLOAD:
+        case OPCODE_VSTORE:
+        {
+            insn->memory_address = insn->rs1_value + insn->imm;
+            memcpy(lanes->vresult, lanes->vs2_value, sizeof(lanes->vresult));
+            break;
+        }
+
+        case OPCODE_VADD:
+        {
+            APEX_vector_add(lanes->vresult, lanes->vs1_value,
+                            lanes->vs2_value);
+            break;
+        }
+
+        case OPCODE_VMUL:
+        {
+            APEX_vector_mul(lanes->vresult, lanes->vs1_value,
+                            lanes->vs2_value);
+            break;
+        }
+
+        case OPCODE_VRED:
+        {
+            insn->result_buffer = APEX_vector_reduce(lanes->vs1_value);
+            break;
+        }
+
+        case OPCODE_AND:
+        {
+            insn->result_buffer = insn->rs1_value & insn->rs2_value;
 
-            case OPCODE_JUMP:
+            /* Set the zero flag based on the result buffer */
+            if (insn->result_buffer == 0)
             {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                break;
-            }
-
-            case OPCODE_JALR:
+                cpu->zero_flag = TRUE;
+            } 
+            else 
             {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rd_value = cpu->regs[cpu->decode.rd];
-                break;
+                cpu->zero_flag = FALSE;
             }
+            break;
         }
+    }
 
-        /* Copy data from decode latch to execute latch*/
-        cpu->execute = cpu->decode;
-        cpu->decode.has_insn = FALSE;
-
-        if (ENABLE_DEBUG_MESSAGES)
+    /* Resolve conditional branches against the fetch-time prediction,
+     * unless decode already did. A redirect from decode came as many
+     * cycles early as the branch has taken to get here */
+    if (is_conditional_branch(insn->opcode))
+    {
+        if (!insn->resolved_early)
         {
-            print_stage_content("Decode/RF", &cpu->decode);
+            resolve_branch(cpu, insn,
+                           branch_taken(insn->opcode, cpu->zero_flag,
+                                        cpu->pos_flag, cpu->neg_flag),
+                           FALSE);
         }
+        else if (insn->redirect_cycle >= 0)
+        {
+            cpu->stats.early_cycles_saved
+                += cpu->clock - insn->redirect_cycle;
+        }
+    }
+
+    /* Flags a value replay of this load goes back to */
+    if (CFG_VALUE_PREDICTOR(cpu) != LVP_NONE && insn->value_predicted)
+    {
+        insn->lvp_flags = cpu->zero_flag | (cpu->pos_flag << 1)
+                          | (cpu->neg_flag << 2);
     }
 }
 
@@ -466,444 +2400,380 @@ APEX_decode(APEX_CPU *cpu)
 static void
 APEX_execute(APEX_CPU *cpu)
 {
-    if (cpu->execute.stall) {
-        // Skip fetching new instruction
-        return;
+    CPU_Stage *insn = LATCH_INSN(cpu, execute);
+    CPU_Stage *tail = FUSED_TAIL(cpu, execute);
+    CPU_Latch *next = memory_entry(cpu);
+
+    if (!cpu->execute.has_insn)
+    {
+        mark_bubble(next, cpu->execute.bubble_reason, cpu->execute.bubble_pc);
     }
+
     if (cpu->execute.has_insn)
     {
-        /* Execute logic based on instruction type */
-        switch (cpu->execute.opcode)
+        /* Multi-cycle functional unit still working */
+        if (insn->cycles_left > 1)
         {
-            case OPCODE_ADD:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value + cpu->execute.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
-            }
+            insn->cycles_left--;
+            cpu->stats.exec_stalls++;
+            mark_bubble(next, CYCLE_EXEC, insn->pc);
+            return;
+        }
 
-            case OPCODE_ADDL:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value + cpu->execute.imm;
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
-            }
-            
-            case OPCODE_SUB:
+        /* Memory is still busy with a multi-cycle access */
+        if (next->has_insn)
+        {
+            if (CFG_PROBES && cpu->trace)
             {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value - cpu->execute.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
+                APEX_trace_stall(cpu->trace, insn, CYCLE_MEM);
             }
+            return;
+        }
 
-            case OPCODE_SUBL:
+        execute_operation(cpu, insn);
+        if (tail)
+        {
+            /* The tail takes the head's result straight from the ALU */
+            if (reads_rs1(tail->opcode) && tail->rs1 == insn->rd
+                && is_write_to_reg_instruction(insn->opcode))
             {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value - cpu->execute.imm;
-                    
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
+                tail->rs1_value = insn->result_buffer;
             }
-
-            case OPCODE_MUL:
+            if (reads_rs2(tail->opcode) && tail->rs2 == insn->rd
+                && is_write_to_reg_instruction(insn->opcode))
             {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value - cpu->execute.rs2_value;
-                break;
+                tail->rs2_value = insn->result_buffer;
             }
+            execute_operation(cpu, tail);
+        }
 
-            case OPCODE_LOAD:
-            {
-                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
-                printf("%d",cpu->execute.memory_address);
-                break;
-            }
+        /* Copy data from execute latch to memory latch*/
+        *next = cpu->execute;
+        if (next == &cpu->memory)
+        {
+            start_memory_access(cpu, MEMORY_INSN(cpu, next));
+        }
+        cpu->execute.has_insn = FALSE;
 
-            case OPCODE_LOADP:
-            {
-                /* Calculate the memory address by adding rs1_value and rs2_value */
-                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->execute.rd = cpu->execute.rd_value + 4 ;
-                break;
-            }
-            
-            case OPCODE_STORE:
+        if (CFG_PROBES && cpu->trace)
+        {
+            APEX_trace_stage(cpu->trace, insn, TRACE_MEMORY);
+            if (tail)
             {
-                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->execute.result_buffer = cpu->execute.rs2_value;
-                printf("%d",cpu->execute.result_buffer);
-                printf("%d",cpu->execute.memory_address);
-                break;
+                APEX_trace_stage(cpu->trace, tail, TRACE_MEMORY);
             }
+        }
 
-            case OPCODE_STOREP:
+        if (CFG_PROBES && cpu->debug_messages)
+        {
+            print_stage_content("Execute", insn);
+            if (tail)
             {
-                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->execute.result_buffer = cpu->execute.rs2_value;
-                // printf("%d",cpu->execute.result_buffer);
-                // printf("%d",cpu->execute.memory_address);
-                break;
+                print_stage_content("Execute", tail);
             }
+        }
+    }
+}
 
-            case OPCODE_JUMP:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value + cpu->execute.imm;
-
-                cpu->pc = cpu->execute.result_buffer;
+/*
+ * Value misprediction recovery for load, completing in memory: squashes
+ * everything behind it, puts the flags back as it left execute and fetches
+ * again from the instruction after it.
+ */
+static void
+replay_after_load(APEX_CPU *cpu, const CPU_Stage *load)
+{
+    int i;
 
-                cpu->fetch_from_next_cycle = TRUE;
+    cpu->stats.lvp_replays++;
+    for (i = 0; i < CFG_MEMORY_STAGES(cpu) - 1; ++i)
+    {
+        squash_latch(cpu, &cpu->memory_pipe[i], load->pc);
+    }
+    squash_latch(cpu, &cpu->execute, load->pc);
 
-                cpu->decode.has_insn = FALSE;
+    cpu->zero_flag = load->lvp_flags & 1;
+    cpu->pos_flag = (load->lvp_flags >> 1) & 1;
+    cpu->neg_flag = (load->lvp_flags >> 2) & 1;
 
-                cpu->fetch.has_insn = TRUE;
+    redirect_fetch(cpu, load->pc, load->pc + 4);
+    cpu->lvp.replay_cycle = cpu->clock;
+}
 
-                break;
-            }
+/*
+ * Checks the value the load just read against the predictor's guess and
+ * trains the predictor. A wrong guess that dependents took is replayed.
+ */
+static void
+verify_load_value(APEX_CPU *cpu, const CPU_Stage *insn)
+{
+    APEX_lvp_train(cpu, insn->pc, insn->result_buffer, insn->predicted_value);
+    if (!insn->value_predicted)
+    {
+        return;
+    }
 
-            case OPCODE_JALR: 
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value + cpu->execute.imm;
+    if (insn->result_buffer == insn->predicted_value)
+    {
+        /* Dependents would have had the value from this cycle on */
+        cpu->stats.lvp_correct++;
+        if (insn->lvp_first_use >= 0)
+        {
+            cpu->stats.lvp_cycles_saved += cpu->clock - insn->lvp_first_use;
+        }
+    }
+    else if (insn->lvp_first_use >= 0)
+    {
+        replay_after_load(cpu, insn);
+    }
+}
 
-                cpu->pc = cpu->execute.result_buffer;
+/* TRUE if the data memory access of insn reaches outside data memory */
+static int
+outside_data_memory(const APEX_CPU *cpu, const CPU_Stage *insn)
+{
+    int last = insn->memory_address;
 
-                cpu->regs[cpu->execute.rd_value] = cpu->execute.pc + 4;
+    switch (insn->opcode)
+    {
+        case OPCODE_VLOAD:
+        case OPCODE_VSTORE:
+            /* Lanes are four words apart */
+            last += 4 * (cpu->config.vector_length - 1);
+            break;
 
-                cpu->fetch_from_next_cycle = TRUE;
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+            break;
 
-                cpu->decode.has_insn = FALSE;
+        default:
+            return FALSE;
+    }
+    return insn->memory_address < 0 || last >= DATA_MEMORY_SIZE;
+}
 
-                cpu->fetch.has_insn = TRUE;
+/*
+ * Memory Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_memory(APEX_CPU *cpu)
+{
+    CPU_Stage *insn = MEMORY_INSN(cpu, &cpu->memory);
+    CPU_Lanes *lanes = INSN_LANES(cpu, insn);
+    int slot;
 
-                break;
-            }
+    if (CFG_STORE_BUFFER(cpu))
+    {
+        drain_store_buffer(cpu);
+    }
 
+    if (!cpu->memory.has_insn)
+    {
+        mark_bubble(&cpu->writeback, cpu->memory.bubble_reason,
+                    cpu->memory.bubble_pc);
+    }
 
-            case OPCODE_BZ:
+    if (cpu->memory.has_insn)
+    {
+        if (CFG_STORE_BUFFER(cpu) && store_buffer_blocks(cpu))
+        {
+            cpu->stats.sb_stalls++;
+            mark_bubble(&cpu->writeback, CYCLE_MEM, insn->pc);
+            if (CFG_PROBES && cpu->trace)
             {
-                if (cpu->zero_flag == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
+                APEX_trace_stall(cpu->trace, insn, CYCLE_MEM);
             }
+            return;
+        }
 
-            case OPCODE_BNZ:
-            {
-                if (cpu->zero_flag == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
+        /* Multi-cycle access still in progress */
+        if (insn->cycles_left > 1)
+        {
+            insn->cycles_left--;
+            cpu->stats.mem_stalls++;
+            mark_bubble(&cpu->writeback, CYCLE_MEM, insn->pc);
+            return;
+        }
 
-            case OPCODE_BP:
+        /* A wild address stops the run rather than reach past data memory */
+        if (outside_data_memory(cpu, insn))
+        {
+            cpu->failed = FAIL_MEMORY;
+            fprintf(stderr,
+                    "APEX_Error: pc(%d) %s accesses M[%d] outside data "
+                    "memory\n",
+                    insn->pc, APEX_opcode_name(insn->opcode),
+                    insn->memory_address);
+            return;
+        }
+
+        switch (insn->opcode)
+        {
+            case OPCODE_LOAD:
+            case OPCODE_LOADP:
             {
-                if (cpu->pos_flag == TRUE)
+                /* Read from the youngest matching buffered store, or from data
+                 * memory */
+                slot = CFG_STORE_BUFFER(cpu)
+                           ? find_buffered_store(cpu, insn->memory_address)
+                           : -1;
+                if (slot >= 0)
                 {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
+                    insn->result_buffer = cpu->store_buffer[slot].value;
+                    cpu->stats.sb_forwards++;
                 }
-                break;
-            }
-
-            case OPCODE_BNP:
-            {
-                if (cpu->pos_flag == FALSE)
+                else
                 {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
+                    insn->result_buffer
+                        = cpu->data_memory[insn->memory_address];
                 }
-                break;
-            }
 
-            case OPCODE_BN:
-            {
-                if (cpu->neg_flag == TRUE)
+                if (cpu->recorder)
                 {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
+                    APEX_recorder_access(cpu->recorder, insn->memory_address,
+                                         insn->result_buffer, FALSE);
                 }
-                break;
-            }
 
-            case OPCODE_BNN:
-            {
-                if (cpu->neg_flag == FALSE)
+                if (CFG_VALUE_PREDICTOR(cpu) != LVP_NONE)
                 {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
+                    verify_load_value(cpu, insn);
                 }
                 break;
             }
 
-            case OPCODE_CMP:
+            case OPCODE_STORE:
+            case OPCODE_STOREP:
             {
-                if (cpu->execute.rs1_value == cpu->execute.rs2_value)
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->neg_flag = FALSE;
-                    cpu->pos_flag = FALSE;
-                }
-
-                else if (cpu->execute.rs1_value < cpu->execute.rs2_value)
+                /* Write to data memory, or leave it to the store buffer */
+                if (CFG_STORE_BUFFER(cpu))
                 {
-                    cpu->zero_flag = FALSE;
-                    cpu->neg_flag = TRUE;
-                    cpu->pos_flag = FALSE;
+                    buffer_store(cpu, insn->memory_address,
+                                 insn->result_buffer);
                 }
-
                 else
                 {
-                    cpu->zero_flag = FALSE;
-                    cpu->neg_flag = FALSE;
-                    cpu->pos_flag = TRUE;
+                    cpu->data_memory[insn->memory_address] = insn->result_buffer;
+                    if (cpu->recorder)
+                    {
+                        APEX_recorder_access(cpu->recorder,
+                                             insn->memory_address,
+                                             insn->result_buffer, TRUE);
+                    }
                 }
+                break;
             }
 
-            case OPCODE_CML:
+            case OPCODE_VLOAD:
             {
-                if (cpu->execute.rs1_value == cpu->execute.imm)
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->neg_flag = FALSE;
-                    cpu->pos_flag = FALSE;
-                }
-
-                else if (cpu->execute.rs1_value < cpu->execute.imm)
-                {
-                    cpu->zero_flag = FALSE;
-                    cpu->neg_flag = TRUE;
-                    cpu->pos_flag = FALSE;
-                }
-
-                else
+                APEX_vector_load(lanes->vresult, cpu->data_memory,
+                                 insn->memory_address,
+                                 cpu->config.vector_length);
+                if (cpu->recorder)
                 {
-                    cpu->zero_flag = FALSE;
-                    cpu->neg_flag = FALSE;
-                    cpu->pos_flag = TRUE;
+                    APEX_recorder_access(cpu->recorder, insn->memory_address,
+                                         lanes->vresult[0], FALSE);
                 }
+                break;
             }
 
-            case OPCODE_MOVC: 
+            case OPCODE_VSTORE:
             {
-                cpu->execute.result_buffer = cpu->execute.imm;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
+                APEX_vector_store(cpu->data_memory, insn->memory_address,
+                                  lanes->vresult, cpu->config.vector_length);
+                if (cpu->recorder)
                 {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
+                    APEX_recorder_access(cpu->recorder, insn->memory_address,
+                                         lanes->vresult[0], TRUE);
                 }
                 break;
             }
+        }
 
-            case OPCODE_OR:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value | cpu->execute.rs2_value;
-                break;
-            }
-
-            case OPCODE_XOR:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value ^ cpu->execute.rs2_value;
-                break;
-            }
+        /* Copy data from memory latch to writeback latch*/
+        cpu->writeback = cpu->memory;
+        cpu->memory.has_insn = FALSE;
 
-            case OPCODE_AND:
+        if (CFG_PROBES && cpu->trace)
+        {
+            if (LATCH_FUSED(cpu, &cpu->writeback))
             {
-                cpu->execute.result_buffer = cpu->execute.rs1_value & cpu->execute.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
+                APEX_trace_stage(cpu->trace, LATCH_INSN(cpu, writeback),
+                                 TRACE_WRITEBACK);
             }
+            APEX_trace_stage(cpu->trace, insn, TRACE_WRITEBACK);
         }
 
-        /* Copy data from execute latch to memory latch*/
-        cpu->memory = cpu->execute;
-        cpu->execute.has_insn = FALSE;
-
-        if (ENABLE_DEBUG_MESSAGES)
+        if (CFG_PROBES && cpu->debug_messages)
         {
-            print_stage_content("Execute", &cpu->execute);
+            if (LATCH_FUSED(cpu, &cpu->writeback))
+            {
+                print_stage_content("Memory", LATCH_INSN(cpu, writeback));
+            }
+            print_stage_content("Memory", insn);
         }
     }
 }
 
 /*
- * Memory Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Writes the results of insn back and retires it. Returns TRUE if the
+ * simulator must stop: insn is HALT or diverged from the golden model.
  */
-static void
-APEX_memory(APEX_CPU *cpu)
+static int
+retire_insn(APEX_CPU *cpu, const CPU_Stage *insn)
 {
-    if (cpu->memory.stall) {
-        // Skip fetching new instruction
-        return;
-    }
-    if (cpu->memory.has_insn)
+    /* Post-incremented base first, so LOADP into its own base keeps the
+     * loaded value */
+    if (writes_base_register(insn->opcode))
     {
-        switch (cpu->memory.opcode)
+        cpu->regs[insn->rs1] = insn->rs1_new_value;
+        if (cpu->recorder)
         {
-            case OPCODE_ADD:
-            {
-                /* No work for ADD */
-                break;
-            }
-
-            case OPCODE_LOAD:
-            {
-                /* Read from data memory */
-                cpu->memory.result_buffer
-                    = cpu->data_memory[cpu->memory.memory_address];
-                printf("%d",cpu->memory.result_buffer);
-                break;
-            }
-            case OPCODE_LOADP:
-            {
-                /* Read from data memory */
-                cpu->memory.result_buffer
-                    = cpu->data_memory[cpu->memory.memory_address];
-                // printf("%d",cpu->memory.result_buffer);
-                break;
-            }
-
-            case OPCODE_STORE:
-            {
-                /* Write to data memory */
-                cpu->data_memory[cpu->memory.memory_address] = cpu->memory.result_buffer;
-                break;
-            }
-
-            case OPCODE_STOREP:
-            {
-                int data_to_store = cpu->memory.result_buffer;
+            APEX_recorder_write(cpu->recorder, insn->rs1, insn->rs1_new_value);
+        }
+    }
 
-                cpu->data_memory[cpu->memory.memory_address] = data_to_store;
-                break;
-            }
+    /* Write result to register file based on instruction type */
+    if (is_write_to_reg_instruction(insn->opcode))
+    {
+        cpu->regs[insn->rd] = insn->result_buffer;
+        if (cpu->recorder)
+        {
+            APEX_recorder_write(cpu->recorder, insn->rd, insn->result_buffer);
+        }
+    }
 
+    if (writes_vector_register(insn->opcode))
+    {
+        memcpy(cpu->vregs[insn->rd], INSN_LANES(cpu, insn)->vresult,
+               sizeof(cpu->lanes[0].vresult));
+    }
 
-        }
+    cpu->insn_completed++;
 
-        /* Copy data from memory latch to writeback latch*/
-        cpu->writeback = cpu->memory;
-        cpu->memory.has_insn = FALSE;
+    if (CFG_PROBES && cpu->golden
+        && APEX_golden_retire(cpu->golden, cpu, insn))
+    {
+        /* Stop the APEX simulator at the first divergence */
+        cpu->diverged = TRUE;
+        return TRUE;
+    }
 
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            print_stage_content("Memory", &cpu->memory);
-        }
+    if (CFG_PROBES && cpu->trace)
+    {
+        APEX_trace_retire(cpu->trace, insn);
+    }
+
+    if (CFG_PROBES && cpu->debug_messages)
+    {
+        print_stage_content("Writeback", insn);
     }
+
+    /* Stop the APEX simulator on HALT */
+    return insn->opcode == OPCODE_HALT;
 }
 
 /*
@@ -914,84 +2784,44 @@ APEX_memory(APEX_CPU *cpu)
 static int
 APEX_writeback(APEX_CPU *cpu)
 {
-    if (cpu->writeback.stall) {
-        // Skip fetching new instruction
-        return FALSE;
-    }
-    if (cpu->writeback.has_insn)
+    const CPU_Stage *insn = LATCH_INSN(cpu, writeback);
+
+    if (CFG_PROBES && cpu->profile)
     {
-        /* Write result to register file based on instruction type */
-        switch (cpu->writeback.opcode)
+        if (cpu->writeback.has_insn)
         {
-            case OPCODE_ADD:
-            case OPCODE_ADDL:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
-
-            case OPCODE_SUB:
-            case OPCODE_SUBL:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
-
-            case OPCODE_MUL:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
-
-            case OPCODE_LOAD:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
-
-            case OPCODE_LOADP:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
-
-            case OPCODE_MOVC: 
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
-
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
-
-            case OPCODE_JALR:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
-
-            case OPCODE_AND:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
+            APEX_profile_charge(cpu->profile, insn->pc, CYCLE_RETIRE);
+        }
+        else
+        {
+            APEX_profile_charge(cpu->profile, cpu->writeback.bubble_pc,
+                                cpu->writeback.bubble_reason);
         }
+    }
 
-        cpu->insn_completed++;
+    if (cpu->writeback.has_insn)
+    {
         cpu->writeback.has_insn = FALSE;
-
-        if (ENABLE_DEBUG_MESSAGES)
+        if (LATCH_FUSED(cpu, &cpu->writeback))
         {
-            print_stage_content("Writeback", &cpu->writeback);
+            switch (cpu->writeback.fused)
+            {
+                case FUSE_CMP_BRANCH:
+                    cpu->stats.fused_cmp_branch++;
+                    break;
+                case FUSE_MOVC_ADD:
+                    cpu->stats.fused_movc_add++;
+                    break;
+                case FUSE_ADDL_LOAD:
+                    cpu->stats.fused_addl_load++;
+                    break;
+            }
         }
 
-        if (cpu->writeback.opcode == OPCODE_HALT)
+        if (retire_insn(cpu, insn)
+            || (LATCH_FUSED(cpu, &cpu->writeback)
+                && retire_insn(cpu, FUSED_TAIL(cpu, writeback))))
         {
-            /* Stop the APEX simulator */
             return TRUE;
         }
     }
@@ -1000,13 +2830,15 @@ APEX_writeback(APEX_CPU *cpu)
     return 0;
 }
 
+#ifndef APEX_VARIANT
 /*
- * This function creates and initializes APEX cpu.
+ * This function creates and initializes APEX cpu. A NULL config selects the
+ * defaults from apex_macros.h.
  *
  * Note: You are free to edit this function according to your implementation
  */
 APEX_CPU *
-APEX_cpu_init(const char *filename)
+APEX_cpu_init(const char *filename, const APEX_Config *config)
 {
     int i;
     APEX_CPU *cpu;
@@ -1023,19 +2855,40 @@ APEX_cpu_init(const char *filename)
         return NULL;
     }
 
-    cpu->fetch.stall = 0;
-    cpu->decode.stall = 0;
-    cpu->execute.stall = 0;
-    cpu->memory.stall = 0;
-    cpu->writeback.stall = 0;
-
-    printf("Fetch stage stall flag before fetch: %d\n", cpu->fetch.stall);
+    if (config)
+    {
+        cpu->config = *config;
+    }
+    else
+    {
+        APEX_config_defaults(&cpu->config);
+    }
 
     /* Initialize PC, Registers and all pipeline stages */
-    cpu->pc = 4000;
+    cpu->pc = CODE_START_PC;
     memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
     memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
-    cpu->single_step = ENABLE_SINGLE_STEP;
+    cpu->single_step = cpu->config.single_step;
+    cpu->debug_messages = cpu->config.debug_messages;
+    initialize_BTB(cpu);
+    APEX_prefetch_init(&cpu->prefetcher);
+    APEX_icache_init(&cpu->icache);
+    APEX_lvp_init(&cpu->lvp);
+    cpu->fetch_ready_cycle = -1;
+
+    /* The pipeline starts out filled with fetch bubbles */
+    cpu->decode.bubble_pc = cpu->execute.bubble_pc = cpu->pc;
+    cpu->memory.bubble_pc = cpu->writeback.bubble_pc = cpu->pc;
+    cpu->decode.bubble_reason = cpu->execute.bubble_reason = CYCLE_FETCH;
+    cpu->memory.bubble_reason = cpu->writeback.bubble_reason = CYCLE_FETCH;
+    for (i = 0; i < MAX_SUB_STAGES - 1; ++i)
+    {
+        cpu->fetch_pipe[i].bubble_pc = cpu->execute_pipe[i].bubble_pc = cpu->pc;
+        cpu->memory_pipe[i].bubble_pc = cpu->pc;
+        cpu->fetch_pipe[i].bubble_reason = CYCLE_FETCH;
+        cpu->execute_pipe[i].bubble_reason = CYCLE_FETCH;
+        cpu->memory_pipe[i].bubble_reason = CYCLE_FETCH;
+    }
 
     /* Parse input file and create code memory */
     cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
@@ -1045,7 +2898,7 @@ APEX_cpu_init(const char *filename)
         return NULL;
     }
 
-    if (ENABLE_DEBUG_MESSAGES)
+    if (cpu->debug_messages)
     {
         fprintf(stderr,
                 "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
@@ -1063,139 +2916,553 @@ APEX_cpu_init(const char *filename)
         }
     }
 
+    if (cpu->config.cosim)
+    {
+        cpu->golden = APEX_golden_create(cpu);
+        if (!cpu->golden)
+        {
+            free(cpu->code_memory);
+            free(cpu);
+            return NULL;
+        }
+    }
+
     /* To start fetch stage */
     cpu->fetch.has_insn = TRUE;
     return cpu;
 }
+#endif
+
+/*
+ * Checks the sources of the instruction in decode, both halves of a fused
+ * pair, against older in-flight instructions and stalls decode, and fetch
+ * behind it, on a RAW hazard that forwarding cannot cover.
+ */
+void
+detect_data_hazards(APEX_CPU *cpu)
+{
+    cpu->decode.stall = FALSE;
 
+    if (cpu->decode.has_insn)
+    {
+        cpu->decode.stall
+            = !operands_ready(cpu, LATCH_INSN(cpu, decode))
+              || (LATCH_FUSED(cpu, &cpu->decode)
+                  && !operands_ready(cpu, FUSED_TAIL(cpu, decode)));
+    }
 
+    cpu->fetch.stall = cpu->decode.stall;
+}
 
-void detect_data_hazards(APEX_CPU *cpu) {
-    // Check if both stages have valid instructions
-    if (cpu->execute.has_insn && cpu->decode.has_insn) {
-
-        // Check if the execute stage instruction writes to a register
-        if (cpu->execute.opcode == OPCODE_ADD  ||
-            cpu->execute.opcode == OPCODE_SUB  ||
-            cpu->execute.opcode == OPCODE_MUL  ||
-            cpu->execute.opcode == OPCODE_AND  ||
-            cpu->execute.opcode == OPCODE_OR   ||
-            cpu->execute.opcode == OPCODE_XOR  ||
-            cpu->execute.opcode == OPCODE_MOVC ||
-            cpu->execute.opcode == OPCODE_ADDL ||
-            cpu->execute.opcode == OPCODE_SUBL ) 
-        {
-            int execute_dest_reg = cpu->execute.rd;
-            printf("rs1 %d\n", cpu->decode.rs1);
-            printf("rs2 %d\n", cpu->decode.rs2);
-            printf("rd %d\n", cpu->decode.rd);
-
-            // Check if the execute stage instruction's destination register is non-zero
-            // and if the decode stage instruction uses the same register as a source
-            if (execute_dest_reg != 0 &&
-                (cpu->decode.rs1 == execute_dest_reg || cpu->decode.rs2 == execute_dest_reg)) {
-                // RAW hazard detected, stall the pipeline
-                cpu->decode.stall = 1;
-                cpu->fetch.stall = 1;
-            } else {
-                // No hazard, clear stall flags
-                cpu->decode.stall = 0;
-                cpu->fetch.stall = 0;
-                APEX_fetch(cpu);
-            }
-        } else {
-            // No hazard, clear stall flags
-            cpu->decode.stall = 0;
-            cpu->fetch.stall = 0;
+/*
+ * Simulates one clock cycle. Returns TRUE once HALT has retired, after which
+ * further calls do nothing.
+ */
+int
+APEX_cpu_step(APEX_CPU *cpu)
+{
+    if (cpu->halted || cpu->failed)
+    {
+        return TRUE;
+    }
+
+    if (cpu->recorder)
+    {
+        APEX_recorder_cycle(cpu->recorder, cpu);
+    }
+
+    if (CFG_PROBES && cpu->debug_messages)
+    {
+        printf("--------------------------------------------\n");
+        printf("Clock Cycle #: %d\n", cpu->clock);
+        printf("--------------------------------------------\n");
+    }
+
+    if (CFG_PROBES && cpu->trace)
+    {
+        APEX_trace_cycle(cpu->trace, cpu->clock);
+    }
+
+    if (APEX_writeback(cpu))
+    {
+        /* Halt in writeback stage */
+        cpu->clock++;
+        cpu->halted = TRUE;
+        if (cpu->diverged)
+        {
+            printf("APEX_CPU: Simulation Stopped on co-simulation divergence, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+        }
+        else
+        {
+            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
         }
+        return TRUE;
+    }
+
+    /* Sub-stages in front of a stage move on once it has run */
+    APEX_memory(cpu);
+    if (cpu->failed)
+    {
+        cpu->clock++;
+        printf("APEX_CPU: Simulation Stopped on a data memory fault, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+        return TRUE;
+    }
+    if (advance_sub_stages(cpu->memory_pipe, CFG_MEMORY_STAGES(cpu) - 1,
+                           &cpu->memory))
+    {
+        start_memory_access(cpu, MEMORY_INSN(cpu, &cpu->memory));
+    }
+
+    APEX_execute(cpu);
+    advance_sub_stages(cpu->execute_pipe, CFG_EXECUTE_STAGES(cpu) - 1,
+                       &cpu->execute);
+
+    APEX_decode(cpu);
+    advance_sub_stages(cpu->fetch_pipe, CFG_FETCH_STAGES(cpu) - 1,
+                       &cpu->decode);
+
+    APEX_fetch(cpu);
+
+    if (CFG_PROBES && cpu->debug_messages)
+    {
+        print_reg_file(cpu);
+    }
+
+    cpu->clock++;
+    if (CFG_PROBES && cpu->interval)
+    {
+        APEX_interval_tick(cpu->interval, cpu);
+    }
+    return FALSE;
+}
+
+#ifdef APEX_VARIANT
+/* Whether cpu runs with the parameters this variant fixes, and without the
+ * probes it may have compiled out */
+static int
+variant_matches(const APEX_CPU *cpu)
+{
+#ifdef FIXED_predictor
+    if (cpu->config.predictor != FIXED_predictor)
+    {
+        return FALSE;
+    }
+#endif
+#ifdef FIXED_forwarding
+    if (cpu->config.forwarding != FIXED_forwarding)
+    {
+        return FALSE;
+    }
+#endif
+#ifdef FIXED_store_buffer
+    if (cpu->config.store_buffer != FIXED_store_buffer)
+    {
+        return FALSE;
+    }
+#endif
+#ifdef FIXED_prefetcher
+    if (cpu->config.prefetcher != FIXED_prefetcher)
+    {
+        return FALSE;
     }
+#endif
+#ifdef FIXED_icache_sets
+    if (cpu->config.icache_sets != FIXED_icache_sets)
+    {
+        return FALSE;
+    }
+#endif
+#ifdef FIXED_fetch_queue
+    if (cpu->config.fetch_queue != FIXED_fetch_queue)
+    {
+        return FALSE;
+    }
+#endif
+#ifdef FIXED_loop_buffer
+    if (cpu->config.loop_buffer != FIXED_loop_buffer)
+    {
+        return FALSE;
+    }
+#endif
+#ifdef FIXED_fetch_stages
+    if (cpu->config.fetch_stages != FIXED_fetch_stages)
+    {
+        return FALSE;
+    }
+#endif
+#ifdef FIXED_execute_stages
+    if (cpu->config.execute_stages != FIXED_execute_stages)
+    {
+        return FALSE;
+    }
+#endif
+#ifdef FIXED_memory_stages
+    if (cpu->config.memory_stages != FIXED_memory_stages)
+    {
+        return FALSE;
+    }
+#endif
+#ifdef FIXED_value_predictor
+    if (cpu->config.value_predictor != FIXED_value_predictor)
+    {
+        return FALSE;
+    }
+#endif
+#ifdef FIXED_branch_stage
+    if (cpu->config.branch_stage != FIXED_branch_stage)
+    {
+        return FALSE;
+    }
+#endif
+#ifdef FIXED_fusion
+    if (cpu->config.fusion != FIXED_fusion)
+    {
+        return FALSE;
+    }
+#endif
+    if (!CFG_PROBES
+        && (cpu->debug_messages || cpu->trace || cpu->profile
+            || cpu->interval || cpu->golden || cpu->warm))
+    {
+        return FALSE;
+    }
+    return TRUE;
 }
 
+const APEX_Variant VARIANT_NAME(APEX_variant, APEX_VARIANT) = {
+    VARIANT_STRING(APEX_VARIANT), variant_matches, APEX_cpu_step};
+#else
+/* The variants the Makefile built from apex_variants.cfg, first match wins */
+#define VARIANT(name) extern const APEX_Variant APEX_variant_##name;
+#include "apex_variants.h"
+#undef VARIANT
 
+static const APEX_Variant *const variants[] = {
+#define VARIANT(name) &APEX_variant_##name,
+#include "apex_variants.h"
+#undef VARIANT
+    NULL};
 
 /*
- * APEX CPU simulation loop
+ * APEX CPU simulation loop, runs to HALT, the cycle limit or a failure; the
+ * watchdog stops a run that has not retired anything for a while. A program
+ * looping forever still retires, so only the cycle limit ends it.
+ * Interactive control lives in the debugger, see apex_debug.c. The cycle
+ * loop is picked once, the first specialised variant that matches the
+ * configuration or else the generic APEX_cpu_step().
  *
  * Note: You are free to edit this function according to your implementation
  */
 void
 APEX_cpu_run(APEX_CPU *cpu)
 {
-    char user_prompt_val;
+    int (*step)(APEX_CPU *cpu) = APEX_cpu_step;
+    int retired = cpu->insn_completed, progress = cpu->clock;
+    int i;
 
-    while (TRUE)
+    cpu->variant = NULL;
+    for (i = 0; cpu->config.variants && variants[i]; ++i)
     {
+        if (variants[i]->matches(cpu))
+        {
+            cpu->variant = variants[i]->name;
+            step = variants[i]->step;
+            break;
+        }
+    }
 
-
-       
-        if (ENABLE_DEBUG_MESSAGES)
+    while (!step(cpu))
+    {
+        if (cpu->config.max_cycles && cpu->clock >= cpu->config.max_cycles)
         {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cpu->clock);
-            printf("--------------------------------------------\n");
+            printf("APEX_CPU: Simulation Stopped at cycle limit, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            break;
         }
 
-        if (APEX_writeback(cpu))
+        /* Watchdog: a pipeline that stopped retiring is hung */
+        if (cpu->insn_completed != retired)
         {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            retired = cpu->insn_completed;
+            progress = cpu->clock;
+        }
+        else if (cpu->config.watchdog
+                 && cpu->clock - progress >= cpu->config.watchdog)
+        {
+            cpu->failed = FAIL_WATCHDOG;
+            printf("APEX_CPU: Simulation Stopped by the watchdog, nothing retired in %d cycles, cycles = %d instructions = %d\n", cpu->config.watchdog, cpu->clock, cpu->insn_completed);
             break;
         }
+    }
+}
+
+/* Prints the instruction latch holds, both halves of a fused pair */
+static void
+print_latch_content(const APEX_CPU *cpu, const char *label,
+                    const CPU_Latch *latch)
+{
+    print_stage_content(label, &cpu->insns[latch->insn]);
+    if (latch->fused)
+    {
+        print_stage_content(label, &cpu->insns[latch->tail]);
+    }
+}
 
-        // APEX_memory(cpu);
-        // APEX_execute(cpu);
-        // APEX_decode(cpu);
-        // APEX_fetch(cpu);
+/* Prints the extra sub-stages of a split stage, numbered from first */
+static void
+print_sub_stages(const APEX_CPU *cpu, const char *name, const CPU_Latch *pipe,
+                 int stages, int first)
+{
+    char label[32];
+    int i;
 
-        if (!cpu->memory.stall) {
-        APEX_memory(cpu);
-        }else {
-            // Check if the stall condition is resolved
-            detect_data_hazards(cpu);
+    for (i = 0; i < stages - 1; ++i)
+    {
+        snprintf(label, sizeof(label), "%s %d", name, first + i);
+        if (pipe[i].has_insn)
+        {
+            print_latch_content(cpu, label, &pipe[i]);
+        }
+        else
+        {
+            printf("%-15s: empty\n", label);
         }
+    }
+}
+
+/* Prints every pipeline latch, the flags and the register file */
+void
+APEX_cpu_print_state(const APEX_CPU *cpu)
+{
+    static const char *names[] = {"Fetch", "Decode/RF", "Execute", "Memory",
+                                  "Writeback"};
+    const CPU_Latch *stages[] = {&cpu->fetch, &cpu->decode, &cpu->execute,
+                                 &cpu->memory, &cpu->writeback};
+    const int sub_stages[] = {cpu->config.fetch_stages, 1,
+                              cpu->config.execute_stages,
+                              cpu->config.memory_stages, 1};
+    const Store_Buffer_Entry *e;
+    char label[32];
+    int i;
 
-        // Execute Stage
-        if (!cpu->execute.stall) {
-            APEX_execute(cpu);
-        }else {
-            // Check if the stall condition is resolved
-            detect_data_hazards(cpu);
+    printf("----------\nCycle %d, pc(%d), %d retired, flags Z=%d P=%d N=%d\n"
+           "----------\n",
+           cpu->clock, cpu->pc, cpu->insn_completed, cpu->zero_flag,
+           cpu->pos_flag, cpu->neg_flag);
+
+    for (i = 0; i < 5; ++i)
+    {
+        if (i == 2)
+        {
+            print_sub_stages(cpu, "Execute", cpu->execute_pipe,
+                             cpu->config.execute_stages, 1);
+        }
+        else if (i == 3)
+        {
+            print_sub_stages(cpu, "Memory", cpu->memory_pipe,
+                             cpu->config.memory_stages, 1);
         }
 
-        // Decode Stage
-        if (!cpu->decode.stall) {
-            APEX_decode(cpu);
-        } else {
-            // Check if the stall condition is resolved
-            detect_data_hazards(cpu);
+        /* A split stage numbers its sub-stages; fetch works in its first,
+         * execute and memory in their last */
+        snprintf(label, sizeof(label), "%s", names[i]);
+        if (sub_stages[i] > 1)
+        {
+            snprintf(label, sizeof(label), "%s %d", names[i],
+                     i == 0 ? 1 : sub_stages[i]);
         }
 
-        // Fetch Stage
-        if (!cpu->fetch.stall) {
-            APEX_fetch(cpu);
-        }else {
-            // Check if the stall condition is resolved
-            detect_data_hazards(cpu);
+        /* The fetch latch keeps the last fetched instruction */
+        if (i == 0 ? cpu->fetch_seq == 0 : !stages[i]->has_insn)
+        {
+            printf("%-15s: empty\n", label);
+        }
+        else
+        {
+            print_latch_content(cpu, label, stages[i]);
         }
 
-        // Detect hazards before running the stages
-        detect_data_hazards(cpu);
+        if (i == 0)
+        {
+            print_sub_stages(cpu, "Fetch", cpu->fetch_pipe,
+                             cpu->config.fetch_stages, 2);
+        }
+    }
 
-        print_reg_file(cpu);
+    print_reg_file(cpu);
+    print_vector_reg_file(cpu);
 
-        if (cpu->single_step)
+    if (cpu->sb_count)
+    {
+        printf("Store buffer (oldest first):");
+        for (i = 0; i < cpu->sb_count; ++i)
         {
-            printf("Press any key to advance CPU Clock or <q> to quit:\n");
-            scanf("%c", &user_prompt_val);
+            e = &cpu->store_buffer[(cpu->sb_head + i) % MAX_STORE_BUFFER_SIZE];
+            printf(" M[%d]=%d", e->address, e->value);
+        }
+        printf("\n");
+    }
 
-            if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
-            {
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                break;
-            }
+    if (cpu->loop_buffer.active)
+    {
+        printf("Loop buffer: streaming pc(%d)..pc(%d)\n",
+               cpu->loop_buffer.start, cpu->loop_buffer.end);
+    }
+
+    if (cpu->ftq_count || cpu->fq_count)
+    {
+        printf("Fetch targets:");
+        for (i = 0; i < cpu->ftq_count; ++i)
+        {
+            printf(" pc(%d)",
+                   cpu->ftq[(cpu->ftq_head + i) % MAX_FETCH_QUEUE_SIZE].pc);
+        }
+        printf("\nFetch queue:  ");
+        for (i = 0; i < cpu->fq_count; ++i)
+        {
+            printf(" pc(%d)",
+                   cpu->fetch_queue[(cpu->fq_head + i) % FETCH_QUEUE_RING].pc);
         }
+        printf("\n");
+    }
+}
 
-        cpu->clock++;
+/* Prints the event counters and the derived rates of a finished run */
+void
+APEX_cpu_print_stats(const APEX_CPU *cpu, FILE *fp)
+{
+    const APEX_Stats *s = &cpu->stats;
+    unsigned long long fused;
+
+    fprintf(fp, "----------\n%s\n----------\n", "Statistics:");
+    fprintf(fp, "cycles            %d\n", cpu->clock);
+    fprintf(fp, "instructions      %d\n", cpu->insn_completed);
+    fprintf(fp, "cpi               %.3f\n",
+            cpu->insn_completed ? (double)cpu->clock / cpu->insn_completed : 0.0);
+    fprintf(fp, "branches          %llu (taken %llu)\n", s->branches, s->taken);
+    fprintf(fp, "mispredicts       %llu (%.2f%%)\n", s->mispredicts,
+            s->branches ? 100.0 * s->mispredicts / s->branches : 0.0);
+    fprintf(fp, "jumps             %llu\n", s->jumps);
+    fprintf(fp, "squashed          %llu\n", s->squashed);
+    fprintf(fp, "raw_stalls        %llu\n", s->raw_stalls);
+    fprintf(fp, "exec_stalls       %llu\n", s->exec_stalls);
+    fprintf(fp, "mem_stalls        %llu\n", s->mem_stalls);
+    fprintf(fp, "flush_bubbles     %llu\n", s->flush_bubbles);
+    if (cpu->config.fetch_stages > 1 || cpu->config.execute_stages > 1
+        || cpu->config.memory_stages > 1)
+    {
+        fprintf(fp, "sub_stages        fetch %d, execute %d, memory %d\n",
+                cpu->config.fetch_stages, cpu->config.execute_stages,
+                cpu->config.memory_stages);
+    }
+    if (cpu->variant)
+    {
+        fprintf(fp, "variant           %s\n", cpu->variant);
+    }
+
+    if (cpu->config.store_buffer)
+    {
+        fprintf(fp, "sb_forwards       %llu\n", s->sb_forwards);
+        fprintf(fp, "sb_stalls         %llu\n", s->sb_stalls);
+        fprintf(fp, "sb_occupancy      %.3f avg, %llu max\n",
+                cpu->clock ? (double)s->sb_occupancy / cpu->clock : 0.0,
+                s->sb_max);
+    }
+
+    if (cpu->config.prefetcher != PREFETCH_NONE)
+    {
+        fprintf(fp, "pf_issued         %llu\n", s->pf_issued);
+        fprintf(fp, "pf_useful         %llu (accuracy %.2f%%)\n", s->pf_useful,
+                s->pf_issued ? 100.0 * s->pf_useful / s->pf_issued : 0.0);
+        fprintf(fp, "pf_coverage       %.2f%% of %llu loads\n",
+                s->pf_useful + s->pf_misses
+                    ? 100.0 * s->pf_useful / (s->pf_useful + s->pf_misses)
+                    : 0.0,
+                s->pf_useful + s->pf_misses);
+        fprintf(fp, "pf_late           %llu (timely %.2f%%)\n", s->pf_late,
+                s->pf_useful
+                    ? 100.0 * (s->pf_useful - s->pf_late) / s->pf_useful
+                    : 0.0);
+        fprintf(fp, "pf_cycles_saved   %llu\n", s->pf_cycles_saved);
+    }
+
+    if (cpu->config.icache_sets)
+    {
+        fprintf(fp, "ic_accesses       %llu\n", s->ic_accesses);
+        fprintf(fp, "ic_misses         %llu (%.2f%%)\n", s->ic_misses,
+                s->ic_accesses ? 100.0 * s->ic_misses / s->ic_accesses : 0.0);
+        fprintf(fp, "ic_prefetches     %llu\n", s->ic_prefetches);
+        fprintf(fp, "ic_stalls         %llu\n", s->ic_stalls);
+    }
+
+    if (cpu->config.icache_sets || cpu->config.fetch_queue)
+    {
+        fprintf(fp, "fetch_bubbles     %llu\n", s->fetch_bubbles);
+        fprintf(fp, "fq_full           %llu\n", s->fq_full);
+        fprintf(fp, "fq_occupancy      %.3f avg, %llu max\n",
+                cpu->clock ? (double)s->fq_occupancy / cpu->clock : 0.0,
+                s->fq_max);
+        fprintf(fp, "ftq_occupancy     %.3f avg\n",
+                cpu->clock ? (double)s->ftq_occupancy / cpu->clock : 0.0);
+    }
+
+    if (cpu->config.loop_buffer)
+    {
+        fprintf(fp, "lsd_loops         %llu\n", s->lsd_loops);
+        fprintf(fp, "lsd_replays       %llu (%.2f%% of fetched)\n",
+                s->lsd_replays,
+                cpu->fetch_seq ? 100.0 * s->lsd_replays / cpu->fetch_seq : 0.0);
+    }
+
+    if (cpu->config.value_predictor != LVP_NONE)
+    {
+        fprintf(fp, "lvp_predicted     %llu (coverage %.2f%% of %llu loads)\n",
+                s->lvp_predicted,
+                s->lvp_loads ? 100.0 * s->lvp_predicted / s->lvp_loads : 0.0,
+                s->lvp_loads);
+        fprintf(fp, "lvp_correct       %llu (accuracy %.2f%%)\n",
+                s->lvp_correct,
+                s->lvp_predicted
+                    ? 100.0 * s->lvp_correct / s->lvp_predicted
+                    : 0.0);
+        fprintf(fp, "lvp_replays       %llu\n", s->lvp_replays);
+        fprintf(fp, "lvp_net_cycles    %lld (saved %llu, lost %llu)\n",
+                (long long)s->lvp_cycles_saved - (long long)s->lvp_cycles_lost,
+                s->lvp_cycles_saved, s->lvp_cycles_lost);
+    }
+
+    if (cpu->config.branch_stage == BRANCH_DECODE)
+    {
+        fprintf(fp, "early_branches    %llu (%.2f%% of branches)\n",
+                s->early_branches,
+                s->branches ? 100.0 * s->early_branches / s->branches : 0.0);
+        fprintf(fp, "early_saved       %llu cycles on %llu mispredicts\n",
+                s->early_cycles_saved, s->early_mispredicts);
+    }
+
+    if (cpu->config.fusion != FUSE_NONE)
+    {
+        fused = s->fused_cmp_branch + s->fused_movc_add + s->fused_addl_load;
+        fprintf(fp,
+                "fused_pairs       %llu (covering %.2f%% of instructions)\n",
+                fused,
+                cpu->insn_completed ? 200.0 * fused / cpu->insn_completed
+                                    : 0.0);
+        fprintf(fp, "fused_by_idiom    cmp_branch %llu, movc_add %llu, "
+                    "addl_load %llu\n",
+                s->fused_cmp_branch, s->fused_movc_add, s->fused_addl_load);
+    }
+}
+
+/* Replaces data memory with image, before the first cycle. The golden model
+ * starts from the same image */
+void
+APEX_cpu_set_data_memory(APEX_CPU *cpu, const int *image)
+{
+    memcpy(cpu->data_memory, image, sizeof(cpu->data_memory));
+    if (cpu->golden)
+    {
+        memcpy(cpu->golden->data_memory, image,
+               sizeof(cpu->golden->data_memory));
     }
 }
 
@@ -1207,6 +3474,13 @@ APEX_cpu_run(APEX_CPU *cpu)
 void
 APEX_cpu_stop(APEX_CPU *cpu)
 {
+    APEX_profile_free(cpu->profile);
+    APEX_trace_close(cpu->trace);
+    APEX_interval_close(cpu->interval, cpu);
+    APEX_golden_free(cpu->golden);
+    APEX_warm_free(cpu->warm);
+    APEX_recorder_free(cpu->recorder);
     free(cpu->code_memory);
     free(cpu);
-}
\ No newline at end of file
+}
+#endif
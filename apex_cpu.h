@@ -9,9 +9,9 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
-#include "apex_macros.h"
-
+#include <stdio.h>
 
+#include "apex_macros.h"
 
 /* Format of an APEX instruction  */
 typedef struct APEX_Instruction
@@ -25,29 +25,71 @@ typedef struct APEX_Instruction
     int is_lit;    //flag to identify if the operand is literal or not
     int is_store;  // flag to show store command
     int stall;
+    int line;      /* Source line number in the input file */
 } APEX_Instruction;
 
-/* Model of CPU stage latch */
+/* An instruction in flight, from fetch until it retires: one slot of the
+ * APEX_CPU insns ring, which latches name by index. The loop buffer keeps
+ * fetched copies to replay */
 typedef struct CPU_Stage
 {
     int pc;
-    char opcode_str[128];
     int opcode;
     int rs1;
     int rs2;
     int rd;
     int imm;
-    int is_lit;
     int rs1_value;
     int rs2_value;
-    int rd_value;
     int result_buffer;
     int memory_address;
+    int rs1_new_value;   /* Post-incremented base register of LOADP/STOREP */
+    int predicted_taken; /* Fetch followed the BTB to the branch target */
+    int cycles_left;     /* Cycles until a multi-cycle unit completes */
+    int seq;             /* Fetch order, names the instruction in traces */
+    const char *opcode_str;         /* Mnemonic, points into code memory */
+    int value_predicted; /* Dependents may take predicted_value until the
+                            load completes in memory */
+    int predicted_value; /* Value predictor's guess, confident or not */
+    int lvp_first_use;   /* Cycle the first dependent took predicted_value,
+                            -1 for none */
+    int lvp_flags;       /* Flags as the load left execute, for a replay */
+    int resolved_early;  /* A conditional branch resolved in decode */
+    int redirect_cycle;  /* Cycle it redirected fetch from there, -1 if it
+                            did not */
+} CPU_Stage;
+
+/* Vector lanes of the record in the same insns slot, kept apart from
+ * CPU_Stage, which scalar instructions would otherwise carry them in */
+typedef struct CPU_Lanes
+{
+    int vresult[MAX_VECTOR_LENGTH]; /* Vector result, or the lanes VSTORE writes */
+    int vs1_value[MAX_VECTOR_LENGTH]; /* Vector operands read in decode */
+    int vs2_value[MAX_VECTOR_LENGTH];
+} CPU_Lanes;
+
+/* Model of CPU stage latch */
+typedef struct CPU_Latch
+{
     int has_insn;
-    int data_of_store;
     int stall;
-    int hazard_pres;
-} CPU_Stage;
+    int insn;            /* Slot in APEX_CPU insns of the instruction held */
+    int fused;           /* FUSE_* idiom of the pair insn heads, see
+                            apex_fusion.c; FUSE_NONE for none */
+    int tail;            /* Slot of the pair's second instruction */
+    int bubble_reason;   /* Empty latch: CYCLE_* class that caused the bubble */
+    int bubble_pc;       /* Empty latch: pc of the instruction responsible */
+} CPU_Latch;
+
+/* Instruction held by stage latch, one of fetch, decode, ... writeback */
+#define LATCH_INSN(cpu, latch) (&(cpu)->insns[(cpu)->latch.insn])
+
+/* Vector lanes of insn, a record in APEX_CPU insns */
+#define INSN_LANES(cpu, insn) (&(cpu)->lanes[(insn) - (cpu)->insns])
+
+/* Second instruction of the fused pair stage latch holds, NULL for none */
+#define LATCH_TAIL(cpu, latch) \
+    ((cpu)->latch.fused ? &(cpu)->insns[(cpu)->latch.tail] : NULL)
 
 typedef struct APEX_Reg_Status 
 {
@@ -63,6 +105,185 @@ typedef struct BTB_Entry {
     // Additional fields if necessary (e.g., for identifying the victim entry)
 } BTB_Entry;
 
+/* Store waiting in the store buffer to be written to data memory */
+typedef struct Store_Buffer_Entry
+{
+    int address;
+    int value;
+} Store_Buffer_Entry;
+
+/* Prefetched word, address -1 when the slot is free */
+typedef struct Prefetch_Entry
+{
+    int address;
+    int ready_cycle;    /* Cycle the word arrives from memory */
+} Prefetch_Entry;
+
+/* Reference prediction table entry of the stride prefetcher */
+typedef struct RPT_Entry
+{
+    int pc;             /* -1 when free */
+    int last_address;
+    int stride;
+    int confidence;     /* 0..3, prefetches from 2 on */
+} RPT_Entry;
+
+typedef struct Stream_Entry
+{
+    int valid;
+    int last_address;   /* Last word of the stream that was accessed */
+    int direction;      /* +4 or -4 */
+    int last_use;       /* For LRU replacement */
+} Stream_Entry;
+
+typedef struct APEX_Prefetcher
+{
+    Prefetch_Entry buffer[PREFETCH_BUFFER_SIZE];
+    int victim;         /* Next buffer slot to replace (FIFO) */
+    RPT_Entry rpt[RPT_SIZE];
+    Stream_Entry streams[PREFETCH_STREAMS];
+    int stream_uses;
+    int last_miss;      /* Address of the last demand miss */
+} APEX_Prefetcher;
+
+/* I-cache line tag, tag -1 when invalid */
+typedef struct ICache_Line
+{
+    int tag;            /* Line number, code memory index / line size */
+    int ready_cycle;    /* Cycle the line arrives from memory */
+    int last_use;       /* For LRU replacement */
+} ICache_Line;
+
+typedef struct APEX_ICache
+{
+    ICache_Line lines[MAX_ICACHE_SETS * MAX_ICACHE_WAYS]; /* Set major */
+    int uses;
+} APEX_ICache;
+
+/* Load value predictor entry, indexed by load pc */
+typedef struct LVP_Entry
+{
+    int pc;             /* -1 when free */
+    int last_value;
+    int stride;         /* Difference between the last two values */
+    int confidence;     /* Correct guesses in a row, see LVP_CONFIDENCE_MAX */
+} LVP_Entry;
+
+typedef struct APEX_Value_Predictor
+{
+    LVP_Entry table[MAX_LVP_SIZE];
+    int replay_cycle;   /* Cycle of the last replay until decode gets an
+                           instruction again, -1 otherwise */
+} APEX_Value_Predictor;
+
+/* Fetch target queue and fetch queue entry */
+typedef struct Fetch_Entry
+{
+    int pc;
+    int predicted_taken; /* The predictor followed the BTB past this branch */
+} Fetch_Entry;
+
+/* Loop stream detector: the last short backward loop seen and, once it
+ * streams, its instructions ready to go to decode */
+typedef struct APEX_Loop_Buffer
+{
+    int start;          /* pc of the first instruction of the loop */
+    int end;            /* pc of its backward branch */
+    int iterations;     /* Back-to-back taken back-edges seen */
+    int active;         /* Fetch replays the loop from insns */
+    CPU_Stage insns[MAX_LOOP_BUFFER_SIZE];
+} APEX_Loop_Buffer;
+
+/* Run time micro-architecture configuration, see apex_config.c */
+typedef struct APEX_Config
+{
+    int btb_size;       /* BTB entries in use, at most MAX_BTB_SIZE */
+    int predictor;      /* One of PREDICTOR_* */
+    int forwarding;     /* Forward EX/MEM results into decode */
+    int mul_latency;    /* Cycles MUL/DIV occupy execute */
+    int mem_latency;    /* Cycles LOAD/STORE occupy memory */
+    int vector_length;  /* Vector lanes in use, at most MAX_VECTOR_LENGTH */
+    int vector_latency; /* Cycles VADD/VMUL/VRED occupy execute */
+    int store_buffer;   /* Store buffer entries, 0 for none */
+    int prefetcher;     /* One of PREFETCH_* */
+    int prefetch_degree;   /* Words prefetched per trigger */
+    int prefetch_distance; /* Strides ahead of the triggering access */
+    int icache_sets;    /* I-cache sets, 0 for a perfect I-cache */
+    int icache_ways;
+    int icache_line;    /* Instructions per I-cache line */
+    int icache_latency; /* Cycles an I-cache miss takes */
+    int fetch_queue;    /* Fetch queue entries, 0 for none */
+    int ftq_size;       /* Fetch target queue entries */
+    int loop_buffer;    /* Loop buffer entries, 0 for none */
+    int fetch_stages;   /* Sub-stages of fetch, execute and memory, */
+    int execute_stages; /* at most MAX_SUB_STAGES each */
+    int memory_stages;
+    int value_predictor; /* One of LVP_* */
+    int lvp_size;       /* Value predictor entries */
+    int lvp_confidence; /* Correct guesses in a row before predicting */
+    int branch_stage;   /* One of BRANCH_* */
+    int fusion;         /* FUSE_* idioms fused into one micro-op */
+    int max_cycles;     /* Stop after this many cycles, 0 for no limit */
+    int debug_messages; /* Print stage contents every cycle */
+    int single_step;    /* Start in the interactive debugger */
+    int snapshot_interval; /* Debugger: cycles between snapshots, 0 for none */
+    int history_mb;     /* Debugger: memory bound of the snapshots in MiB */
+    int cosim;          /* Check retirements against the golden model */
+    int watchdog;       /* Cycles without a retirement before the run is
+                           stopped as hung, 0 for never */
+    int variants;       /* Run a matching specialised variant */
+} APEX_Config;
+
+/* Event counters collected during a run */
+typedef struct APEX_Stats
+{
+    unsigned long long branches;      /* Conditional branches executed */
+    unsigned long long taken;         /* ... of which were taken */
+    unsigned long long mispredicts;   /* Branch direction/target mispredicts */
+    unsigned long long jumps;         /* JUMP/JALR redirects */
+    unsigned long long squashed;      /* Wrong-path instructions flushed */
+    unsigned long long raw_stalls;    /* Cycles decode waited on a RAW hazard */
+    unsigned long long exec_stalls;   /* Extra cycles spent in a multi-cycle EX */
+    unsigned long long mem_stalls;    /* Extra cycles spent in a multi-cycle MEM */
+    unsigned long long flush_bubbles; /* Cycles fetch idled after a redirect */
+    unsigned long long sb_forwards;   /* Loads served by the store buffer */
+    unsigned long long sb_stalls;     /* Cycles memory waited on the store buffer */
+    unsigned long long sb_occupancy;  /* Sum of buffered stores over all cycles */
+    unsigned long long sb_max;        /* Most stores buffered at once */
+    unsigned long long pf_issued;     /* Prefetches sent to memory */
+    unsigned long long pf_useful;     /* ... later hit by a demand load */
+    unsigned long long pf_late;       /* ... of which were still in flight */
+    unsigned long long pf_misses;     /* Demand loads no prefetch covered */
+    unsigned long long pf_cycles_saved; /* Memory cycles hits did not wait */
+    unsigned long long ic_accesses;   /* Instructions read from the I-cache */
+    unsigned long long ic_misses;     /* ... that missed */
+    unsigned long long ic_prefetches; /* Lines filled ahead of fetch */
+    unsigned long long ic_stalls;     /* Cycles fetch waited on a miss */
+    unsigned long long fetch_bubbles; /* Cycles the front end left decode empty */
+    unsigned long long fq_full;       /* Cycles the fetch queue was full */
+    unsigned long long fq_occupancy;  /* Sum of queued instructions over all cycles */
+    unsigned long long fq_max;        /* Most instructions queued at once */
+    unsigned long long ftq_occupancy; /* Sum of queued fetch targets */
+    unsigned long long lsd_loops;     /* Loops that started streaming */
+    unsigned long long lsd_replays;   /* Instructions fetched from the loop buffer */
+    unsigned long long lvp_loads;     /* Loads the value predictor saw */
+    unsigned long long lvp_predicted; /* ... whose value it predicted */
+    unsigned long long lvp_correct;   /* ... correctly */
+    unsigned long long lvp_replays;   /* Wrong predictions dependents took */
+    unsigned long long lvp_cycles_saved; /* Decode cycles correct predictions
+                                            did not wait */
+    unsigned long long lvp_cycles_lost;  /* Decode cycles replays waited for
+                                            the refetch */
+    unsigned long long early_branches;    /* Branches resolved in decode */
+    unsigned long long early_mispredicts; /* ... that mispredicted */
+    unsigned long long early_cycles_saved; /* Cycles those redirects came
+                                              before execute would have
+                                              resolved them */
+    unsigned long long fused_cmp_branch; /* Fused pairs retired, by idiom */
+    unsigned long long fused_movc_add;
+    unsigned long long fused_addl_load;
+} APEX_Stats;
+
 
 /* Model of APEX CPU */
 typedef struct APEX_CPU
@@ -71,28 +292,99 @@ typedef struct APEX_CPU
     int clock;                     /* Clock cycles elapsed */
     int insn_completed;            /* Instructions retired */
     int regs[REG_FILE_SIZE];       /* Integer register file */
+    int vregs[VEC_REG_FILE_SIZE][MAX_VECTOR_LENGTH]; /* Vector register file */
     int code_memory_size;          /* Number of instruction in the input file */
     APEX_Reg_Status register_status[REG_FILE_SIZE]; // Status of registers
     APEX_Instruction *code_memory; /* Code Memory */
     int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
-    int single_step;               /* Wait for user input after every cycle */
+    int single_step;               /* Run under the interactive debugger */
     int zero_flag;                 /* {TRUE, FALSE} Used by BZ and BNZ to branch */
     int pos_flag;                  
     int neg_flag;
     int cc;                        
     int fetch_from_next_cycle;
+    int halted;                    /* HALT reached writeback */
+    int failed;                    /* FAIL_* that stopped the run */
+    int debug_messages;            /* Print stage contents every cycle */
+    int redirect_pc;               /* pc of the last instruction to redirect fetch */
+    struct APEX_Profile *profile;  /* Per-pc cycle accounting, NULL when off */
+    struct APEX_Trace *trace;      /* Pipeline viewer log, NULL when off */
+    struct APEX_Golden *golden;    /* Co-simulation model, NULL when off */
+    struct APEX_Interval *interval; /* Interval statistics, NULL when off */
+    struct APEX_Warm *warm;        /* Branch profile for the warm-start file,
+                                      NULL when off */
+    struct APEX_Recorder *recorder; /* Flight recorder, NULL when off */
+    int diverged;                  /* Pipeline and golden model disagreed */
+    int fetch_seq;                 /* Instructions fetched so far */
+    const char *variant;           /* Variant APEX_cpu_run picked, NULL for
+                                      the generic cycle loop */
+
+    APEX_Config config;            /* Micro-architecture parameters */
+    APEX_Stats stats;              /* Event counters */
+    BTB_Entry btb[MAX_BTB_SIZE];   /* Branch target buffer */
+    int btb_victim;                /* Next BTB entry to replace (FIFO) */
+    Store_Buffer_Entry store_buffer[MAX_STORE_BUFFER_SIZE]; /* Ring, oldest at sb_head */
+    int sb_head;
+    int sb_count;                  /* Stores buffered */
+    int sb_cycles_left;            /* Cycles until the oldest reaches memory */
+    APEX_Prefetcher prefetcher;    /* Data prefetcher, see apex_prefetch.c */
+    APEX_ICache icache;            /* See apex_icache.c */
+    APEX_Value_Predictor lvp;      /* See apex_lvp.c */
+    Fetch_Entry ftq[MAX_FETCH_QUEUE_SIZE]; /* Rings, oldest at the head */
+    int ftq_head;
+    int ftq_count;
+    Fetch_Entry fetch_queue[FETCH_QUEUE_RING];
+    int fq_head;
+    int fq_count;
+    int fetch_ready_cycle;         /* Cycle the FTQ head arrives from the
+                                      I-cache, -1 before it is looked up */
+    APEX_Loop_Buffer loop_buffer;  /* Loop stream detector */
+
+    /* Pipeline stages. Instructions stay in their insns slot from fetch to
+     * retirement, moving on to the next stage copies only the latch */
+    CPU_Stage insns[INSN_RING_SIZE];
+    CPU_Lanes lanes[INSN_RING_SIZE]; /* Vector lanes, by insns slot */
+    int next_insn;                 /* Where the search for a free slot starts */
+    CPU_Latch fetch;
+    CPU_Latch decode;
+    CPU_Latch execute;
+    CPU_Latch memory;
+    CPU_Latch writeback;
 
-    /* Pipeline stages */
-    CPU_Stage fetch;
-    CPU_Stage decode;
-    CPU_Stage execute;
-    CPU_Stage memory;
-    CPU_Stage writeback;
+    /* Sub-stages past the first, youngest first. Fetch works in its first
+     * sub-stage, whose latch is fetch, and fetch_pipe holds the rest. Execute
+     * and memory work in their last, execute_pipe and memory_pipe hold the
+     * ones before it */
+    CPU_Latch fetch_pipe[MAX_SUB_STAGES - 1];
+    CPU_Latch execute_pipe[MAX_SUB_STAGES - 1];
+    CPU_Latch memory_pipe[MAX_SUB_STAGES - 1];
 } APEX_CPU;
 
+/* A cycle loop specialised for the parameters it fixes, see apex_variants.cfg */
+typedef struct APEX_Variant
+{
+    const char *name;
+    int (*matches)(const APEX_CPU *cpu); /* Built for cpu's configuration */
+    int (*step)(APEX_CPU *cpu);          /* APEX_cpu_step() of the variant */
+} APEX_Variant;
+
 APEX_Instruction *create_code_memory(const char *filename, int *size);
-APEX_CPU *APEX_cpu_init(const char *filename);
+int load_data_image(const char *filename, int *data_memory);
+const char *APEX_opcode_name(int opcode);
+APEX_CPU *APEX_cpu_init(const char *filename, const APEX_Config *config);
+int APEX_cpu_step(APEX_CPU *cpu);
 void APEX_cpu_run(APEX_CPU *cpu);
+void APEX_cpu_print_state(const APEX_CPU *cpu);
+void APEX_cpu_print_stats(const APEX_CPU *cpu, FILE *fp);
 void APEX_cpu_stop(APEX_CPU *cpu);
+void APEX_cpu_set_data_memory(APEX_CPU *cpu, const int *image);
 void detect_data_hazards(APEX_CPU *cpu);
+void APEX_format_instruction(const CPU_Stage *stage, char *buf, int size);
+
+void APEX_config_defaults(APEX_Config *config);
+int APEX_config_set(APEX_Config *config, const char *key, const char *value);
+int APEX_config_parse(APEX_Config *config, const char *assignment);
+void APEX_config_format(const APEX_Config *config, const char *key, char *buf,
+                        int size);
+double APEX_config_cost(const APEX_Config *config);
 #endif
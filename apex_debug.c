@@ -0,0 +1,798 @@
+/*
+ * apex_debug.c
+ * Debugger console for the APEX cpu. Commands are read a line at a time and
+ * the simulator then runs headless until a stop condition fires, so reaching
+ * cycle 2,000,000 costs one command rather than two million keypresses.
+ *
+ * Stop conditions are reduced to cheap checks made after every cycle:
+ * breakpoints are a flag per code memory slot looked up only when fetch took
+ * a new instruction, watchpoints are a pointer into the register file or data
+ * memory plus the value last seen. State is printed only when a run stops.
+ *
+ * Reverse execution rebuilds earlier cycles from the snapshots kept in
+ * apex_history.c.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_debug.h"
+#include "apex_golden.h"
+
+#define MAX_ARGS 8
+
+typedef struct Debug_Command
+{
+    const char *name;
+    const char *alias;
+    int (*run)(APEX_Debugger *dbg, int argc, char **argv);
+    const char *usage;
+    const char *help;
+} Debug_Command;
+
+APEX_Debugger *
+APEX_debug_create(APEX_CPU *cpu)
+{
+    APEX_Debugger *dbg = calloc(1, sizeof(APEX_Debugger));
+
+    if (!dbg)
+    {
+        return NULL;
+    }
+
+    dbg->breakpoints = calloc(cpu->code_memory_size + 1, 1);
+    if (!dbg->breakpoints)
+    {
+        free(dbg);
+        return NULL;
+    }
+
+    dbg->cpu = cpu;
+    dbg->stop_cycle = -1;
+    dbg->last_seq = cpu->fetch_seq;
+    dbg->history = APEX_history_create(cpu->config.snapshot_interval,
+                                       cpu->config.history_mb);
+
+    /* Stage contents are printed when a run stops, not every cycle */
+    cpu->debug_messages = FALSE;
+    return dbg;
+}
+
+void
+APEX_debug_free(APEX_Debugger *dbg)
+{
+    if (dbg)
+    {
+        APEX_history_free(dbg->history);
+        free(dbg->breakpoints);
+        free(dbg);
+    }
+}
+
+/* Parses a whole decimal or 0x prefixed number, returns -1 on failure */
+static int
+parse_number(const char *text, int *value)
+{
+    char *end;
+    long v;
+
+    if (!text || !*text)
+    {
+        return -1;
+    }
+
+    v = strtol(text, &end, 0);
+    if (*end != '\0')
+    {
+        return -1;
+    }
+
+    *value = (int)v;
+    return 0;
+}
+
+/* Code memory index of the instruction at pc, -1 if there is none */
+static int
+code_index(const APEX_CPU *cpu, int pc)
+{
+    int index = PC_TO_CODE_INDEX(pc);
+
+    if (pc % 4 || index < 0 || index >= cpu->code_memory_size)
+    {
+        return -1;
+    }
+    return index;
+}
+
+/* pc of the instruction fetched last */
+static int
+fetched_pc(const APEX_CPU *cpu)
+{
+    return LATCH_INSN(cpu, fetch)->pc;
+}
+
+/*
+ * Resolves "R<n>", "M<addr>" or "M[<addr>]" to the watched location and its
+ * canonical name. Returns NULL on a bad target.
+ */
+static int *
+parse_location(APEX_Debugger *dbg, const char *text, char *name, int size)
+{
+    char buf[32];
+    int n;
+
+    if (!text)
+    {
+        return NULL;
+    }
+
+    if ((text[0] == 'R' || text[0] == 'r')
+        && parse_number(text + 1, &n) == 0 && n >= 0 && n < REG_FILE_SIZE)
+    {
+        snprintf(name, size, "R%d", n);
+        return &dbg->cpu->regs[n];
+    }
+
+    if (text[0] == 'M' || text[0] == 'm')
+    {
+        snprintf(buf, sizeof(buf), "%s", text + 1);
+        if (buf[0] == '[' && buf[strlen(buf) - 1] == ']')
+        {
+            buf[strlen(buf) - 1] = '\0';
+            memmove(buf, buf + 1, strlen(buf));
+        }
+
+        if (parse_number(buf, &n) == 0 && n >= 0 && n < DATA_MEMORY_SIZE)
+        {
+            snprintf(name, size, "M[%d]", n);
+            return &dbg->cpu->data_memory[n];
+        }
+    }
+
+    return NULL;
+}
+
+/* Reports watchpoints whose location changed and rearms all of them */
+static int
+report_watches(APEX_Debugger *dbg, int print)
+{
+    Debug_Watch *w;
+    int changed = FALSE;
+    int i;
+
+    for (i = 0; i < dbg->num_watches; ++i)
+    {
+        w = &dbg->watches[i];
+        if (*w->location != w->old_value)
+        {
+            if (print)
+            {
+                printf("Watchpoint %s: %d -> %d\n", w->name, w->old_value,
+                       *w->location);
+            }
+            w->old_value = *w->location;
+            changed = TRUE;
+        }
+    }
+
+    return changed;
+}
+
+/*
+ * Runs at most max_steps cycles, or without limit when max_steps is
+ * negative, and returns the STOP_* reason the run ended with.
+ */
+static int
+run_cycles(APEX_Debugger *dbg, long max_steps)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    const Debug_Watch *w, *end = dbg->watches + dbg->num_watches;
+    int index;
+    long n;
+
+    dbg->last_seq = cpu->fetch_seq;
+
+    for (n = 0; max_steps < 0 || n < max_steps; ++n)
+    {
+        if (dbg->history)
+        {
+            APEX_history_record(dbg->history, cpu);
+        }
+
+        if (APEX_cpu_step(cpu))
+        {
+            return STOP_HALT;
+        }
+
+        if (cpu->clock == dbg->stop_cycle)
+        {
+            return STOP_CYCLE;
+        }
+
+        if (cpu->config.max_cycles && cpu->clock >= cpu->config.max_cycles)
+        {
+            return STOP_LIMIT;
+        }
+
+        /* The fetch latch keeps the pc of the newest instruction */
+        if (dbg->num_breakpoints && cpu->fetch_seq != dbg->last_seq)
+        {
+            dbg->last_seq = cpu->fetch_seq;
+            index = code_index(cpu, fetched_pc(cpu));
+            if (index >= 0 && dbg->breakpoints[index])
+            {
+                return STOP_BREAK;
+            }
+        }
+
+        for (w = dbg->watches; w < end; ++w)
+        {
+            if (*w->location != w->old_value)
+            {
+                return STOP_WATCH;
+            }
+        }
+    }
+
+    return STOP_STEP;
+}
+
+/* Runs and then reports why the run stopped along with the cpu state */
+static void
+run_and_report(APEX_Debugger *dbg, long max_steps)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    int reason;
+
+    if (cpu->halted)
+    {
+        printf("The program has halted\n");
+        return;
+    }
+
+    reason = run_cycles(dbg, max_steps);
+    dbg->stop_cycle = -1;
+
+    switch (reason)
+    {
+        case STOP_HALT:
+            break;
+
+        case STOP_CYCLE:
+            printf("Reached cycle %d\n", cpu->clock);
+            break;
+
+        case STOP_LIMIT:
+            printf("Reached the cycle limit %d\n", cpu->config.max_cycles);
+            break;
+
+        case STOP_BREAK:
+            printf("Breakpoint at pc(%d), line %d\n", fetched_pc(cpu),
+                   cpu->code_memory[code_index(cpu, fetched_pc(cpu))].line);
+            break;
+    }
+
+    report_watches(dbg, TRUE);
+    APEX_cpu_print_state(cpu);
+}
+
+static int
+cmd_step(APEX_Debugger *dbg, int argc, char **argv)
+{
+    int n = 1;
+
+    if (argc > 1 && (parse_number(argv[1], &n) || n < 1))
+    {
+        return -1;
+    }
+
+    run_and_report(dbg, n);
+    return 0;
+}
+
+static int
+cmd_continue(APEX_Debugger *dbg, int argc, char **argv)
+{
+    run_and_report(dbg, -1);
+    return 0;
+}
+
+/* run-until cycle N, "cycle" may be left out */
+static int
+cmd_until(APEX_Debugger *dbg, int argc, char **argv)
+{
+    int arg = (argc > 2 && strcmp(argv[1], "cycle") == 0) ? 2 : 1;
+    int cycle;
+
+    if (argc != arg + 1 || parse_number(argv[arg], &cycle))
+    {
+        return -1;
+    }
+
+    if (cycle <= dbg->cpu->clock)
+    {
+        printf("Already at cycle %d\n", dbg->cpu->clock);
+        return 0;
+    }
+
+    dbg->stop_cycle = cycle;
+    run_and_report(dbg, -1);
+    return 0;
+}
+
+/* True when the instruction fetched in the last cycle has a breakpoint */
+static int
+hit_breakpoint(const APEX_Debugger *dbg, int seq_before)
+{
+    const APEX_CPU *cpu = dbg->cpu;
+    int index;
+
+    if (cpu->fetch_seq == seq_before)
+    {
+        return FALSE;
+    }
+
+    index = code_index(cpu, fetched_pc(cpu));
+    return index >= 0 && dbg->breakpoints[index];
+}
+
+/* The golden model cannot follow the cpu back in time */
+static void
+stop_cosim(APEX_Debugger *dbg)
+{
+    if (dbg->cpu->golden)
+    {
+        APEX_golden_free(dbg->cpu->golden);
+        dbg->cpu->golden = NULL;
+        printf("Co-simulation is off after reverse execution\n");
+    }
+}
+
+/*
+ * Replays from snapshot index through the cycle that ends at clock limit and
+ * returns the last clock at which a watched location changed or a breakpoint
+ * was fetched, -1 if none did.
+ */
+static int
+last_stop_before(APEX_Debugger *dbg, int index, int limit)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    APEX_Replay replay;
+    int values[DEBUG_MAX_WATCHES];
+    int found = -1;
+    int i, seq;
+
+    APEX_history_detach(cpu, &replay);
+    APEX_history_load(dbg->history, index, cpu);
+
+    while (cpu->clock < limit)
+    {
+        for (i = 0; i < dbg->num_watches; ++i)
+        {
+            values[i] = *dbg->watches[i].location;
+        }
+        seq = cpu->fetch_seq;
+
+        if (APEX_cpu_step(cpu))
+        {
+            break;
+        }
+
+        if (hit_breakpoint(dbg, seq))
+        {
+            found = cpu->clock;
+            continue;
+        }
+
+        for (i = 0; i < dbg->num_watches; ++i)
+        {
+            if (*dbg->watches[i].location != values[i])
+            {
+                found = cpu->clock;
+                break;
+            }
+        }
+    }
+
+    APEX_history_attach(cpu, &replay);
+    return found;
+}
+
+/*
+ * Moves to cycle and reports like a forward run that stopped there. The last
+ * cycle is simulated again so that the watchpoints it changed are shown.
+ */
+static void
+reverse_to(APEX_Debugger *dbg, int cycle)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    APEX_Replay replay;
+    int seq;
+
+    APEX_history_detach(cpu, &replay);
+
+    if (cycle > dbg->history->snapshots[0].clock)
+    {
+        APEX_history_goto(dbg->history, cpu, cycle - 1);
+        report_watches(dbg, FALSE);
+        seq = cpu->fetch_seq;
+        APEX_cpu_step(cpu);
+
+        if (hit_breakpoint(dbg, seq))
+        {
+            printf("Breakpoint at pc(%d), line %d\n", fetched_pc(cpu),
+                   cpu->code_memory[code_index(cpu, fetched_pc(cpu))].line);
+        }
+    }
+    else
+    {
+        APEX_history_goto(dbg->history, cpu, cycle);
+    }
+
+    APEX_history_attach(cpu, &replay);
+    report_watches(dbg, TRUE);
+    dbg->last_seq = cpu->fetch_seq;
+    APEX_cpu_print_state(cpu);
+}
+
+static int
+cmd_reverse_step(APEX_Debugger *dbg, int argc, char **argv)
+{
+    int n = 1, cycle;
+
+    if (argc > 1 && (parse_number(argv[1], &n) || n < 1))
+    {
+        return -1;
+    }
+
+    if (!dbg->history || !dbg->history->count)
+    {
+        printf("No history, snapshot_interval is 0 or nothing ran yet\n");
+        return 0;
+    }
+
+    stop_cosim(dbg);
+    cycle = dbg->cpu->clock - n;
+    if (cycle < dbg->history->snapshots[0].clock)
+    {
+        cycle = dbg->history->snapshots[0].clock;
+        printf("History starts at cycle %d\n", cycle);
+    }
+
+    reverse_to(dbg, cycle);
+    return 0;
+}
+
+/* Goes back to the last cycle a watchpoint changed or a breakpoint hit */
+static int
+cmd_reverse_continue(APEX_Debugger *dbg, int argc, char **argv)
+{
+    APEX_History *history = dbg->history;
+    int now = dbg->cpu->clock;
+    int index, limit, found = -1;
+
+    if (!history || !history->count)
+    {
+        printf("No history, snapshot_interval is 0 or nothing ran yet\n");
+        return 0;
+    }
+
+    stop_cosim(dbg);
+
+    /* Newest interval first, each one up to where the next one starts */
+    limit = now - 1;
+    for (index = APEX_history_find(history, now - 1); index >= 0 && found < 0;
+         --index)
+    {
+        found = last_stop_before(dbg, index, limit);
+        limit = history->snapshots[index].clock;
+    }
+
+    if (found < 0)
+    {
+        found = history->snapshots[0].clock;
+        printf("No earlier watchpoint or breakpoint, history starts at cycle "
+               "%d\n", found);
+    }
+
+    reverse_to(dbg, found);
+    return 0;
+}
+
+static int
+cmd_break(APEX_Debugger *dbg, int argc, char **argv)
+{
+    int pc, index;
+
+    if (argc != 2 || parse_number(argv[1], &pc))
+    {
+        return -1;
+    }
+
+    index = code_index(dbg->cpu, pc);
+    if (index < 0)
+    {
+        printf("No instruction at pc(%d)\n", pc);
+        return 0;
+    }
+
+    if (!dbg->breakpoints[index])
+    {
+        dbg->breakpoints[index] = TRUE;
+        dbg->num_breakpoints++;
+    }
+    printf("Breakpoint at pc(%d), line %d\n", pc,
+           dbg->cpu->code_memory[index].line);
+    return 0;
+}
+
+static int
+cmd_clear(APEX_Debugger *dbg, int argc, char **argv)
+{
+    int pc, index;
+
+    if (argc != 2 || parse_number(argv[1], &pc))
+    {
+        return -1;
+    }
+
+    index = code_index(dbg->cpu, pc);
+    if (index < 0 || !dbg->breakpoints[index])
+    {
+        printf("No breakpoint at pc(%d)\n", pc);
+        return 0;
+    }
+
+    dbg->breakpoints[index] = FALSE;
+    dbg->num_breakpoints--;
+    return 0;
+}
+
+static int
+cmd_watch(APEX_Debugger *dbg, int argc, char **argv)
+{
+    Debug_Watch *w;
+    char name[24];
+    int *location;
+    int i;
+
+    if (argc != 2)
+    {
+        return -1;
+    }
+
+    location = parse_location(dbg, argv[1], name, sizeof(name));
+    if (!location)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < dbg->num_watches; ++i)
+    {
+        if (dbg->watches[i].location == location)
+        {
+            return 0;
+        }
+    }
+
+    if (dbg->num_watches == DEBUG_MAX_WATCHES)
+    {
+        printf("At most %d watchpoints\n", DEBUG_MAX_WATCHES);
+        return 0;
+    }
+
+    w = &dbg->watches[dbg->num_watches++];
+    strcpy(w->name, name);
+    w->location = location;
+    w->old_value = *location;
+    printf("Watchpoint %s = %d\n", w->name, w->old_value);
+    return 0;
+}
+
+static int
+cmd_unwatch(APEX_Debugger *dbg, int argc, char **argv)
+{
+    char name[24];
+    int *location;
+    int i;
+
+    if (argc != 2)
+    {
+        return -1;
+    }
+
+    location = parse_location(dbg, argv[1], name, sizeof(name));
+    for (i = 0; location && i < dbg->num_watches; ++i)
+    {
+        if (dbg->watches[i].location == location)
+        {
+            dbg->watches[i] = dbg->watches[--dbg->num_watches];
+            return 0;
+        }
+    }
+
+    printf("No watchpoint on %s\n", argv[1]);
+    return 0;
+}
+
+static int
+cmd_info(APEX_Debugger *dbg, int argc, char **argv)
+{
+    const APEX_CPU *cpu = dbg->cpu;
+    int i;
+
+    printf("Cycle %d, %d instructions retired%s\n", cpu->clock,
+           cpu->insn_completed, cpu->halted ? ", halted" : "");
+
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        if (dbg->breakpoints[i])
+        {
+            printf("Breakpoint at pc(%d), line %d\n", CODE_INDEX_TO_PC(i),
+                   cpu->code_memory[i].line);
+        }
+    }
+
+    for (i = 0; i < dbg->num_watches; ++i)
+    {
+        printf("Watchpoint %s = %d\n", dbg->watches[i].name,
+               *dbg->watches[i].location);
+    }
+
+    if (dbg->history && dbg->history->count)
+    {
+        printf("History from cycle %d, %d of %d snapshots every %d cycles, "
+               "%zu KiB\n",
+               dbg->history->snapshots[0].clock, dbg->history->count,
+               dbg->history->capacity, dbg->history->interval,
+               dbg->history->count * sizeof(APEX_CPU) / 1024);
+    }
+    return 0;
+}
+
+static int
+cmd_print(APEX_Debugger *dbg, int argc, char **argv)
+{
+    APEX_cpu_print_state(dbg->cpu);
+    return 0;
+}
+
+static int
+cmd_mem(APEX_Debugger *dbg, int argc, char **argv)
+{
+    int addr, count = 1, i;
+
+    if (argc < 2 || parse_number(argv[1], &addr)
+        || (argc > 2 && parse_number(argv[2], &count)) || addr < 0
+        || count < 1)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < count && addr + i < DATA_MEMORY_SIZE; ++i)
+    {
+        printf("M[%d] = %d\n", addr + i, dbg->cpu->data_memory[addr + i]);
+    }
+    return 0;
+}
+
+static int cmd_help(APEX_Debugger *dbg, int argc, char **argv);
+
+static const Debug_Command commands[] = {
+    {"step", "s", cmd_step, "step [N]", "Run N cycles, default 1"},
+    {"continue", "c", cmd_continue, "continue",
+     "Run to a breakpoint, watchpoint or HALT"},
+    {"run-until", "until", cmd_until, "run-until cycle N",
+     "Run until clock cycle N"},
+    {"reverse-step", "rs", cmd_reverse_step, "reverse-step [N]",
+     "Go back N cycles, default 1"},
+    {"reverse-continue", "rc", cmd_reverse_continue, "reverse-continue",
+     "Go back to the last watchpoint change or breakpoint"},
+    {"break", "b", cmd_break, "break <pc>",
+     "Stop when the instruction at pc is fetched"},
+    {"clear", NULL, cmd_clear, "clear <pc>", "Remove a breakpoint"},
+    {"watch", "w", cmd_watch, "watch R<n> | M<addr>",
+     "Stop when a register or data memory word changes"},
+    {"unwatch", NULL, cmd_unwatch, "unwatch R<n> | M<addr>",
+     "Remove a watchpoint"},
+    {"info", "i", cmd_info, "info", "List breakpoints and watchpoints"},
+    {"print", "p", cmd_print, "print", "Print the pipeline and registers"},
+    {"mem", "x", cmd_mem, "mem <addr> [count]", "Print data memory"},
+    {"help", "h", cmd_help, "help", "Print this list"},
+    {"quit", "q", NULL, "quit", "Leave the debugger"},
+    {NULL, NULL, NULL, NULL, NULL},
+};
+
+static int
+cmd_help(APEX_Debugger *dbg, int argc, char **argv)
+{
+    const Debug_Command *c;
+
+    for (c = commands; c->name; ++c)
+    {
+        printf("  %-24s %s\n", c->usage, c->help);
+    }
+    return 0;
+}
+
+/*
+ * Executes one command line. Returns FALSE when the debugger should exit,
+ * TRUE otherwise. An empty line repeats the previous command.
+ */
+int
+APEX_debug_command(APEX_Debugger *dbg, const char *line)
+{
+    const Debug_Command *c;
+    char buf[DEBUG_LINE_SIZE];
+    char *argv[MAX_ARGS];
+    int argc = 0;
+    char *tok;
+
+    snprintf(buf, sizeof(buf), "%s", line);
+    buf[strcspn(buf, "\r\n")] = '\0';
+    if (strspn(buf, " \t") == strlen(buf))
+    {
+        snprintf(buf, sizeof(buf), "%s", dbg->last_line);
+    }
+    snprintf(dbg->last_line, sizeof(dbg->last_line), "%s", buf);
+
+    for (tok = strtok(buf, " \t"); tok && argc < MAX_ARGS;
+         tok = strtok(NULL, " \t"))
+    {
+        argv[argc++] = tok;
+    }
+
+    if (argc == 0)
+    {
+        return TRUE;
+    }
+
+    for (c = commands; c->name; ++c)
+    {
+        if (strcmp(argv[0], c->name) == 0
+            || (c->alias && strcmp(argv[0], c->alias) == 0))
+        {
+            if (!c->run)
+            {
+                return FALSE;
+            }
+
+            if (c->run(dbg, argc, argv))
+            {
+                printf("Usage: %s\n", c->usage);
+            }
+            return TRUE;
+        }
+    }
+
+    printf("Unknown command '%s', try help\n", argv[0]);
+    return TRUE;
+}
+
+/* Reads commands from in until quit or end of input */
+void
+APEX_debug_console(APEX_Debugger *dbg, FILE *in)
+{
+    char line[DEBUG_LINE_SIZE];
+
+    APEX_cpu_print_state(dbg->cpu);
+
+    while (TRUE)
+    {
+        printf("(apex) ");
+        fflush(stdout);
+
+        if (!fgets(line, sizeof(line), in) || !APEX_debug_command(dbg, line))
+        {
+            break;
+        }
+    }
+
+    printf("\n");
+}
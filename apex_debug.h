@@ -0,0 +1,57 @@
+/*
+ * apex_debug.h
+ * Interactive debugger with breakpoints, watchpoints and run-until
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_DEBUG_H_
+#define _APEX_DEBUG_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+#include "apex_history.h"
+#include "apex_macros.h"
+
+/* Watchpoints active at once */
+#define DEBUG_MAX_WATCHES 32
+
+/* Longest command line */
+#define DEBUG_LINE_SIZE 256
+
+/* Why a run of the debugger came to a stop */
+#define STOP_STEP 0   /* Requested number of cycles done */
+#define STOP_HALT 1   /* HALT retired */
+#define STOP_CYCLE 2  /* run-until cycle reached */
+#define STOP_LIMIT 3  /* max_cycles reached */
+#define STOP_BREAK 4  /* Breakpoint instruction fetched */
+#define STOP_WATCH 5  /* Watched location changed */
+
+typedef struct Debug_Watch
+{
+    char name[24];                /* "R3" or "M[128]" */
+    int *location;                /* Register or data memory word watched */
+    int old_value;
+} Debug_Watch;
+
+typedef struct APEX_Debugger
+{
+    APEX_CPU *cpu;
+    char *breakpoints;            /* One flag per code memory instruction */
+    int num_breakpoints;
+    Debug_Watch watches[DEBUG_MAX_WATCHES];
+    int num_watches;
+    int stop_cycle;               /* run-until target, -1 for none */
+    int last_seq;                 /* fetch_seq at the last breakpoint check */
+    APEX_History *history;        /* Snapshots for reverse execution, or NULL */
+    char last_line[DEBUG_LINE_SIZE]; /* Repeated on an empty line */
+} APEX_Debugger;
+
+APEX_Debugger *APEX_debug_create(APEX_CPU *cpu);
+void APEX_debug_free(APEX_Debugger *dbg);
+int APEX_debug_command(APEX_Debugger *dbg, const char *line);
+void APEX_debug_console(APEX_Debugger *dbg, FILE *in);
+
+#endif
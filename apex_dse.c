@@ -0,0 +1,729 @@
+/*
+ * apex_dse.c
+ * Design-space exploration driver. Expands parameter ranges from a sweep file
+ * into design points (full cartesian product or a Latin-hypercube sample),
+ * runs every point against a workload set on all cores and writes a results
+ * table with CPI, mispredict rate and stall breakdown plus the CPI/cost
+ * Pareto front. Only points that ran every workload to HALT are on the
+ * front; a point whose configuration a workload fails to load with is
+ * reported and fails the run.
+ *
+ * Sweep file format, one directive per line, '#' starts a comment:
+ *
+ *   param <name> <value> [<value> ...]    explicit levels
+ *   range <name> <first> <last> [<step>]  arithmetic levels, "*<k>" for
+ *                                         geometric steps
+ *   workload <file.asm>                   may be repeated
+ *   sample grid | lhs <points>            default grid
+ *   seed <n>                              LHS seed, default 1
+ *   jobs <n>                              worker processes, 0 = all cores
+ *   max_cycles <n>                        per-run cycle limit
+ *   output <file.csv>                     default dse_results.csv
+ *
+ * Parameter names are those accepted by APEX_config_set().
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+
+#define DSE_MAX_PARAMS 16
+#define DSE_MAX_LEVELS 64
+#define DSE_MAX_WORKLOADS 64
+#define DSE_MAX_POINTS 100000
+
+typedef struct DSE_Param
+{
+    char name[32];
+    int num_levels;
+    char levels[DSE_MAX_LEVELS][32];
+} DSE_Param;
+
+typedef struct DSE_Sweep
+{
+    DSE_Param params[DSE_MAX_PARAMS];
+    int num_params;
+    char workloads[DSE_MAX_WORKLOADS][256];
+    int num_workloads;
+    int lhs_points;      /* 0 selects the full grid */
+    unsigned int seed;
+    int jobs;
+    int max_cycles;
+    char output[256];
+} DSE_Sweep;
+
+/* Result of one design point summed over all workloads, lives in memory
+ * shared with the worker processes */
+typedef struct DSE_Result
+{
+    int done;
+    int halted;          /* Workloads that reached HALT */
+    int failed;          /* Workloads APEX_cpu_init() rejected */
+    double cost;
+    unsigned long long cycles;
+    unsigned long long insns;
+    unsigned long long branches;
+    unsigned long long mispredicts;
+    unsigned long long raw_stalls;
+    unsigned long long unit_stalls;
+    unsigned long long flush_bubbles;
+    unsigned long long sb_forwards;
+    unsigned long long sb_occupancy;
+    unsigned long long pf_issued;
+    unsigned long long pf_useful;
+    unsigned long long pf_late;
+    unsigned long long pf_misses;
+    unsigned long long ic_accesses;
+    unsigned long long ic_misses;
+    unsigned long long fetch_bubbles;
+    unsigned long long fq_occupancy;
+    unsigned long long fetched;
+    unsigned long long lsd_replays;
+    unsigned long long lvp_loads;
+    unsigned long long lvp_predicted;
+    unsigned long long lvp_correct;
+    long long lvp_net_cycles;
+} DSE_Result;
+
+typedef struct DSE_Shared
+{
+    volatile int next_point;
+    DSE_Result results[];
+} DSE_Shared;
+
+static DSE_Param *
+find_or_add_param(DSE_Sweep *sweep, const char *name)
+{
+    int i;
+
+    for (i = 0; i < sweep->num_params; ++i)
+    {
+        if (strcmp(sweep->params[i].name, name) == 0)
+        {
+            return &sweep->params[i];
+        }
+    }
+
+    if (sweep->num_params == DSE_MAX_PARAMS)
+    {
+        return NULL;
+    }
+
+    snprintf(sweep->params[i].name, sizeof(sweep->params[i].name), "%s", name);
+    sweep->params[i].num_levels = 0;
+    sweep->num_params++;
+    return &sweep->params[i];
+}
+
+static int
+add_level(DSE_Param *param, const char *value)
+{
+    APEX_Config probe;
+
+    APEX_config_defaults(&probe);
+    if (APEX_config_set(&probe, param->name, value))
+    {
+        fprintf(stderr, "apex_dse: invalid value '%s' for '%s'\n", value,
+                param->name);
+        return -1;
+    }
+
+    if (param->num_levels == DSE_MAX_LEVELS)
+    {
+        fprintf(stderr, "apex_dse: too many levels for '%s'\n", param->name);
+        return -1;
+    }
+
+    snprintf(param->levels[param->num_levels++], sizeof(param->levels[0]), "%s",
+             value);
+    return 0;
+}
+
+static int
+add_range(DSE_Param *param, const char *first, const char *last,
+          const char *step)
+{
+    long v = strtol(first, NULL, 0);
+    long end = strtol(last, NULL, 0);
+    long inc = 1;
+    int geometric = FALSE;
+    char buf[32];
+
+    if (step)
+    {
+        geometric = (step[0] == '*');
+        inc = strtol(step + geometric, NULL, 0);
+    }
+
+    if (inc < 1 || (geometric && inc < 2))
+    {
+        fprintf(stderr, "apex_dse: bad step for '%s'\n", param->name);
+        return -1;
+    }
+
+    for (; v <= end; v = geometric ? v * inc : v + inc)
+    {
+        snprintf(buf, sizeof(buf), "%ld", v);
+        if (add_level(param, buf))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+parse_sweep_file(const char *filename, DSE_Sweep *sweep)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    int line_num = 0;
+    char *argv[DSE_MAX_LEVELS + 2];
+    int argc;
+    DSE_Param *param;
+    int i, err = 0;
+
+    fp = fopen(filename, "r");
+    if (!fp)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    while (!err && getline(&line, &len, fp) != -1)
+    {
+        line_num++;
+        line[strcspn(line, "#\r\n")] = '\0';
+
+        argc = 0;
+        for (char *tok = strtok(line, " \t"); tok && argc < DSE_MAX_LEVELS + 2;
+             tok = strtok(NULL, " \t"))
+        {
+            argv[argc++] = tok;
+        }
+
+        if (argc == 0)
+        {
+            continue;
+        }
+
+        if (strcmp(argv[0], "param") == 0 && argc >= 3)
+        {
+            param = find_or_add_param(sweep, argv[1]);
+            for (i = 2; param && !err && i < argc; ++i)
+            {
+                err = add_level(param, argv[i]);
+            }
+            err = err || !param;
+        }
+        else if (strcmp(argv[0], "range") == 0 && (argc == 4 || argc == 5))
+        {
+            param = find_or_add_param(sweep, argv[1]);
+            err = !param
+                  || add_range(param, argv[2], argv[3], argc == 5 ? argv[4] : NULL);
+        }
+        else if (strcmp(argv[0], "workload") == 0 && argc == 2
+                 && sweep->num_workloads < DSE_MAX_WORKLOADS)
+        {
+            snprintf(sweep->workloads[sweep->num_workloads++],
+                     sizeof(sweep->workloads[0]), "%s", argv[1]);
+        }
+        else if (strcmp(argv[0], "sample") == 0 && argc >= 2)
+        {
+            if (strcmp(argv[1], "grid") == 0)
+            {
+                sweep->lhs_points = 0;
+            }
+            else if (strcmp(argv[1], "lhs") == 0 && argc == 3)
+            {
+                sweep->lhs_points = atoi(argv[2]);
+                err = sweep->lhs_points < 1;
+            }
+            else
+            {
+                err = 1;
+            }
+        }
+        else if (strcmp(argv[0], "seed") == 0 && argc == 2)
+        {
+            sweep->seed = strtoul(argv[1], NULL, 0);
+        }
+        else if (strcmp(argv[0], "jobs") == 0 && argc == 2)
+        {
+            sweep->jobs = atoi(argv[1]);
+        }
+        else if (strcmp(argv[0], "max_cycles") == 0 && argc == 2)
+        {
+            sweep->max_cycles = atoi(argv[1]);
+        }
+        else if (strcmp(argv[0], "output") == 0 && argc == 2)
+        {
+            snprintf(sweep->output, sizeof(sweep->output), "%s", argv[1]);
+        }
+        else
+        {
+            err = 1;
+        }
+
+        if (err)
+        {
+            fprintf(stderr, "apex_dse: %s:%d: invalid directive\n", filename,
+                    line_num);
+        }
+    }
+
+    free(line);
+    fclose(fp);
+
+    if (!err && sweep->num_workloads == 0)
+    {
+        fprintf(stderr, "apex_dse: %s: no workloads\n", filename);
+        err = 1;
+    }
+
+    return err ? -1 : 0;
+}
+
+/* Small deterministic PRNG so LHS designs are reproducible across hosts */
+static unsigned int
+next_random(unsigned int *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 8) & 0xffffff;
+}
+
+/*
+ * Fills level_index[point * num_params + param] with the level chosen for
+ * each parameter. Returns the number of points.
+ */
+static int
+expand_points(const DSE_Sweep *sweep, int **level_index)
+{
+    int num_points = 1;
+    int p, i, j, tmp, rem;
+    int *idx, *perm;
+    unsigned int state = sweep->seed;
+
+    if (sweep->lhs_points)
+    {
+        num_points = sweep->lhs_points;
+    }
+    else
+    {
+        for (p = 0; p < sweep->num_params; ++p)
+        {
+            num_points *= sweep->params[p].num_levels;
+            if (num_points > DSE_MAX_POINTS)
+            {
+                fprintf(stderr, "apex_dse: grid exceeds %d points, use lhs\n",
+                        DSE_MAX_POINTS);
+                return -1;
+            }
+        }
+    }
+
+    idx = calloc((size_t)num_points * (sweep->num_params ? sweep->num_params : 1),
+                 sizeof(int));
+    perm = calloc(num_points, sizeof(int));
+    if (!idx || !perm)
+    {
+        free(idx);
+        free(perm);
+        return -1;
+    }
+
+    for (p = 0; p < sweep->num_params; ++p)
+    {
+        const DSE_Param *param = &sweep->params[p];
+
+        if (!sweep->lhs_points)
+        {
+            /* Mixed-radix counter, last parameter varies fastest */
+            for (i = 0; i < num_points; ++i)
+            {
+                rem = i;
+                for (j = sweep->num_params - 1; j > p; --j)
+                {
+                    rem /= sweep->params[j].num_levels;
+                }
+                idx[i * sweep->num_params + p] = rem % param->num_levels;
+            }
+            continue;
+        }
+
+        /* One sample per stratum, strata shuffled independently per
+         * parameter, jittered inside the stratum */
+        for (i = 0; i < num_points; ++i)
+        {
+            perm[i] = i;
+        }
+        for (i = num_points - 1; i > 0; --i)
+        {
+            j = next_random(&state) % (i + 1);
+            tmp = perm[i];
+            perm[i] = perm[j];
+            perm[j] = tmp;
+        }
+        for (i = 0; i < num_points; ++i)
+        {
+            double u = (perm[i] + (next_random(&state) / 16777216.0)) / num_points;
+            idx[i * sweep->num_params + p] = (int)(u * param->num_levels);
+        }
+    }
+
+    free(perm);
+    *level_index = idx;
+    return num_points;
+}
+
+static void
+build_config(const DSE_Sweep *sweep, const int *levels, APEX_Config *config)
+{
+    int p;
+
+    APEX_config_defaults(config);
+    config->debug_messages = FALSE;
+    config->single_step = FALSE;
+    config->max_cycles = sweep->max_cycles;
+
+    for (p = 0; p < sweep->num_params; ++p)
+    {
+        APEX_config_set(config, sweep->params[p].name,
+                        sweep->params[p].levels[levels[p]]);
+    }
+}
+
+static void
+run_point(const DSE_Sweep *sweep, const APEX_Config *config, DSE_Result *r)
+{
+    APEX_CPU *cpu;
+    int w;
+
+    for (w = 0; w < sweep->num_workloads; ++w)
+    {
+        cpu = APEX_cpu_init(sweep->workloads[w], config);
+        if (!cpu)
+        {
+            r->failed++;
+            continue;
+        }
+
+        APEX_cpu_run(cpu);
+
+        r->halted += cpu->halted;
+        r->cycles += cpu->clock;
+        r->insns += cpu->insn_completed;
+        r->branches += cpu->stats.branches;
+        r->mispredicts += cpu->stats.mispredicts;
+        r->raw_stalls += cpu->stats.raw_stalls;
+        r->unit_stalls += cpu->stats.exec_stalls + cpu->stats.mem_stalls
+                          + cpu->stats.sb_stalls;
+        r->flush_bubbles += cpu->stats.flush_bubbles;
+        r->sb_forwards += cpu->stats.sb_forwards;
+        r->sb_occupancy += cpu->stats.sb_occupancy;
+        r->pf_issued += cpu->stats.pf_issued;
+        r->pf_useful += cpu->stats.pf_useful;
+        r->pf_late += cpu->stats.pf_late;
+        r->pf_misses += cpu->stats.pf_misses;
+        r->ic_accesses += cpu->stats.ic_accesses;
+        r->ic_misses += cpu->stats.ic_misses;
+        r->fetch_bubbles += cpu->stats.fetch_bubbles;
+        r->fq_occupancy += cpu->stats.fq_occupancy;
+        r->fetched += cpu->fetch_seq;
+        r->lsd_replays += cpu->stats.lsd_replays;
+        r->lvp_loads += cpu->stats.lvp_loads;
+        r->lvp_predicted += cpu->stats.lvp_predicted;
+        r->lvp_correct += cpu->stats.lvp_correct;
+        r->lvp_net_cycles += (long long)cpu->stats.lvp_cycles_saved
+                             - (long long)cpu->stats.lvp_cycles_lost;
+        APEX_cpu_stop(cpu);
+    }
+
+    r->cost = APEX_config_cost(config);
+    r->done = TRUE;
+}
+
+/* Worker process body: claims points until none are left */
+static void
+worker(const DSE_Sweep *sweep, const int *level_index, int num_points,
+       DSE_Shared *shared)
+{
+    APEX_Config config;
+    int point;
+
+    /* The simulator reports completion on stdout, keep the terminal clean */
+    if (!freopen("/dev/null", "w", stdout))
+    {
+        _exit(1);
+    }
+
+    while ((point = __sync_fetch_and_add(&shared->next_point, 1)) < num_points)
+    {
+        build_config(sweep, &level_index[point * sweep->num_params], &config);
+        run_point(sweep, &config, &shared->results[point]);
+    }
+
+    fflush(NULL);
+    _exit(0);
+}
+
+static double
+result_cpi(const DSE_Result *r)
+{
+    return r->insns ? (double)r->cycles / r->insns : 0.0;
+}
+
+/* Only points that ran every workload to HALT are compared: a CPI summed
+ * over fewer workloads, or up to a cycle limit, is not comparable */
+static int
+point_complete(const DSE_Sweep *sweep, const DSE_Result *r)
+{
+    return r->done && r->insns != 0 && r->halted == sweep->num_workloads;
+}
+
+/* A point is on the front when no other point is at least as good on both
+ * CPI and cost and strictly better on one */
+static int
+is_pareto_optimal(const DSE_Sweep *sweep, const DSE_Shared *shared,
+                  int num_points, int point)
+{
+    const DSE_Result *a = &shared->results[point];
+    int i;
+
+    for (i = 0; i < num_points; ++i)
+    {
+        const DSE_Result *b = &shared->results[i];
+
+        if (i == point || !point_complete(sweep, b))
+        {
+            continue;
+        }
+
+        /* Ties keep only the lowest numbered point */
+        if (result_cpi(b) <= result_cpi(a) && b->cost <= a->cost
+            && (result_cpi(b) < result_cpi(a) || b->cost < a->cost || i < point))
+        {
+            return FALSE;
+        }
+    }
+
+    return point_complete(sweep, a);
+}
+
+static void
+print_point_params(FILE *fp, const DSE_Sweep *sweep, const int *levels,
+                   const char *sep)
+{
+    int p;
+
+    for (p = 0; p < sweep->num_params; ++p)
+    {
+        fprintf(fp, "%s%s", p ? sep : "", sweep->params[p].levels[levels[p]]);
+    }
+}
+
+static int
+write_results(const DSE_Sweep *sweep, const int *level_index, int num_points,
+              const DSE_Shared *shared)
+{
+    FILE *fp;
+    int i, p;
+
+    fp = fopen(sweep->output, "w");
+    if (!fp)
+    {
+        perror(sweep->output);
+        return -1;
+    }
+
+    fprintf(fp, "point");
+    for (p = 0; p < sweep->num_params; ++p)
+    {
+        fprintf(fp, ",%s", sweep->params[p].name);
+    }
+    fprintf(fp, ",cost,halted,cycles,instructions,cpi,mispredict_rate,"
+                "raw_stall_frac,unit_stall_frac,flush_frac,sb_forwards,"
+                "sb_occupancy,pf_accuracy,pf_coverage,pf_timeliness,"
+                "ic_miss_rate,fetch_bubble_frac,fq_occupancy,lsd_hit_rate,"
+                "lvp_coverage,lvp_accuracy,lvp_net_cycles,pareto\n");
+
+    for (i = 0; i < num_points; ++i)
+    {
+        const DSE_Result *r = &shared->results[i];
+        double cycles = r->cycles ? (double)r->cycles : 1.0;
+
+        fprintf(fp, "%d,", i);
+        print_point_params(fp, sweep, &level_index[i * sweep->num_params], ",");
+        fprintf(fp,
+                "%s%.2f,%d/%d,%llu,%llu,%.4f,%.4f,%.4f,%.4f,%.4f,%llu,%.4f,"
+                "%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%lld,%d\n",
+                sweep->num_params ? "," : "", r->cost, r->halted,
+                sweep->num_workloads, r->cycles, r->insns, result_cpi(r),
+                r->branches ? (double)r->mispredicts / r->branches : 0.0,
+                r->raw_stalls / cycles, r->unit_stalls / cycles,
+                r->flush_bubbles / cycles, r->sb_forwards,
+                r->sb_occupancy / cycles,
+                r->pf_issued ? (double)r->pf_useful / r->pf_issued : 0.0,
+                r->pf_useful + r->pf_misses
+                    ? (double)r->pf_useful / (r->pf_useful + r->pf_misses)
+                    : 0.0,
+                r->pf_useful ? (double)(r->pf_useful - r->pf_late) / r->pf_useful
+                             : 0.0,
+                r->ic_accesses ? (double)r->ic_misses / r->ic_accesses : 0.0,
+                r->fetch_bubbles / cycles, r->fq_occupancy / cycles,
+                r->fetched ? (double)r->lsd_replays / r->fetched : 0.0,
+                r->lvp_loads ? (double)r->lvp_predicted / r->lvp_loads : 0.0,
+                r->lvp_predicted ? (double)r->lvp_correct / r->lvp_predicted
+                                 : 0.0,
+                r->lvp_net_cycles,
+                is_pareto_optimal(sweep, shared, num_points, i));
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+static void
+print_pareto_summary(const DSE_Sweep *sweep, const int *level_index,
+                     int num_points, const DSE_Shared *shared)
+{
+    int i, p;
+
+    printf("Pareto front (CPI vs cost) over %d points:\n", num_points);
+    printf("%8s %8s  ", "cpi", "cost");
+    for (p = 0; p < sweep->num_params; ++p)
+    {
+        printf("%s ", sweep->params[p].name);
+    }
+    printf("\n");
+
+    for (i = 0; i < num_points; ++i)
+    {
+        if (is_pareto_optimal(sweep, shared, num_points, i))
+        {
+            printf("%8.4f %8.2f  ", result_cpi(&shared->results[i]),
+                   shared->results[i].cost);
+            print_point_params(stdout, sweep, &level_index[i * sweep->num_params],
+                               " ");
+            printf("\n");
+        }
+    }
+}
+
+int
+main(int argc, char const *argv[])
+{
+    DSE_Sweep *sweep;
+    DSE_Shared *shared;
+    int *level_index = NULL;
+    int num_points, num_workers, i, status, failed = 0;
+    size_t shared_size;
+    pid_t pid;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s <sweep_file>\n", argv[0]);
+        exit(1);
+    }
+
+    sweep = calloc(1, sizeof(DSE_Sweep));
+    if (!sweep)
+    {
+        exit(1);
+    }
+    sweep->seed = 1;
+    snprintf(sweep->output, sizeof(sweep->output), "dse_results.csv");
+
+    if (parse_sweep_file(argv[1], sweep))
+    {
+        exit(1);
+    }
+
+    num_points = expand_points(sweep, &level_index);
+    if (num_points < 0)
+    {
+        exit(1);
+    }
+
+    shared_size = sizeof(DSE_Shared) + (size_t)num_points * sizeof(DSE_Result);
+    shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+
+    num_workers = sweep->jobs > 0 ? sweep->jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_workers < 1)
+    {
+        num_workers = 1;
+    }
+    if (num_workers > num_points)
+    {
+        num_workers = num_points;
+    }
+
+    fprintf(stderr, "apex_dse: %d points x %d workloads on %d workers\n",
+            num_points, sweep->num_workloads, num_workers);
+    fflush(NULL);
+
+    for (i = 0; i < num_workers; ++i)
+    {
+        pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0)
+        {
+            worker(sweep, level_index, num_points, shared);
+        }
+    }
+
+    while (wait(&status) > 0)
+    {
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+    }
+
+    for (i = 0; i < num_points; ++i)
+    {
+        if (!shared->results[i].done)
+        {
+            fprintf(stderr, "apex_dse: point %d did not complete\n", i);
+            failed = 1;
+        }
+        else if (shared->results[i].failed)
+        {
+            fprintf(stderr, "apex_dse: point %d failed to load %d of %d "
+                            "workloads\n",
+                    i, shared->results[i].failed, sweep->num_workloads);
+            failed = 1;
+        }
+    }
+
+    if (write_results(sweep, level_index, num_points, shared))
+    {
+        exit(1);
+    }
+
+    print_pareto_summary(sweep, level_index, num_points, shared);
+    printf("Results written to %s\n", sweep->output);
+
+    munmap(shared, shared_size);
+    free(level_index);
+    free(sweep);
+    return failed;
+}
@@ -0,0 +1,144 @@
+/*
+ * apex_flight.c
+ * Prints a flight recorder file, the last cycles of a failed apex_sim run
+ * (see apex_recorder.c), oldest cycle first: the instruction in each latch
+ * as the cycle started, the flags, and the register writes and data memory
+ * accesses of the cycle.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_recorder.h"
+
+static const char *latch_names[FLIGHT_LATCHES] = {"F", "D", "X", "M", "W"};
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr, "APEX_Help: Usage %s <flight_file> [<cycles>]\n", prog);
+    fprintf(stderr, "APEX_Help: prints the last <cycles> cycles recorded, "
+                    "all by default\n");
+}
+
+static void
+print_record(const Flight_Record *r, FILE *out)
+{
+    const char *name;
+    int i;
+
+    fprintf(out, "cycle %d pc(%d) retired %d flags Z=%d P=%d N=%d\n",
+            r->clock, r->pc, r->retired, r->flags & 1, (r->flags >> 1) & 1,
+            (r->flags >> 2) & 1);
+
+    fprintf(out, " ");
+    for (i = 0; i < FLIGHT_LATCHES; ++i)
+    {
+        if (r->latches[i].pc < 0)
+        {
+            fprintf(out, " %s: -", latch_names[i]);
+            continue;
+        }
+
+        name = APEX_opcode_name(r->latches[i].opcode);
+        fprintf(out, " %s: pc(%d) %s", latch_names[i], r->latches[i].pc,
+                name ? name : "?");
+        if (r->latches[i].tail_pc >= 0)
+        {
+            fprintf(out, "+pc(%d)", r->latches[i].tail_pc);
+        }
+    }
+    fprintf(out, "\n");
+
+    for (i = 0; i < r->num_writes && i < FLIGHT_WRITES; ++i)
+    {
+        fprintf(out, i ? ", R%d = %d" : "  writes R%d = %d",
+                r->writes[i].reg, r->writes[i].value);
+    }
+    if (r->num_writes)
+    {
+        fprintf(out, "\n");
+    }
+
+    for (i = 0; i < r->num_accesses && i < FLIGHT_ACCESSES; ++i)
+    {
+        fprintf(out, i ? ", M[%d] %s %d" : "  memory M[%d] %s %d",
+                r->accesses[i].address, r->accesses[i].store ? "<-" : "->",
+                r->accesses[i].value);
+    }
+    if (r->num_accesses)
+    {
+        fprintf(out, "\n");
+    }
+}
+
+int
+main(int argc, char const *argv[])
+{
+    Flight_Header header;
+    Flight_Record record;
+    FILE *fp;
+    char *end;
+    int last = 0, i;
+
+    if (argc < 2 || argc > 3)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    if (argc == 3)
+    {
+        last = strtol(argv[2], &end, 10);
+        if (*end || last < 1)
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    fp = fopen(argv[1], "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to read %s\n", argv[1]);
+        exit(1);
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1
+        || memcmp(header.magic, FLIGHT_MAGIC, sizeof(FLIGHT_MAGIC)) != 0
+        || header.version != FLIGHT_VERSION
+        || header.record_size != sizeof(Flight_Record) || header.count < 0)
+    {
+        fprintf(stderr, "APEX_Error: %s is not a flight recorder file of this "
+                        "build\n",
+                argv[1]);
+        exit(1);
+    }
+
+    header.cause[sizeof(header.cause) - 1] = '\0';
+    printf("Run stopped in cycle %d: %s, %d cycles recorded\n", header.clock,
+           header.cause, header.count);
+
+    for (i = 0; i < header.count; ++i)
+    {
+        if (fread(&record, sizeof(record), 1, fp) != 1)
+        {
+            fprintf(stderr, "APEX_Error: %s ends after %d of %d cycles\n",
+                    argv[1], i, header.count);
+            exit(1);
+        }
+
+        if (!last || i >= header.count - last)
+        {
+            print_record(&record, stdout);
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
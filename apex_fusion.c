@@ -0,0 +1,62 @@
+/*
+ * apex_fusion.c
+ * Macro-op fusion. Two instructions next to each other in code memory that
+ * form one of the idioms enabled in the fusion parameter travel down the
+ * pipeline as one micro-op, in a single slot of every latch:
+ *
+ *   cmp_branch  CMP, CML or SUBL and a conditional branch on its flags
+ *   movc_add    MOVC and an ADD reading the constant
+ *   addl_load   ADDL and a LOAD using its result as the base address
+ *
+ * The pipeline fetches the second instruction along with the first when
+ * they match, and the lockstep engine of apex_batch executes a matching
+ * pair in one step.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include "apex_cpu.h"
+#include "apex_fusion.h"
+
+/*
+ * The FUSE_* idiom of idioms that head, followed by tail in code memory,
+ * forms, FUSE_NONE when they do not fuse
+ */
+int
+APEX_fusion_match(int idioms, const APEX_Instruction *head,
+                  const APEX_Instruction *tail)
+{
+    switch (head->opcode)
+    {
+        case OPCODE_CMP:
+        case OPCODE_CML:
+        case OPCODE_SUBL:
+            if ((idioms & FUSE_CMP_BRANCH)
+                && (tail->opcode == OPCODE_BZ || tail->opcode == OPCODE_BNZ
+                    || tail->opcode == OPCODE_BP || tail->opcode == OPCODE_BNP
+                    || tail->opcode == OPCODE_BN
+                    || tail->opcode == OPCODE_BNN))
+            {
+                return FUSE_CMP_BRANCH;
+            }
+            break;
+
+        case OPCODE_MOVC:
+            if ((idioms & FUSE_MOVC_ADD) && tail->opcode == OPCODE_ADD
+                && (tail->rs1 == head->rd || tail->rs2 == head->rd))
+            {
+                return FUSE_MOVC_ADD;
+            }
+            break;
+
+        case OPCODE_ADDL:
+            if ((idioms & FUSE_ADDL_LOAD) && tail->opcode == OPCODE_LOAD
+                && tail->rs1 == head->rd)
+            {
+                return FUSE_ADDL_LOAD;
+            }
+            break;
+    }
+    return FUSE_NONE;
+}
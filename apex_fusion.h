@@ -0,0 +1,18 @@
+/*
+ * apex_fusion.h
+ * Macro-op fusion of instruction pairs
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_FUSION_H_
+#define _APEX_FUSION_H_
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+int APEX_fusion_match(int idioms, const APEX_Instruction *head,
+                      const APEX_Instruction *tail);
+
+#endif
@@ -0,0 +1,793 @@
+/*
+ * apex_gen.c
+ * Random APEX program generator for stress and scaling runs. Programs are a
+ * chain of counted loops ending in HALT, so every program terminates:
+ *
+ *       MOVC R14,#<trips>
+ *   top MOVC R13,#0              stream pointer for LOADP/STOREP
+ *       <random body>
+ *       SUBL R14,R14,#1
+ *       BNZ  <top>
+ *
+ * Body branches and jumps only go forward and never past the loop's SUBL.
+ * Each body branch follows a CML on the loop counter R14, which runs trips
+ * down to 1, so a chosen compare value makes the branch taken on the wanted
+ * fraction of iterations. Loads and stores use word addresses inside the
+ * footprint, relative to R15 = 0 or to the R13 stream pointer, which is reset
+ * every iteration and never walks past the footprint. Sources are picked
+ * among recently written registers, dependency distance is geometric with
+ * the requested mean.
+ *
+ * Registers: R0-R11 data, R12 JALR link, R13 stream pointer, R14 loop
+ * counter, R15 zero base, V0-V7 vector data. Vector accesses leave room for
+ * MAX_VECTOR_LENGTH lanes, so programs stay valid at any vector_length.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+#define GEN_DATA_REGS 12
+#define GEN_LINK_REG 12
+#define GEN_PTR_REG 13
+#define GEN_COUNT_REG 14
+#define GEN_ZERO_REG 15
+
+/* Producers remembered for picking dependent sources */
+#define GEN_RING_SIZE 256
+
+/* Longest forward branch or jump, in instructions */
+#define GEN_MAX_SKIP 16
+
+/* Bytes of output collected before each write */
+#define GEN_BUFFER_SIZE (1 << 20)
+
+/* Instruction classes of the mix */
+#define CLASS_ALU 0
+#define CLASS_MUL 1
+#define CLASS_LOAD 2
+#define CLASS_STORE 3
+#define CLASS_CMP 4
+#define CLASS_BRANCH 5
+#define CLASS_JUMP 6
+#define CLASS_NOP 7
+#define CLASS_VECTOR 8
+#define NUM_CLASSES 9
+
+static const char *class_names[NUM_CLASSES] = {
+    "alu", "mul", "load", "store", "cmp", "branch", "jump", "nop", "vector",
+};
+
+/* Vector instructions are opt-in */
+static const int default_weights[NUM_CLASSES] = {40, 5, 15, 10, 5, 15, 3, 2, 0};
+
+#define GEN_VECTOR_REGS 8
+
+static const int alu_opcodes[] = {OPCODE_ADD,  OPCODE_SUB,  OPCODE_AND,
+                                  OPCODE_OR,   OPCODE_XOR,  OPCODE_ADDL,
+                                  OPCODE_SUBL, OPCODE_MOVC};
+static const int branch_opcodes[] = {OPCODE_BP, OPCODE_BNP, OPCODE_BN,
+                                     OPCODE_BNN};
+
+typedef struct Gen_Options
+{
+    long length;          /* Static instructions, HALT included */
+    int body;             /* Random instructions per loop body */
+    int trips;            /* Iterations of every loop */
+    double distance;      /* Mean producer to consumer distance */
+    double bias;          /* Fraction of iterations a body branch is taken */
+    int footprint;        /* Data memory words touched */
+    int weights[NUM_CLASSES];
+    uint64_t seed;
+    int binary;           /* Write the APEX_BINARY_MAGIC format */
+    const char *output;
+} Gen_Options;
+
+typedef struct Gen_Insn
+{
+    int opcode;
+    int rd;
+    int rs1;
+    int rs2;
+    int imm;
+} Gen_Insn;
+
+typedef struct Generator
+{
+    const Gen_Options *opts;
+    uint64_t rng;
+    int total_weight;
+    int ring[GEN_RING_SIZE];      /* Destinations of recent instructions */
+    long produced;
+    int stream_uses;              /* LOADP/STOREP in the current body */
+    long emitted;
+    FILE *fp;
+    int used;
+    char buf[GEN_BUFFER_SIZE];
+} Generator;
+
+/* xorshift64* */
+static uint64_t
+next_random(Generator *gen)
+{
+    gen->rng ^= gen->rng >> 12;
+    gen->rng ^= gen->rng << 25;
+    gen->rng ^= gen->rng >> 27;
+    return gen->rng * 0x2545F4914F6CDD1DULL;
+}
+
+/* Uniform integer in [0, n) */
+static int
+random_below(Generator *gen, int n)
+{
+    return (int)((next_random(gen) >> 33) % (uint64_t)n);
+}
+
+static double
+random_unit(Generator *gen)
+{
+    return (next_random(gen) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void
+flush_output(Generator *gen)
+{
+    fwrite(gen->buf, 1, gen->used, gen->fp);
+    gen->used = 0;
+}
+
+static void
+put_char(Generator *gen, char c)
+{
+    gen->buf[gen->used++] = c;
+}
+
+static void
+put_string(Generator *gen, const char *s)
+{
+    while (*s)
+    {
+        gen->buf[gen->used++] = *s++;
+    }
+}
+
+static void
+put_number(Generator *gen, int value)
+{
+    char digits[12];
+    unsigned int v = value < 0 ? -(unsigned int)value : (unsigned int)value;
+    int n = 0;
+
+    if (value < 0)
+    {
+        put_char(gen, '-');
+    }
+
+    do
+    {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+
+    while (n)
+    {
+        put_char(gen, digits[--n]);
+    }
+}
+
+static void
+put_reg(Generator *gen, int reg)
+{
+    put_char(gen, 'R');
+    put_number(gen, reg);
+}
+
+static void
+put_vreg(Generator *gen, int reg)
+{
+    put_char(gen, 'V');
+    put_number(gen, reg);
+}
+
+static void
+put_imm(Generator *gen, int imm)
+{
+    put_char(gen, '#');
+    put_number(gen, imm);
+}
+
+/* Writes one instruction in the syntax file_parser.c reads */
+static void
+emit_text(Generator *gen, const Gen_Insn *in)
+{
+    put_string(gen, APEX_opcode_name(in->opcode));
+
+    switch (in->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+            put_char(gen, ' ');
+            put_reg(gen, in->rd);
+            put_char(gen, ',');
+            put_reg(gen, in->rs1);
+            put_char(gen, ',');
+            put_reg(gen, in->rs2);
+            break;
+
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+        case OPCODE_JALR:
+            put_char(gen, ' ');
+            put_reg(gen, in->rd);
+            put_char(gen, ',');
+            put_reg(gen, in->rs1);
+            put_char(gen, ',');
+            put_imm(gen, in->imm);
+            break;
+
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+            put_char(gen, ' ');
+            put_reg(gen, in->rs1);
+            put_char(gen, ',');
+            put_reg(gen, in->rs2);
+            put_char(gen, ',');
+            put_imm(gen, in->imm);
+            break;
+
+        case OPCODE_MOVC:
+            put_char(gen, ' ');
+            put_reg(gen, in->rd);
+            put_char(gen, ',');
+            put_imm(gen, in->imm);
+            break;
+
+        case OPCODE_CMP:
+            put_char(gen, ' ');
+            put_reg(gen, in->rs1);
+            put_char(gen, ',');
+            put_reg(gen, in->rs2);
+            break;
+
+        case OPCODE_CML:
+        case OPCODE_JUMP:
+            put_char(gen, ' ');
+            put_reg(gen, in->rs1);
+            put_char(gen, ',');
+            put_imm(gen, in->imm);
+            break;
+
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+            put_char(gen, ' ');
+            put_imm(gen, in->imm);
+            break;
+
+        case OPCODE_VADD:
+        case OPCODE_VMUL:
+            put_char(gen, ' ');
+            put_vreg(gen, in->rd);
+            put_char(gen, ',');
+            put_vreg(gen, in->rs1);
+            put_char(gen, ',');
+            put_vreg(gen, in->rs2);
+            break;
+
+        case OPCODE_VLOAD:
+            put_char(gen, ' ');
+            put_vreg(gen, in->rd);
+            put_char(gen, ',');
+            put_reg(gen, in->rs1);
+            put_char(gen, ',');
+            put_imm(gen, in->imm);
+            break;
+
+        case OPCODE_VSTORE:
+            put_char(gen, ' ');
+            put_reg(gen, in->rs1);
+            put_char(gen, ',');
+            put_vreg(gen, in->rs2);
+            put_char(gen, ',');
+            put_imm(gen, in->imm);
+            break;
+
+        case OPCODE_VRED:
+            put_char(gen, ' ');
+            put_reg(gen, in->rd);
+            put_char(gen, ',');
+            put_vreg(gen, in->rs1);
+            break;
+    }
+
+    put_char(gen, '\n');
+}
+
+static void
+emit_binary(Generator *gen, const Gen_Insn *in)
+{
+    int32_t fields[5] = {in->opcode, in->rd, in->rs1, in->rs2, in->imm};
+
+    memcpy(gen->buf + gen->used, fields, sizeof(fields));
+    gen->used += sizeof(fields);
+}
+
+static void
+emit(Generator *gen, int opcode, int rd, int rs1, int rs2, int imm)
+{
+    Gen_Insn in = {opcode, rd, rs1, rs2, imm};
+
+    /* Room for the longest text line */
+    if (gen->used > GEN_BUFFER_SIZE - 64)
+    {
+        flush_output(gen);
+    }
+
+    if (gen->opts->binary)
+    {
+        emit_binary(gen, &in);
+    }
+    else
+    {
+        emit_text(gen, &in);
+    }
+    gen->emitted++;
+}
+
+/* Source register written about opts->distance instructions ago */
+static int
+pick_source(Generator *gen)
+{
+    double stay = 1.0 - 1.0 / gen->opts->distance;
+    long distance = 1;
+
+    if (gen->produced == 0)
+    {
+        return random_below(gen, GEN_DATA_REGS);
+    }
+
+    while (distance < gen->produced && distance < GEN_RING_SIZE
+           && random_unit(gen) < stay)
+    {
+        distance++;
+    }
+
+    return gen->ring[(gen->produced - distance) % GEN_RING_SIZE];
+}
+
+static int
+pick_dest(Generator *gen)
+{
+    int rd = random_below(gen, GEN_DATA_REGS);
+
+    gen->ring[gen->produced % GEN_RING_SIZE] = rd;
+    gen->produced++;
+    return rd;
+}
+
+static int
+pick_class(Generator *gen)
+{
+    int r = random_below(gen, gen->total_weight);
+    int c;
+
+    for (c = 0; c < NUM_CLASSES - 1; ++c)
+    {
+        r -= gen->opts->weights[c];
+        if (r < 0)
+        {
+            break;
+        }
+    }
+    return c;
+}
+
+/* Word aligned data address inside the footprint */
+static int
+pick_address(Generator *gen)
+{
+    return 4 * random_below(gen, gen->opts->footprint);
+}
+
+/*
+ * Emits one random instruction, two for a branch, at code index pos of a
+ * body whose SUBL sits at index end. Returns the number emitted.
+ */
+static int
+emit_random(Generator *gen, long pos, long end)
+{
+    const Gen_Options *opts = gen->opts;
+    int opcode, skip, limit, k, taken, a, b;
+
+    switch (pick_class(gen))
+    {
+        case CLASS_MUL:
+            opcode = random_below(gen, 2) ? OPCODE_MUL : OPCODE_DIV;
+            a = pick_source(gen);
+            b = pick_source(gen);
+            emit(gen, opcode, pick_dest(gen), a, b, 0);
+            return 1;
+
+        case CLASS_LOAD:
+            /* The stream pointer must stay inside the footprint */
+            if (random_below(gen, 2) && gen->stream_uses < opts->footprint)
+            {
+                gen->stream_uses++;
+                emit(gen, OPCODE_LOADP, pick_dest(gen), GEN_PTR_REG, 0, 0);
+            }
+            else
+            {
+                emit(gen, OPCODE_LOAD, pick_dest(gen), GEN_ZERO_REG, 0,
+                     pick_address(gen));
+            }
+            return 1;
+
+        case CLASS_STORE:
+            if (random_below(gen, 2) && gen->stream_uses < opts->footprint)
+            {
+                gen->stream_uses++;
+                emit(gen, OPCODE_STOREP, 0, GEN_PTR_REG, pick_source(gen), 0);
+            }
+            else
+            {
+                emit(gen, OPCODE_STORE, 0, GEN_ZERO_REG, pick_source(gen),
+                     pick_address(gen));
+            }
+            return 1;
+
+        case CLASS_CMP:
+            if (random_below(gen, 2))
+            {
+                a = pick_source(gen);
+                emit(gen, OPCODE_CMP, 0, a, pick_source(gen), 0);
+            }
+            else
+            {
+                emit(gen, OPCODE_CML, 0, pick_source(gen), 0,
+                     random_below(gen, 256) - 128);
+            }
+            return 1;
+
+        case CLASS_BRANCH:
+            /* CML plus the branch, which must skip at least one slot */
+            if (end - pos < 3)
+            {
+                break;
+            }
+
+            limit = end - (pos + 1);
+            skip = 2 + random_below(gen, (limit < GEN_MAX_SKIP ? limit
+                                                                : GEN_MAX_SKIP)
+                                             - 1);
+            taken = (int)(opts->bias * opts->trips + 0.5);
+            opcode = branch_opcodes[random_below(gen, 4)];
+
+            /* R14 takes the values trips .. 1 */
+            switch (opcode)
+            {
+                case OPCODE_BP:  k = opts->trips - taken; break;     /* R14 > k */
+                case OPCODE_BNP: k = taken; break;                   /* R14 <= k */
+                case OPCODE_BN:  k = taken + 1; break;               /* R14 < k */
+                default:         k = opts->trips + 1 - taken; break; /* R14 >= k */
+            }
+
+            emit(gen, OPCODE_CML, 0, GEN_COUNT_REG, 0, k);
+            emit(gen, opcode, 0, 0, 0, 4 * skip);
+            return 2;
+
+        case CLASS_JUMP:
+            if (end - pos < 2)
+            {
+                break;
+            }
+
+            limit = end - pos;
+            skip = 2 + random_below(gen, (limit < GEN_MAX_SKIP ? limit
+                                                                : GEN_MAX_SKIP)
+                                             - 1);
+            if (random_below(gen, 2))
+            {
+                emit(gen, OPCODE_JUMP, 0, GEN_ZERO_REG, 0,
+                     CODE_INDEX_TO_PC((int)(pos + skip)));
+            }
+            else
+            {
+                emit(gen, OPCODE_JALR, GEN_LINK_REG, GEN_ZERO_REG, 0,
+                     CODE_INDEX_TO_PC((int)(pos + skip)));
+            }
+            return 1;
+
+        case CLASS_NOP:
+            emit(gen, OPCODE_NOP, 0, 0, 0, 0);
+            return 1;
+
+        case CLASS_VECTOR:
+            /* Whole registers must fit in the footprint */
+            if (opts->footprint < MAX_VECTOR_LENGTH)
+            {
+                break;
+            }
+
+            limit = opts->footprint - MAX_VECTOR_LENGTH + 1;
+            switch (random_below(gen, 5))
+            {
+                case 0:
+                    emit(gen, OPCODE_VLOAD, random_below(gen, GEN_VECTOR_REGS),
+                         GEN_ZERO_REG, 0, 4 * random_below(gen, limit));
+                    break;
+
+                case 1:
+                    emit(gen, OPCODE_VSTORE, 0, GEN_ZERO_REG,
+                         random_below(gen, GEN_VECTOR_REGS),
+                         4 * random_below(gen, limit));
+                    break;
+
+                case 4:
+                    a = random_below(gen, GEN_VECTOR_REGS);
+                    emit(gen, OPCODE_VRED, pick_dest(gen), a, 0, 0);
+                    break;
+
+                default:
+                    a = random_below(gen, GEN_VECTOR_REGS);
+                    b = random_below(gen, GEN_VECTOR_REGS);
+                    emit(gen, random_below(gen, 2) ? OPCODE_VADD : OPCODE_VMUL,
+                         random_below(gen, GEN_VECTOR_REGS), a, b, 0);
+                    break;
+            }
+            return 1;
+    }
+
+    /* ALU, also the fallback when a branch or jump does not fit */
+    opcode = alu_opcodes[random_below(gen, 8)];
+    switch (opcode)
+    {
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+            a = pick_source(gen);
+            emit(gen, opcode, pick_dest(gen), a, 0, random_below(gen, 64));
+            break;
+
+        case OPCODE_MOVC:
+            emit(gen, opcode, pick_dest(gen), 0, 0,
+                 random_below(gen, 512) - 256);
+            break;
+
+        default:
+            a = pick_source(gen);
+            b = pick_source(gen);
+            emit(gen, opcode, pick_dest(gen), a, b, 0);
+            break;
+    }
+    return 1;
+}
+
+static void
+generate(Generator *gen)
+{
+    const Gen_Options *opts = gen->opts;
+    long pos, top, end;
+    int r;
+
+    emit(gen, OPCODE_MOVC, GEN_ZERO_REG, 0, 0, 0);
+    for (r = 0; r < GEN_DATA_REGS; ++r)
+    {
+        emit(gen, OPCODE_MOVC, r, 0, 0, 1 + random_below(gen, 100));
+    }
+
+    /* Each loop costs its body plus four instructions of control */
+    while (gen->emitted + 5 < opts->length)
+    {
+        emit(gen, OPCODE_MOVC, GEN_COUNT_REG, 0, 0, opts->trips);
+        top = gen->emitted;
+        emit(gen, OPCODE_MOVC, GEN_PTR_REG, 0, 0, 0);
+
+        end = gen->emitted + opts->body;
+        if (end > opts->length - 3)
+        {
+            end = opts->length - 3;
+        }
+
+        gen->stream_uses = 0;
+        pos = gen->emitted;
+        while (pos < end)
+        {
+            pos += emit_random(gen, pos, end);
+        }
+
+        emit(gen, OPCODE_SUBL, GEN_COUNT_REG, GEN_COUNT_REG, 0, 1);
+        emit(gen, OPCODE_BNZ, 0, 0, 0, -4 * (int)(gen->emitted - top));
+    }
+
+    /* Too short for another loop, pad so the program is exactly -n long */
+    while (gen->emitted < opts->length - 1)
+    {
+        emit(gen, OPCODE_NOP, 0, 0, 0, 0);
+    }
+
+    emit(gen, OPCODE_HALT, 0, 0, 0, 0);
+}
+
+/* Parses "alu=40,mul=5,..." into the class weights, classes left out keep
+ * their default */
+static int
+parse_mix(Gen_Options *opts, const char *spec)
+{
+    char buf[256], *item, *eq;
+    int c;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (item = strtok(buf, ","); item; item = strtok(NULL, ","))
+    {
+        eq = strchr(item, '=');
+        if (!eq)
+        {
+            return -1;
+        }
+        *eq = '\0';
+
+        for (c = 0; c < NUM_CLASSES; ++c)
+        {
+            if (strcmp(item, class_names[c]) == 0)
+            {
+                opts->weights[c] = atoi(eq + 1);
+                break;
+            }
+        }
+
+        if (c == NUM_CLASSES || opts->weights[c] < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "APEX_Help: Usage %s [-n <instructions>] [-L <body>] "
+            "[-t <trips>] [-d <distance>] [-b <bias>] [-f <words>] "
+            "[-m <class>=<weight>,...] [-s <seed>] [-B] [-o <file>]\n",
+            prog);
+    fprintf(stderr, "APEX_Help: classes alu, mul, load, store, cmp, branch, "
+                    "jump, nop, vector\n");
+}
+
+int
+main(int argc, char const *argv[])
+{
+    Gen_Options opts;
+    Generator *gen;
+    struct timespec start, end;
+    double seconds;
+    int32_t count;
+    int i, c;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.length = 1000;
+    opts.body = 32;
+    opts.trips = 100;
+    opts.distance = 4.0;
+    opts.bias = 0.5;
+    opts.footprint = 256;
+    opts.seed = 1;
+    memcpy(opts.weights, default_weights, sizeof(opts.weights));
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-B") == 0)
+        {
+            opts.binary = TRUE;
+            continue;
+        }
+
+        if (argv[i][0] != '-' || !argv[i][1] || argv[i][2] || i + 1 >= argc)
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+
+        switch (argv[i][1])
+        {
+            case 'n': opts.length = atol(argv[++i]); continue;
+            case 'L': opts.body = atoi(argv[++i]); continue;
+            case 't': opts.trips = atoi(argv[++i]); continue;
+            case 'd': opts.distance = atof(argv[++i]); continue;
+            case 'b': opts.bias = atof(argv[++i]); continue;
+            case 'f': opts.footprint = atoi(argv[++i]); continue;
+            case 's': opts.seed = strtoull(argv[++i], NULL, 0); continue;
+            case 'o': opts.output = argv[++i]; continue;
+            case 'm':
+                if (parse_mix(&opts, argv[++i]) == 0)
+                {
+                    continue;
+                }
+                fprintf(stderr, "apex_gen: invalid mix '%s'\n", argv[i]);
+                exit(1);
+        }
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    /* Loops need room for initialisation, control and HALT */
+    if (opts.length < GEN_DATA_REGS + 2 || opts.length > 0x7fffffff / 4
+        || opts.body < 1 || opts.trips < 1 || opts.distance < 1.0
+        || opts.bias < 0.0 || opts.bias > 1.0 || opts.footprint < 1
+        || opts.footprint > DATA_MEMORY_SIZE / 4)
+    {
+        fprintf(stderr, "apex_gen: need -n >= %d, -L >= 1, -t >= 1, "
+                        "-d >= 1, 0 <= -b <= 1, 1 <= -f <= %d\n",
+                GEN_DATA_REGS + 2, DATA_MEMORY_SIZE / 4);
+        exit(1);
+    }
+
+    gen = calloc(1, sizeof(Generator));
+    if (!gen)
+    {
+        exit(1);
+    }
+
+    gen->opts = &opts;
+    gen->rng = opts.seed ? opts.seed : 1;
+    for (c = 0; c < NUM_CLASSES; ++c)
+    {
+        gen->total_weight += opts.weights[c];
+    }
+    if (!gen->total_weight)
+    {
+        fprintf(stderr, "apex_gen: the mix has no weight\n");
+        exit(1);
+    }
+
+    gen->fp = opts.output ? fopen(opts.output, "wb") : stdout;
+    if (!gen->fp)
+    {
+        fprintf(stderr, "apex_gen: unable to write %s\n", opts.output);
+        exit(1);
+    }
+
+    if (opts.binary)
+    {
+        /* The count is known up front, the program is exactly -n long */
+        count = (int32_t)opts.length;
+        fwrite(APEX_BINARY_MAGIC, 1, APEX_BINARY_MAGIC_SIZE, gen->fp);
+        fwrite(&count, sizeof(count), 1, gen->fp);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    generate(gen);
+    flush_output(gen);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    fprintf(stderr, "apex_gen: %ld instructions in %.3f s (%.1f M/s)\n",
+            gen->emitted, seconds,
+            seconds > 0 ? gen->emitted / seconds / 1e6 : 0.0);
+
+    if (gen->fp != stdout)
+    {
+        fclose(gen->fp);
+    }
+    free(gen);
+    return 0;
+}
@@ -0,0 +1,489 @@
+/*
+ * apex_golden.c
+ * Instruction-at-a-time model of the APEX ISA used for co-simulation. It
+ * shares nothing with the pipeline but the parsed code memory. Each time the
+ * pipeline retires an instruction the model executes the next one and the
+ * two are compared on what that instruction changed:
+ *   - the pc, which catches wrong-path or lost instructions,
+ *   - the registers it wrote, vector registers included,
+ *   - the address and value a store wrote.
+ * Flags and all of data memory are compared once HALT retires, when no
+ * younger instruction can have touched them. The first mismatch is reported
+ * and stops the simulation. Vector instructions run lane by lane in plain C
+ * here, which also checks the host SIMD kernels of apex_vector.c.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_golden.h"
+
+APEX_Golden *
+APEX_golden_create(const APEX_CPU *cpu)
+{
+    APEX_Golden *golden = calloc(1, sizeof(APEX_Golden));
+
+    if (!golden)
+    {
+        return NULL;
+    }
+
+    golden->pc = cpu->pc;
+    memcpy(golden->regs, cpu->regs, sizeof(golden->regs));
+    memcpy(golden->vregs, cpu->vregs, sizeof(golden->vregs));
+    memcpy(golden->data_memory, cpu->data_memory,
+           sizeof(golden->data_memory));
+    golden->zero_flag = cpu->zero_flag;
+    golden->pos_flag = cpu->pos_flag;
+    golden->neg_flag = cpu->neg_flag;
+    return golden;
+}
+
+void
+APEX_golden_free(APEX_Golden *golden)
+{
+    free(golden);
+}
+
+/* Prints the head of a divergence report naming the retiring instruction */
+static void
+report(const APEX_Golden *golden, const APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    char disasm[160];
+    int index = PC_TO_CODE_INDEX(stage->pc);
+
+    APEX_format_instruction(stage, disasm, sizeof(disasm));
+    fprintf(stderr,
+            "APEX_Error: Co-simulation divergence at cycle %d, instruction "
+            "#%llu\n",
+            cpu->clock, golden->retired + 1);
+    fprintf(stderr, "APEX_Error:   retiring pc(%d) line %d: %s\n", stage->pc,
+            index >= 0 && index < cpu->code_memory_size
+                ? cpu->code_memory[index].line
+                : 0,
+            disasm);
+}
+
+static void
+set_flags(APEX_Golden *golden, int value)
+{
+    golden->zero_flag = (value == 0);
+    golden->pos_flag = (value > 0);
+    golden->neg_flag = (value < 0);
+}
+
+static int
+check_address(const APEX_Golden *golden, const APEX_CPU *cpu,
+              const CPU_Stage *stage, int address)
+{
+    if (address < 0 || address >= DATA_MEMORY_SIZE)
+    {
+        report(golden, cpu, stage);
+        fprintf(stderr,
+                "APEX_Error:   data memory address %d is out of range\n",
+                address);
+        return -1;
+    }
+    return 0;
+}
+
+static int
+check_register(const APEX_Golden *golden, const APEX_CPU *cpu,
+               const CPU_Stage *stage, int reg)
+{
+    if (cpu->regs[reg] != golden->regs[reg])
+    {
+        report(golden, cpu, stage);
+        fprintf(stderr, "APEX_Error:   R%d pipeline %d, golden model %d\n",
+                reg, cpu->regs[reg], golden->regs[reg]);
+        return -1;
+    }
+    return 0;
+}
+
+static int
+check_vector_register(const APEX_Golden *golden, const APEX_CPU *cpu,
+                      const CPU_Stage *stage, int reg)
+{
+    int i;
+
+    for (i = 0; i < MAX_VECTOR_LENGTH; ++i)
+    {
+        if (cpu->vregs[reg][i] != golden->vregs[reg][i])
+        {
+            report(golden, cpu, stage);
+            fprintf(stderr,
+                    "APEX_Error:   V%d lane %d pipeline %d, golden model %d\n",
+                    reg, i, cpu->vregs[reg][i], golden->vregs[reg][i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Full comparison once the program has finished */
+static int
+check_final_state(const APEX_Golden *golden, const APEX_CPU *cpu,
+                  const CPU_Stage *stage)
+{
+    int i;
+
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        if (check_register(golden, cpu, stage, i))
+        {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < VEC_REG_FILE_SIZE; ++i)
+    {
+        if (check_vector_register(golden, cpu, stage, i))
+        {
+            return -1;
+        }
+    }
+
+    if (cpu->zero_flag != golden->zero_flag || cpu->pos_flag != golden->pos_flag
+        || cpu->neg_flag != golden->neg_flag)
+    {
+        report(golden, cpu, stage);
+        fprintf(stderr,
+                "APEX_Error:   flags Z=%d P=%d N=%d pipeline, Z=%d P=%d N=%d "
+                "golden model\n",
+                cpu->zero_flag, cpu->pos_flag, cpu->neg_flag,
+                golden->zero_flag, golden->pos_flag, golden->neg_flag);
+        return -1;
+    }
+
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        if (cpu->data_memory[i] != golden->data_memory[i])
+        {
+            report(golden, cpu, stage);
+            fprintf(stderr,
+                    "APEX_Error:   M[%d] pipeline %d, golden model %d\n", i,
+                    cpu->data_memory[i], golden->data_memory[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Executes the instruction the pipeline should be retiring as stage and
+ * compares the results. Call after writeback updated the register file.
+ * Returns 0 while the two agree, -1 after reporting a divergence.
+ */
+int
+APEX_golden_retire(APEX_Golden *golden, const APEX_CPU *cpu,
+                   const CPU_Stage *stage)
+{
+    const APEX_Instruction *insn = NULL;
+    const CPU_Lanes *lanes;
+    int index, next_pc, address = 0, taken = FALSE;
+    int rd_written = FALSE, base_written = FALSE, stored = FALSE;
+    int vector_written = FALSE, vector_stored = FALSE;
+    int length = cpu->config.vector_length;
+    unsigned int sum;
+    int a, b, i;
+
+    /* NOPs never reach writeback */
+    while (!golden->halted)
+    {
+        index = PC_TO_CODE_INDEX(golden->pc);
+        if (golden->pc % 4 || index < 0 || index >= cpu->code_memory_size)
+        {
+            insn = NULL;
+            break;
+        }
+
+        insn = &cpu->code_memory[index];
+        if (insn->opcode != OPCODE_NOP)
+        {
+            break;
+        }
+        golden->pc += 4;
+    }
+
+    if (golden->halted || !insn)
+    {
+        report(golden, cpu, stage);
+        fprintf(stderr, "APEX_Error:   golden model %s at pc(%d)\n",
+                golden->halted ? "already halted" : "ran off code memory",
+                golden->pc);
+        return -1;
+    }
+
+    if (stage->pc != golden->pc)
+    {
+        report(golden, cpu, stage);
+        fprintf(stderr, "APEX_Error:   golden model expected pc(%d)\n",
+                golden->pc);
+        return -1;
+    }
+
+    a = golden->regs[insn->rs1];
+    b = golden->regs[insn->rs2];
+    next_pc = golden->pc + 4;
+
+    switch (insn->opcode)
+    {
+        /* Sums and differences wrap, as in the pipeline */
+        case OPCODE_ADD:
+            golden->regs[insn->rd] = (int)((unsigned int)a + (unsigned int)b);
+            set_flags(golden, golden->regs[insn->rd]);
+            rd_written = TRUE;
+            break;
+
+        case OPCODE_ADDL:
+            golden->regs[insn->rd]
+                = (int)((unsigned int)a + (unsigned int)insn->imm);
+            set_flags(golden, golden->regs[insn->rd]);
+            rd_written = TRUE;
+            break;
+
+        case OPCODE_SUB:
+            golden->regs[insn->rd] = (int)((unsigned int)a - (unsigned int)b);
+            set_flags(golden, golden->regs[insn->rd]);
+            rd_written = TRUE;
+            break;
+
+        case OPCODE_SUBL:
+            golden->regs[insn->rd]
+                = (int)((unsigned int)a - (unsigned int)insn->imm);
+            set_flags(golden, golden->regs[insn->rd]);
+            rd_written = TRUE;
+            break;
+
+        case OPCODE_MUL:
+            golden->regs[insn->rd] = (int)((unsigned int)a * (unsigned int)b);
+            set_flags(golden, golden->regs[insn->rd]);
+            rd_written = TRUE;
+            break;
+
+        case OPCODE_DIV:
+            /* Division by zero yields zero and INT_MIN / -1 wraps, as in the
+             * pipeline */
+            golden->regs[insn->rd]
+                = b == 0 ? 0 : b == -1 ? (int)(0u - (unsigned int)a) : a / b;
+            set_flags(golden, golden->regs[insn->rd]);
+            rd_written = TRUE;
+            break;
+
+        case OPCODE_AND:
+            golden->regs[insn->rd] = a & b;
+            golden->zero_flag = ((a & b) == 0);
+            rd_written = TRUE;
+            break;
+
+        case OPCODE_OR:
+            golden->regs[insn->rd] = a | b;
+            rd_written = TRUE;
+            break;
+
+        case OPCODE_XOR:
+            golden->regs[insn->rd] = a ^ b;
+            rd_written = TRUE;
+            break;
+
+        case OPCODE_MOVC:
+            golden->regs[insn->rd] = insn->imm;
+            golden->zero_flag = (insn->imm == 0);
+            rd_written = TRUE;
+            break;
+
+        case OPCODE_CMP:
+            set_flags(golden, (a > b) - (a < b));
+            break;
+
+        case OPCODE_CML:
+            set_flags(golden, (a > insn->imm) - (a < insn->imm));
+            break;
+
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+            address = a + insn->imm;
+            if (check_address(golden, cpu, stage, address))
+            {
+                return -1;
+            }
+
+            /* The post-incremented base is written before rd */
+            if (insn->opcode == OPCODE_LOADP)
+            {
+                golden->regs[insn->rs1] = a + 4;
+                base_written = TRUE;
+            }
+            golden->regs[insn->rd] = golden->data_memory[address];
+            rd_written = TRUE;
+            break;
+
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+            address = a + insn->imm;
+            if (check_address(golden, cpu, stage, address))
+            {
+                return -1;
+            }
+
+            golden->data_memory[address] = b;
+            stored = TRUE;
+            if (insn->opcode == OPCODE_STOREP)
+            {
+                golden->regs[insn->rs1] = a + 4;
+                base_written = TRUE;
+            }
+            break;
+
+        case OPCODE_BZ:
+            taken = golden->zero_flag;
+            break;
+
+        case OPCODE_BNZ:
+            taken = !golden->zero_flag;
+            break;
+
+        case OPCODE_BP:
+            taken = golden->pos_flag;
+            break;
+
+        case OPCODE_BNP:
+            taken = !golden->pos_flag;
+            break;
+
+        case OPCODE_BN:
+            taken = golden->neg_flag;
+            break;
+
+        case OPCODE_BNN:
+            taken = !golden->neg_flag;
+            break;
+
+        case OPCODE_JUMP:
+            next_pc = a + insn->imm;
+            break;
+
+        case OPCODE_JALR:
+            golden->regs[insn->rd] = golden->pc + 4;
+            rd_written = TRUE;
+            next_pc = a + insn->imm;
+            break;
+
+        case OPCODE_VLOAD:
+        case OPCODE_VSTORE:
+            address = a + insn->imm;
+            if (check_address(golden, cpu, stage, address)
+                || check_address(golden, cpu, stage, address + 4 * (length - 1)))
+            {
+                return -1;
+            }
+
+            for (i = 0; i < MAX_VECTOR_LENGTH; ++i)
+            {
+                if (insn->opcode == OPCODE_VSTORE)
+                {
+                    if (i < length)
+                    {
+                        golden->data_memory[address + 4 * i]
+                            = golden->vregs[insn->rs2][i];
+                    }
+                }
+                else
+                {
+                    golden->vregs[insn->rd][i]
+                        = i < length ? golden->data_memory[address + 4 * i] : 0;
+                }
+            }
+            vector_written = (insn->opcode == OPCODE_VLOAD);
+            vector_stored = (insn->opcode == OPCODE_VSTORE);
+            break;
+
+        case OPCODE_VADD:
+        case OPCODE_VMUL:
+            for (i = 0; i < MAX_VECTOR_LENGTH; ++i)
+            {
+                a = golden->vregs[insn->rs1][i];
+                b = golden->vregs[insn->rs2][i];
+                golden->vregs[insn->rd][i]
+                    = insn->opcode == OPCODE_VADD
+                          ? (int)((unsigned int)a + (unsigned int)b)
+                          : (int)((unsigned int)a * (unsigned int)b);
+            }
+            vector_written = TRUE;
+            break;
+
+        case OPCODE_VRED:
+            sum = 0;
+            for (i = 0; i < MAX_VECTOR_LENGTH; ++i)
+            {
+                sum += (unsigned int)golden->vregs[insn->rs1][i];
+            }
+            golden->regs[insn->rd] = (int)sum;
+            rd_written = TRUE;
+            break;
+
+        case OPCODE_HALT:
+            golden->halted = TRUE;
+            break;
+    }
+
+    if (taken)
+    {
+        next_pc = golden->pc + insn->imm;
+    }
+
+    golden->pc = next_pc;
+    golden->retired++;
+
+    if (stored
+        && (stage->memory_address != address || stage->result_buffer != b))
+    {
+        report(golden, cpu, stage);
+        fprintf(stderr,
+                "APEX_Error:   stored M[%d] = %d, golden model M[%d] = %d\n",
+                stage->memory_address, stage->result_buffer, address, b);
+        return -1;
+    }
+
+    if (vector_stored)
+    {
+        lanes = INSN_LANES(cpu, stage);
+        for (i = 0; i < length; ++i)
+        {
+            if (stage->memory_address != address
+                || lanes->vresult[i] != golden->vregs[insn->rs2][i])
+            {
+                report(golden, cpu, stage);
+                fprintf(stderr,
+                        "APEX_Error:   stored M[%d] = %d, golden model M[%d] "
+                        "= %d\n",
+                        stage->memory_address + 4 * i, lanes->vresult[i],
+                        address + 4 * i, golden->vregs[insn->rs2][i]);
+                return -1;
+            }
+        }
+    }
+
+    if ((base_written && check_register(golden, cpu, stage, insn->rs1))
+        || (rd_written && check_register(golden, cpu, stage, insn->rd))
+        || (vector_written
+            && check_vector_register(golden, cpu, stage, insn->rd)))
+    {
+        return -1;
+    }
+
+    if (golden->halted)
+    {
+        return check_final_state(golden, cpu, stage);
+    }
+
+    return 0;
+}
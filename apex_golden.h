@@ -0,0 +1,33 @@
+/*
+ * apex_golden.h
+ * Functional reference model run in lockstep with the pipeline
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_GOLDEN_H_
+#define _APEX_GOLDEN_H_
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+typedef struct APEX_Golden
+{
+    int pc;
+    int regs[REG_FILE_SIZE];
+    int vregs[VEC_REG_FILE_SIZE][MAX_VECTOR_LENGTH];
+    int data_memory[DATA_MEMORY_SIZE];
+    int zero_flag;
+    int pos_flag;
+    int neg_flag;
+    int halted;
+    unsigned long long retired;   /* Instructions executed, NOPs excluded */
+} APEX_Golden;
+
+APEX_Golden *APEX_golden_create(const APEX_CPU *cpu);
+void APEX_golden_free(APEX_Golden *golden);
+int APEX_golden_retire(APEX_Golden *golden, const APEX_CPU *cpu,
+                       const CPU_Stage *stage);
+
+#endif
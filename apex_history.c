@@ -0,0 +1,194 @@
+/*
+ * apex_history.c
+ * The simulator is deterministic, so any earlier cycle can be rebuilt by
+ * copying the nearest older snapshot of the whole APEX_CPU back in and
+ * simulating forward from there. A snapshot is taken every interval cycles.
+ * When the memory bound is reached every other snapshot is dropped and the
+ * interval doubles, so all of the run stays reachable and rebuilding a cycle
+ * never replays more than one interval.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_history.h"
+
+APEX_History *
+APEX_history_create(int interval, int megabytes)
+{
+    APEX_History *history;
+    long long capacity;
+
+    if (interval <= 0)
+    {
+        return NULL;
+    }
+
+    history = calloc(1, sizeof(APEX_History));
+    if (!history)
+    {
+        return NULL;
+    }
+
+    capacity = ((long long)megabytes << 20) / sizeof(APEX_CPU);
+    history->capacity = capacity < 2 ? 2 : (int)capacity;
+    history->interval = interval;
+    history->next_cycle = 0;
+    history->snapshots = malloc((size_t)history->capacity * sizeof(APEX_CPU));
+    if (!history->snapshots)
+    {
+        free(history);
+        return NULL;
+    }
+
+    return history;
+}
+
+void
+APEX_history_free(APEX_History *history)
+{
+    if (history)
+    {
+        free(history->snapshots);
+        free(history);
+    }
+}
+
+/* Appends a snapshot of cpu, thinning the history first when it is full */
+void
+APEX_history_save(APEX_History *history, const APEX_CPU *cpu)
+{
+    int i;
+
+    /* Replaying after a reverse step passes existing snapshots again */
+    if (history->count
+        && cpu->clock <= history->snapshots[history->count - 1].clock)
+    {
+        return;
+    }
+
+    if (history->count == history->capacity)
+    {
+        for (i = 0; 2 * i < history->count; ++i)
+        {
+            history->snapshots[i] = history->snapshots[2 * i];
+        }
+        history->count = i;
+        history->interval *= 2;
+    }
+
+    history->snapshots[history->count++] = *cpu;
+    history->next_cycle = cpu->clock + history->interval;
+}
+
+/* Index of the newest snapshot taken at or before cycle, -1 if none */
+int
+APEX_history_find(const APEX_History *history, int cycle)
+{
+    int lo = 0, hi = history->count - 1, mid, found = -1;
+
+    while (lo <= hi)
+    {
+        mid = (lo + hi) / 2;
+        if (history->snapshots[mid].clock <= cycle)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+
+    return found;
+}
+
+/*
+ * Copies snapshot index into cpu, keeping the profile, trace, interval
+ * statistics, branch profile, golden model and flight recorder attached to
+ * cpu now
+ */
+void
+APEX_history_load(const APEX_History *history, int index, APEX_CPU *cpu)
+{
+    struct APEX_Profile *profile = cpu->profile;
+    struct APEX_Trace *trace = cpu->trace;
+    struct APEX_Interval *interval = cpu->interval;
+    struct APEX_Warm *warm = cpu->warm;
+    struct APEX_Golden *golden = cpu->golden;
+    struct APEX_Recorder *recorder = cpu->recorder;
+
+    *cpu = history->snapshots[index];
+    cpu->profile = profile;
+    cpu->trace = trace;
+    cpu->interval = interval;
+    cpu->warm = warm;
+    cpu->golden = golden;
+    cpu->recorder = recorder;
+}
+
+/*
+ * Rebuilds the state at the start of cycle. The profile, trace, interval
+ * statistics, branch profile and flight recorder are not charged for the
+ * replayed cycles. Returns -1 when cycle predates the history.
+ */
+int
+APEX_history_goto(const APEX_History *history, APEX_CPU *cpu, int cycle)
+{
+    APEX_Replay replay;
+    int index = APEX_history_find(history, cycle);
+
+    if (index < 0)
+    {
+        return -1;
+    }
+
+    APEX_history_detach(cpu, &replay);
+    APEX_history_load(history, index, cpu);
+    while (cpu->clock < cycle)
+    {
+        if (APEX_cpu_step(cpu))
+        {
+            break;
+        }
+    }
+
+    APEX_history_attach(cpu, &replay);
+    return 0;
+}
+
+/*
+ * Takes the profile, trace, interval statistics, branch profile and flight
+ * recorder off cpu into replay before cycles already run are simulated
+ * again. Every replay goes through here, so none of them is charged twice.
+ */
+void
+APEX_history_detach(APEX_CPU *cpu, APEX_Replay *replay)
+{
+    replay->profile = cpu->profile;
+    replay->trace = cpu->trace;
+    replay->interval = cpu->interval;
+    replay->warm = cpu->warm;
+    replay->recorder = cpu->recorder;
+    cpu->profile = NULL;
+    cpu->trace = NULL;
+    cpu->interval = NULL;
+    cpu->warm = NULL;
+    cpu->recorder = NULL;
+}
+
+/* Puts back what APEX_history_detach() took off cpu */
+void
+APEX_history_attach(APEX_CPU *cpu, const APEX_Replay *replay)
+{
+    cpu->profile = replay->profile;
+    cpu->trace = replay->trace;
+    cpu->interval = replay->interval;
+    cpu->warm = replay->warm;
+    cpu->recorder = replay->recorder;
+}
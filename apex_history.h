@@ -0,0 +1,54 @@
+/*
+ * apex_history.h
+ * Periodic cpu snapshots that let the debugger go back in time
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_HISTORY_H_
+#define _APEX_HISTORY_H_
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+typedef struct APEX_History
+{
+    APEX_CPU *snapshots;          /* Oldest first, clocks strictly increasing */
+    int count;
+    int capacity;                 /* Snapshots that fit the memory bound */
+    int interval;                 /* Cycles between snapshots, doubles when full */
+    int next_cycle;               /* Clock at which the next snapshot is due */
+} APEX_History;
+
+/* What a replay detaches from the cpu so that cycles simulated again are
+ * not charged twice, see APEX_history_detach() */
+typedef struct APEX_Replay
+{
+    struct APEX_Profile *profile;
+    struct APEX_Trace *trace;
+    struct APEX_Interval *interval;
+    struct APEX_Warm *warm;
+    struct APEX_Recorder *recorder;
+} APEX_Replay;
+
+APEX_History *APEX_history_create(int interval, int megabytes);
+void APEX_history_free(APEX_History *history);
+void APEX_history_save(APEX_History *history, const APEX_CPU *cpu);
+int APEX_history_find(const APEX_History *history, int cycle);
+void APEX_history_load(const APEX_History *history, int index, APEX_CPU *cpu);
+int APEX_history_goto(const APEX_History *history, APEX_CPU *cpu, int cycle);
+void APEX_history_detach(APEX_CPU *cpu, APEX_Replay *replay);
+void APEX_history_attach(APEX_CPU *cpu, const APEX_Replay *replay);
+
+/* Takes a snapshot when one is due, called before every simulated cycle */
+static inline void
+APEX_history_record(APEX_History *history, const APEX_CPU *cpu)
+{
+    if (cpu->clock >= history->next_cycle)
+    {
+        APEX_history_save(history, cpu);
+    }
+}
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * apex_icache.c
+ * Instruction cache timing model. Only tags are kept, instructions always
+ * come from code memory. A set-associative cache of icache_sets sets,
+ * icache_ways ways and icache_line instructions per line, replaced LRU. A
+ * miss fills its line icache_latency cycles later, a line being filled is
+ * a hit that waits for the rest of the fill. With no sets every access hits.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_icache.h"
+
+void
+APEX_icache_init(APEX_ICache *icache)
+{
+    int i;
+
+    for (i = 0; i < MAX_ICACHE_SETS * MAX_ICACHE_WAYS; ++i)
+    {
+        icache->lines[i].tag = -1;
+        icache->lines[i].ready_cycle = 0;
+        icache->lines[i].last_use = 0;
+    }
+    icache->uses = 0;
+}
+
+/*
+ * Finds the line holding pc, filling it when absent. Returns the line and
+ * sets *miss when it had to be filled.
+ */
+static ICache_Line *
+lookup(APEX_CPU *cpu, int pc, int *miss)
+{
+    APEX_ICache *icache = &cpu->icache;
+    ICache_Line *set, *victim;
+    int tag = PC_TO_CODE_INDEX(pc) / cpu->config.icache_line;
+    int i;
+
+    set = &icache->lines[(tag % cpu->config.icache_sets)
+                         * cpu->config.icache_ways];
+    victim = &set[0];
+    icache->uses++;
+    for (i = 0; i < cpu->config.icache_ways; ++i)
+    {
+        if (set[i].tag == tag)
+        {
+            set[i].last_use = icache->uses;
+            *miss = FALSE;
+            return &set[i];
+        }
+
+        if (set[i].last_use < victim->last_use)
+        {
+            victim = &set[i];
+        }
+    }
+
+    victim->tag = tag;
+    victim->ready_cycle = cpu->clock + cpu->config.icache_latency;
+    victim->last_use = icache->uses;
+    *miss = TRUE;
+    return victim;
+}
+
+/* Returns the cycle the instruction at pc can be fetched, clock on a hit */
+int
+APEX_icache_access(APEX_CPU *cpu, int pc)
+{
+    ICache_Line *line;
+    int miss;
+
+    if (!cpu->config.icache_sets)
+    {
+        return cpu->clock;
+    }
+
+    line = lookup(cpu, pc, &miss);
+    cpu->stats.ic_accesses++;
+    if (miss)
+    {
+        cpu->stats.ic_misses++;
+    }
+    return line->ready_cycle > cpu->clock ? line->ready_cycle : cpu->clock;
+}
+
+/* Starts filling the line holding pc ahead of fetch */
+void
+APEX_icache_prefetch(APEX_CPU *cpu, int pc)
+{
+    int miss;
+
+    if (!cpu->config.icache_sets)
+    {
+        return;
+    }
+
+    lookup(cpu, pc, &miss);
+    if (miss)
+    {
+        cpu->stats.ic_prefetches++;
+    }
+}
@@ -0,0 +1,19 @@
+/*
+ * apex_icache.h
+ * Instruction cache timing model
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_ICACHE_H_
+#define _APEX_ICACHE_H_
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+void APEX_icache_init(APEX_ICache *icache);
+int APEX_icache_access(APEX_CPU *cpu, int pc);
+void APEX_icache_prefetch(APEX_CPU *cpu, int pc);
+
+#endif
@@ -0,0 +1,303 @@
+/*
+ * apex_interval.c
+ * Interval statistics. Every period cycles the changes of the event counters
+ * since the last sample go into a ring; the ring is written out when it
+ * fills up and at least every INTERVAL_FLUSH_SECONDS, as CSV rows and as a
+ * Prometheus textfile. The textfile holds the running totals and the last
+ * interval, and is replaced atomically so that the node exporter never reads
+ * half of it. Sampling is a copy of the counters per interval and a compare
+ * per cycle.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_interval.h"
+
+static const char *stall_classes[] = {"raw", "exec", "mem", "flush", "fetch"};
+
+/* Copies program into a Prometheus label value, escaping it */
+static char *
+escape_label(const char *program)
+{
+    char *label = malloc(2 * strlen(program) + 1);
+    char *p = label;
+
+    if (!label)
+    {
+        return NULL;
+    }
+
+    for (; *program; ++program)
+    {
+        if (*program == '\\' || *program == '"')
+        {
+            *p++ = '\\';
+            *p++ = *program;
+        }
+        else if (*program == '\n')
+        {
+            *p++ = '\\';
+            *p++ = 'n';
+        }
+        else
+        {
+            *p++ = *program;
+        }
+    }
+    *p = '\0';
+    return label;
+}
+
+APEX_Interval *
+APEX_interval_open(int period, const char *csv_file, const char *prom_file,
+                   const char *program)
+{
+    APEX_Interval *interval = calloc(1, sizeof(APEX_Interval));
+
+    if (!interval)
+    {
+        return NULL;
+    }
+
+    interval->period = period;
+    interval->next_cycle = period;
+    interval->flushed = time(NULL);
+    interval->program = escape_label(program);
+    if (prom_file)
+    {
+        interval->prom_file = malloc(strlen(prom_file) + 1);
+        if (interval->prom_file)
+        {
+            strcpy(interval->prom_file, prom_file);
+        }
+    }
+
+    if (csv_file)
+    {
+        interval->csv = strcmp(csv_file, "-") ? fopen(csv_file, "w") : stdout;
+    }
+
+    if (!interval->program || (prom_file && !interval->prom_file)
+        || (csv_file && !interval->csv))
+    {
+        APEX_interval_close(interval, NULL);
+        return NULL;
+    }
+
+    if (interval->csv)
+    {
+        fprintf(interval->csv,
+                "cycle,cycles,instructions,ipc,raw_frac,exec_frac,mem_frac,"
+                "flush_frac,fetch_frac,branches,mispredicts,mispredict_rate,"
+                "sb_forwards,pf_useful,ic_misses\n");
+    }
+    return interval;
+}
+
+static double
+stall_cycles(const Interval_Sample *s, int c)
+{
+    const unsigned long long counts[] = {s->raw_stalls, s->exec_stalls,
+                                         s->mem_stalls, s->flush_bubbles,
+                                         s->fetch_bubbles};
+
+    return (double)counts[c];
+}
+
+static void
+write_csv(const APEX_Interval *interval, const Interval_Sample *s)
+{
+    double cycles = s->cycles ? (double)s->cycles : 1.0;
+    int c;
+
+    fprintf(interval->csv, "%d,%d,%d,%.4f", s->cycle, s->cycles,
+            s->instructions, s->instructions / cycles);
+    for (c = 0; c < 5; ++c)
+    {
+        fprintf(interval->csv, ",%.4f", stall_cycles(s, c) / cycles);
+    }
+    fprintf(interval->csv, ",%llu,%llu,%.4f,%llu,%llu,%llu\n", s->branches,
+            s->mispredicts,
+            s->branches ? (double)s->mispredicts / s->branches : 0.0,
+            s->sb_forwards, s->pf_useful, s->ic_misses);
+}
+
+static void
+write_header(FILE *fp, const char *name, const char *type, const char *help)
+{
+    fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/* Rewrites the textfile with the totals of cpu and the last sample s */
+static void
+write_prom(const APEX_Interval *interval, const APEX_CPU *cpu,
+           const Interval_Sample *s)
+{
+    const APEX_Stats *t = &cpu->stats;
+    const unsigned long long totals[] = {t->raw_stalls, t->exec_stalls,
+                                         t->mem_stalls, t->flush_bubbles,
+                                         t->fetch_bubbles};
+    const char *p = interval->program;
+    double cycles = s->cycles ? (double)s->cycles : 1.0;
+    char tmp[4096];
+    FILE *fp;
+    int c;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", interval->prom_file);
+    fp = fopen(tmp, "w");
+    if (!fp)
+    {
+        return;
+    }
+
+    write_header(fp, "apex_cycles_total", "counter", "Cycles simulated");
+    fprintf(fp, "apex_cycles_total{program=\"%s\"} %d\n", p, cpu->clock);
+    write_header(fp, "apex_instructions_total", "counter",
+                 "Instructions retired");
+    fprintf(fp, "apex_instructions_total{program=\"%s\"} %d\n", p,
+            cpu->insn_completed);
+    write_header(fp, "apex_branches_total", "counter",
+                 "Conditional branches executed");
+    fprintf(fp, "apex_branches_total{program=\"%s\"} %llu\n", p, t->branches);
+    write_header(fp, "apex_mispredicts_total", "counter",
+                 "Branch mispredictions");
+    fprintf(fp, "apex_mispredicts_total{program=\"%s\"} %llu\n", p,
+            t->mispredicts);
+    write_header(fp, "apex_stall_cycles_total", "counter",
+                 "Cycles lost by class");
+    for (c = 0; c < 5; ++c)
+    {
+        fprintf(fp, "apex_stall_cycles_total{program=\"%s\",class=\"%s\"} %llu\n",
+                p, stall_classes[c], totals[c]);
+    }
+
+    write_header(fp, "apex_interval_ipc", "gauge",
+                 "Instructions per cycle over the last interval");
+    fprintf(fp, "apex_interval_ipc{program=\"%s\"} %.4f\n", p,
+            s->instructions / cycles);
+    write_header(fp, "apex_interval_stall_fraction", "gauge",
+                 "Share of the last interval lost by class");
+    for (c = 0; c < 5; ++c)
+    {
+        fprintf(fp,
+                "apex_interval_stall_fraction{program=\"%s\",class=\"%s\"} "
+                "%.4f\n",
+                p, stall_classes[c], stall_cycles(s, c) / cycles);
+    }
+    write_header(fp, "apex_interval_mispredict_rate", "gauge",
+                 "Mispredicted share of the branches in the last interval");
+    fprintf(fp, "apex_interval_mispredict_rate{program=\"%s\"} %.4f\n", p,
+            s->branches ? (double)s->mispredicts / s->branches : 0.0);
+    write_header(fp, "apex_halted", "gauge", "1 once HALT has retired");
+    fprintf(fp, "apex_halted{program=\"%s\"} %d\n", p, cpu->halted);
+
+    if (fclose(fp) == 0)
+    {
+        rename(tmp, interval->prom_file);
+    }
+}
+
+/* Writes out the unwritten samples and refreshes the textfile */
+static void
+flush_samples(APEX_Interval *interval, const APEX_CPU *cpu)
+{
+    int i;
+
+    if (!interval->last_cycle)
+    {
+        return;
+    }
+
+    if (interval->csv)
+    {
+        for (i = 0; i < interval->count; ++i)
+        {
+            write_csv(interval,
+                      &interval->ring[(interval->head + i) % INTERVAL_RING_SIZE]);
+        }
+        fflush(interval->csv);
+    }
+
+    if (interval->prom_file)
+    {
+        write_prom(interval, cpu,
+                   &interval->ring[(interval->head + interval->count
+                                    + INTERVAL_RING_SIZE - 1)
+                                   % INTERVAL_RING_SIZE]);
+    }
+
+    interval->head = (interval->head + interval->count) % INTERVAL_RING_SIZE;
+    interval->count = 0;
+    interval->flushed = time(NULL);
+}
+
+/* Records the interval that ends at the current clock */
+void
+APEX_interval_sample(APEX_Interval *interval, const APEX_CPU *cpu)
+{
+    const APEX_Stats *now = &cpu->stats, *last = &interval->last;
+    Interval_Sample *s;
+
+    interval->next_cycle = cpu->clock + interval->period;
+    if (cpu->clock <= interval->last_cycle)
+    {
+        return;
+    }
+
+    s = &interval->ring[(interval->head + interval->count) % INTERVAL_RING_SIZE];
+    interval->count++;
+    s->cycle = cpu->clock;
+    s->cycles = cpu->clock - interval->last_cycle;
+    s->instructions = cpu->insn_completed - interval->last_insns;
+    s->raw_stalls = now->raw_stalls - last->raw_stalls;
+    s->exec_stalls = now->exec_stalls - last->exec_stalls;
+    s->mem_stalls = now->mem_stalls - last->mem_stalls;
+    s->flush_bubbles = now->flush_bubbles - last->flush_bubbles;
+    s->fetch_bubbles = now->fetch_bubbles - last->fetch_bubbles;
+    s->branches = now->branches - last->branches;
+    s->mispredicts = now->mispredicts - last->mispredicts;
+    s->sb_forwards = now->sb_forwards - last->sb_forwards;
+    s->pf_useful = now->pf_useful - last->pf_useful;
+    s->ic_misses = now->ic_misses - last->ic_misses;
+
+    interval->last_cycle = cpu->clock;
+    interval->last_insns = cpu->insn_completed;
+    interval->last = *now;
+
+    if (interval->count == INTERVAL_RING_SIZE
+        || time(NULL) - interval->flushed >= INTERVAL_FLUSH_SECONDS)
+    {
+        flush_samples(interval, cpu);
+    }
+}
+
+/* Records the last, partial interval of cpu and writes everything out.
+ * cpu may be NULL to just release interval */
+void
+APEX_interval_close(APEX_Interval *interval, const APEX_CPU *cpu)
+{
+    if (!interval)
+    {
+        return;
+    }
+
+    if (cpu)
+    {
+        APEX_interval_sample(interval, cpu);
+        flush_samples(interval, cpu);
+    }
+
+    if (interval->csv && interval->csv != stdout)
+    {
+        fclose(interval->csv);
+    }
+    free(interval->prom_file);
+    free(interval->program);
+    free(interval);
+}
@@ -0,0 +1,76 @@
+/*
+ * apex_interval.h
+ * Interval statistics: periodic samples of the event counters written as
+ * CSV and as a Prometheus node-exporter textfile
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_INTERVAL_H_
+#define _APEX_INTERVAL_H_
+
+#include <stdio.h>
+#include <time.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Default cycles between samples */
+#define INTERVAL_CYCLES 10000
+
+/* Samples held until written; the sinks are also written once this many
+ * seconds have passed so that long runs can be watched live */
+#define INTERVAL_RING_SIZE 64
+#define INTERVAL_FLUSH_SECONDS 1
+
+/* Counter changes over one interval */
+typedef struct Interval_Sample
+{
+    int cycle;                    /* Clock at the end of the interval */
+    int cycles;                   /* Length of the interval */
+    int instructions;
+    unsigned long long raw_stalls;
+    unsigned long long exec_stalls;
+    unsigned long long mem_stalls;
+    unsigned long long flush_bubbles;
+    unsigned long long fetch_bubbles;
+    unsigned long long branches;
+    unsigned long long mispredicts;
+    unsigned long long sb_forwards;
+    unsigned long long pf_useful;
+    unsigned long long ic_misses;
+} Interval_Sample;
+
+typedef struct APEX_Interval
+{
+    int period;                   /* Cycles between samples */
+    int next_cycle;               /* Clock of the next sample */
+    int last_cycle;               /* Clock and counters of the last sample */
+    int last_insns;
+    APEX_Stats last;
+    FILE *csv;                    /* NULL when not written */
+    char *prom_file;              /* NULL when not written */
+    char *program;                /* Label of the Prometheus metrics */
+    time_t flushed;               /* Wall clock of the last write */
+    int head;                     /* Oldest unwritten sample */
+    int count;
+    Interval_Sample ring[INTERVAL_RING_SIZE];
+} APEX_Interval;
+
+APEX_Interval *APEX_interval_open(int period, const char *csv_file,
+                                  const char *prom_file, const char *program);
+void APEX_interval_sample(APEX_Interval *interval, const APEX_CPU *cpu);
+void APEX_interval_close(APEX_Interval *interval, const APEX_CPU *cpu);
+
+/* Takes a sample when cpu has reached the end of the interval */
+static inline void
+APEX_interval_tick(APEX_Interval *interval, const APEX_CPU *cpu)
+{
+    if (cpu->clock >= interval->next_cycle)
+    {
+        APEX_interval_sample(interval, cpu);
+    }
+}
+
+#endif
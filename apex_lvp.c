@@ -0,0 +1,97 @@
+/*
+ * apex_lvp.c
+ * Load value predictor. A direct-mapped table of lvp_size entries, tagged
+ * with the pc of a LOAD/LOADP, remembers the last value the load read and
+ * the difference to the one before. Decode looks every load up as it
+ * leaves for execute:
+ *
+ *   last    guesses the last value again
+ *   stride  guesses the last value plus the difference, once more for each
+ *           older instance of the load still in flight
+ *
+ * The guess is kept with the load and compared with the real value when
+ * memory completes the load. Each entry counts the correct guesses in a
+ * row, a wrong one starts it over, and dependents only get the guess once
+ * the count has reached lvp_confidence.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include "apex_cpu.h"
+#include "apex_lvp.h"
+
+void
+APEX_lvp_init(APEX_Value_Predictor *lvp)
+{
+    int i;
+
+    for (i = 0; i < MAX_LVP_SIZE; ++i)
+    {
+        lvp->table[i].pc = -1;
+        lvp->table[i].last_value = 0;
+        lvp->table[i].stride = 0;
+        lvp->table[i].confidence = 0;
+    }
+    lvp->replay_cycle = -1;
+}
+
+/*
+ * Guesses the value the load at pc reads, ahead instances after the last
+ * one that completed. Returns TRUE when the guess is confident enough to
+ * hand to dependents.
+ */
+int
+APEX_lvp_predict(const APEX_CPU *cpu, int pc, int ahead, int *guess)
+{
+    const LVP_Entry *entry
+        = &cpu->lvp.table[(pc / 4) % cpu->config.lvp_size];
+
+    if (entry->pc != pc)
+    {
+        *guess = 0;
+        return FALSE;
+    }
+
+    /* Guesses wrap like the loads' own arithmetic, computed as unsigned to
+     * keep the overflow defined */
+    *guess = entry->last_value;
+    if (cpu->config.value_predictor == LVP_STRIDE)
+    {
+        *guess = (int)((unsigned int)*guess
+                       + (unsigned int)entry->stride * (unsigned int)ahead);
+    }
+    return entry->confidence >= cpu->config.lvp_confidence;
+}
+
+/* Learns value, read by the load at pc for which the predictor guessed guess */
+void
+APEX_lvp_train(APEX_CPU *cpu, int pc, int value, int guess)
+{
+    LVP_Entry *entry = &cpu->lvp.table[(pc / 4) % cpu->config.lvp_size];
+
+    if (entry->pc != pc)
+    {
+        entry->pc = pc;
+        entry->last_value = value;
+        entry->stride = 0;
+        entry->confidence = 0;
+        return;
+    }
+
+    if (value == guess)
+    {
+        if (entry->confidence < LVP_CONFIDENCE_MAX)
+        {
+            entry->confidence++;
+        }
+    }
+    else
+    {
+        entry->confidence = 0;
+    }
+
+    entry->stride = (int)((unsigned int)value
+                          - (unsigned int)entry->last_value);
+    entry->last_value = value;
+}
@@ -0,0 +1,19 @@
+/*
+ * apex_lvp.h
+ * Load value predictor
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_LVP_H_
+#define _APEX_LVP_H_
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+void APEX_lvp_init(APEX_Value_Predictor *lvp);
+int APEX_lvp_predict(const APEX_CPU *cpu, int pc, int ahead, int *guess);
+void APEX_lvp_train(APEX_CPU *cpu, int pc, int value, int guess);
+
+#endif
@@ -15,6 +15,12 @@
 /* Integers */
 #define DATA_MEMORY_SIZE 4096
 
+/* Code memory starts at pc 4000, one instruction every 4 bytes; the same
+ * mapping as get_code_memory_index_from_pc() */
+#define CODE_START_PC 4000
+#define PC_TO_CODE_INDEX(pc) (((pc) - CODE_START_PC) / 4)
+#define CODE_INDEX_TO_PC(index) (CODE_START_PC + 4 * (index))
+
 /* Size of integer register file */
 #define REG_FILE_SIZE 16
 
@@ -45,8 +51,159 @@
 #define OPCODE_BN 0x17         // opcode for BN
 #define OPCODE_BNN 0x18        // opcode for BNN
 #define OPCODE_NOP 0x19        // opcode for NOP
+#define OPCODE_VLOAD 0x1a      /* Vd <- M[Rs1 + imm + 4i] */
+#define OPCODE_VSTORE 0x1b     /* M[Rs1 + imm + 4i] <- Vs2 */
+#define OPCODE_VADD 0x1c       /* Vd <- Vs1 + Vs2, lane by lane */
+#define OPCODE_VMUL 0x1d       /* Vd <- Vs1 * Vs2, lane by lane */
+#define OPCODE_VRED 0x1e       /* Rd <- sum of the lanes of Vs1 */
+#define NUM_OPCODES 0x1f
+
+/* Binary program files start with this tag, followed by the instruction
+ * count and then opcode, rd, rs1, rs2, imm of every instruction, all as
+ * 32-bit integers in host byte order */
+#define APEX_BINARY_MAGIC "APEXBIN1"
+#define APEX_BINARY_MAGIC_SIZE 8
+
+/* Vector extension: registers and lanes per register. vector_length sets
+ * the lanes in use at run time, lanes past it are always zero */
+#define VEC_REG_FILE_SIZE 16
+#define MAX_VECTOR_LENGTH 8
+#define VECTOR_LENGTH 4
+
+/* Default number of BTB entries, MAX_BTB_SIZE bounds the run time setting */
 #define BTB_SIZE 4
-BTB_Entry btb[BTB_SIZE];
+#define MAX_BTB_SIZE 64
+
+/* Branch predictor organisations that can be selected at run time */
+#define PREDICTOR_NONE 0x0    /* Static not-taken, BTB unused */
+#define PREDICTOR_HISTORY 0x1 /* Last two outcomes per BTB entry */
+#define PREDICTOR_BIMODAL 0x2 /* Two-bit saturating counter per BTB entry */
+
+/* Default functional unit latencies in cycles */
+#define MUL_LATENCY 1
+#define MEM_LATENCY 1
+#define VECTOR_LATENCY 2
+
+/* Store buffer entries, 0 for none: stores then write memory in the memory
+ * stage. MAX_STORE_BUFFER_SIZE bounds the run time setting */
+#define STORE_BUFFER_SIZE 0
+#define MAX_STORE_BUFFER_SIZE 16
+
+/* Data prefetchers that can be selected at run time */
+#define PREFETCH_NONE 0x0      /* No prefetching */
+#define PREFETCH_NEXT_LINE 0x1 /* Words following every access */
+#define PREFETCH_STRIDE 0x2    /* Per-pc reference prediction table */
+#define PREFETCH_STREAM 0x3    /* Stream buffers started on misses */
+
+/* Prefetched words waiting for a demand load, reference prediction table
+ * entries and stream buffers */
+#define PREFETCH_BUFFER_SIZE 32
+#define RPT_SIZE 16
+#define PREFETCH_STREAMS 4
+
+/* Default prefetch degree (words per trigger) and distance (how far ahead,
+ * in strides), MAX_* bound the run time settings */
+#define PREFETCH_DEGREE 1
+#define PREFETCH_DISTANCE 1
+#define MAX_PREFETCH_DEGREE 8
+#define MAX_PREFETCH_DISTANCE 16
+
+/* Instruction cache geometry, lines hold ICACHE_LINE instructions. The
+ * default of no sets is a perfect I-cache. MAX_* bound the run time
+ * settings */
+#define ICACHE_SETS 0
+#define ICACHE_WAYS 2
+#define ICACHE_LINE 4
+#define ICACHE_LATENCY 8
+#define MAX_ICACHE_SETS 64
+#define MAX_ICACHE_WAYS 8
+#define MAX_ICACHE_LINE 16
+
+/* Fetch queue between fetch and decode (0 for none, fetch then feeds decode
+ * directly) and the fetch target queue in front of the I-cache. The fetch
+ * queue ring also holds the instruction standing in for the fetch latch */
+#define FETCH_QUEUE_SIZE 0
+#define FTQ_SIZE 4
+#define MAX_FETCH_QUEUE_SIZE 16
+#define FETCH_QUEUE_RING (MAX_FETCH_QUEUE_SIZE + 1)
+
+/* Loop buffer entries, 0 for none, and the back-to-back taken back-edges
+ * that make a loop stream from it */
+#define LOOP_BUFFER_SIZE 0
+#define MAX_LOOP_BUFFER_SIZE 32
+#define LOOP_DETECT_ITERATIONS 2
+
+/* Load value predictors that can be selected at run time */
+#define LVP_NONE 0x0   /* Loads are never predicted */
+#define LVP_LAST 0x1   /* Last value loaded by each pc */
+#define LVP_STRIDE 0x2 /* Last value plus the last difference */
+
+/* Default value predictor entries and the confidence a prediction needs,
+ * confidence counts correct guesses in a row up to LVP_CONFIDENCE_MAX */
+#define LVP_SIZE 16
+#define LVP_CONFIDENCE 3
+#define MAX_LVP_SIZE 64
+#define LVP_CONFIDENCE_MAX 7
+
+/* Instruction pairs that can fuse into one micro-op, the bits of the fusion
+ * parameter */
+#define FUSE_NONE 0x0
+#define FUSE_CMP_BRANCH 0x1 /* CMP, CML or SUBL and a branch on its flags */
+#define FUSE_MOVC_ADD 0x2   /* MOVC and an ADD reading the constant */
+#define FUSE_ADDL_LOAD 0x4  /* ADDL and a LOAD based on its result */
+#define FUSE_ALL 0x7
+
+/* Stages conditional branches can resolve in */
+#define BRANCH_EXECUTE 0x0 /* Last execute sub-stage, against the flags */
+#define BRANCH_DECODE 0x1  /* Decode, once no older instruction can still
+                              set the flags or redirect fetch */
+
+/* Sub-stages of fetch, execute and memory. Each one past the first adds a
+ * cycle, and a latch, to the stage; MAX_SUB_STAGES bounds the run time
+ * settings */
+#define FETCH_STAGES 1
+#define EXECUTE_STAGES 1
+#define MEMORY_STAGES 1
+#define MAX_SUB_STAGES 4
+
+/* In-flight instruction records. The latches past fetch hold at most
+ * 4 + 3 * (MAX_SUB_STAGES - 1) slots, each with a fused pair at most, so a
+ * free one is never far away */
+#define INSN_RING_SIZE 32
+
+/* Cycle accounting classes. Every cycle either retires an instruction or
+ * retires a bubble, and each bubble remembers why it was created */
+#define CYCLE_RETIRE 0x0 /* An instruction retired */
+#define CYCLE_RAW 0x1    /* Decode waited on a RAW hazard */
+#define CYCLE_FLUSH 0x2  /* Wrong-path squash or redirect penalty */
+#define CYCLE_MEM 0x3    /* Multi-cycle memory access */
+#define CYCLE_EXEC 0x4   /* Multi-cycle execute unit */
+#define CYCLE_FETCH 0x5  /* Fetch delivered nothing (fill, NOP, end of code) */
+#define CYCLE_ICACHE 0x6 /* Fetch waited on an I-cache miss */
+#define NUM_CYCLE_CLASSES 7
+
+/* Set this flag to 1 to check every retirement against the golden model */
+#define ENABLE_COSIM 0
+
+/* Cycles without a retirement after which a run counts as hung */
+#define WATCHDOG_CYCLES 10000
+
+/* Failures that stop a run before HALT */
+#define FAIL_NONE 0x0
+#define FAIL_MEMORY 0x1    /* Data memory access out of range */
+#define FAIL_WATCHDOG 0x2  /* Nothing retired for watchdog cycles */
+
+/* Set this flag to 0 to always run the generic cycle loop instead of a
+ * matching specialised variant, see apex_variants.cfg */
+#define ENABLE_VARIANTS 1
+
+/* Debugger history for reverse execution: cycles between snapshots and the
+ * memory all snapshots together may use */
+#define SNAPSHOT_INTERVAL 1000
+#define HISTORY_MB 64
+
+/* Set this flag to 1 to forward results from execute/memory into decode */
+#define ENABLE_FORWARDING 1
 
 /* Set this flag to 1 to enable debug messages */
 #define ENABLE_DEBUG_MESSAGES 1
@@ -0,0 +1,228 @@
+/*
+ * apex_prefetch.c
+ * Data prefetchers. Data memory has no lines, every access moves one word,
+ * so prefetches are whole words: a prefetch issued at cycle c brings the
+ * word into the prefetch buffer at c + mem_latency. A LOAD/LOADP that finds
+ * its word there takes it out and waits only for what is left of that, at
+ * least one cycle, instead of the full mem_latency. There is no cache
+ * behind the buffer, so a word serves one load. Prefetches are assumed to
+ * use spare memory bandwidth.
+ *
+ * What triggers prefetches, for the word at address A:
+ *   next_line  every load prefetches A + 4 * (distance + i), i < degree
+ *   stride     a per-pc reference prediction table learns the stride s of
+ *              each load and, once steady, prefetches A + s * (distance + i)
+ *   stream     a miss starts a stream buffer heading away from the previous
+ *              miss; each load that continues a stream advances it by
+ *              degree words, distance words ahead
+ *
+ * The counters give accuracy (useful / issued), coverage (useful / loads)
+ * and timeliness (useful prefetches that did not keep the load waiting).
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_prefetch.h"
+
+void
+APEX_prefetch_init(APEX_Prefetcher *pf)
+{
+    int i;
+
+    memset(pf, 0, sizeof(*pf));
+    for (i = 0; i < PREFETCH_BUFFER_SIZE; ++i)
+    {
+        pf->buffer[i].address = -1;
+    }
+
+    for (i = 0; i < RPT_SIZE; ++i)
+    {
+        pf->rpt[i].pc = -1;
+    }
+    pf->last_miss = -1;
+}
+
+static int
+find_prefetch(const APEX_Prefetcher *pf, int address)
+{
+    int i;
+
+    for (i = 0; i < PREFETCH_BUFFER_SIZE; ++i)
+    {
+        if (pf->buffer[i].address == address)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void
+issue_prefetch(APEX_CPU *cpu, int address)
+{
+    APEX_Prefetcher *pf = &cpu->prefetcher;
+    Prefetch_Entry *entry;
+
+    if (address < 0 || address >= DATA_MEMORY_SIZE
+        || find_prefetch(pf, address) >= 0)
+    {
+        return;
+    }
+
+    entry = &pf->buffer[pf->victim];
+    pf->victim = (pf->victim + 1) % PREFETCH_BUFFER_SIZE;
+
+    entry->address = address;
+    entry->ready_cycle = cpu->clock + cpu->config.mem_latency;
+    cpu->stats.pf_issued++;
+}
+
+/* Prefetches degree words, the first distance strides past address */
+static void
+issue_run(APEX_CPU *cpu, int address, int stride)
+{
+    int i;
+
+    for (i = 0; i < cpu->config.prefetch_degree; ++i)
+    {
+        issue_prefetch(cpu, address + stride * (cpu->config.prefetch_distance + i));
+    }
+}
+
+static void
+train_stride(APEX_CPU *cpu, int pc, int address)
+{
+    RPT_Entry *entry = &cpu->prefetcher.rpt[(pc / 4) % RPT_SIZE];
+    int stride;
+
+    if (entry->pc != pc)
+    {
+        entry->pc = pc;
+        entry->last_address = address;
+        entry->stride = 0;
+        entry->confidence = 0;
+        return;
+    }
+
+    /* A new stride is only learnt once confidence in the old one is gone */
+    stride = address - entry->last_address;
+    if (stride == entry->stride)
+    {
+        if (entry->confidence < 3)
+        {
+            entry->confidence++;
+        }
+    }
+    else if (entry->confidence > 0)
+    {
+        entry->confidence--;
+    }
+    else
+    {
+        entry->stride = stride;
+    }
+    entry->last_address = address;
+
+    if (entry->confidence >= 2 && entry->stride)
+    {
+        issue_run(cpu, address, entry->stride);
+    }
+}
+
+static void
+train_stream(APEX_CPU *cpu, int address, int hit)
+{
+    APEX_Prefetcher *pf = &cpu->prefetcher;
+    Stream_Entry *stream, *victim = &pf->streams[0];
+    int i;
+
+    pf->stream_uses++;
+    for (i = 0; i < PREFETCH_STREAMS; ++i)
+    {
+        stream = &pf->streams[i];
+        if (stream->valid
+            && address == stream->last_address + stream->direction)
+        {
+            stream->last_address = address;
+            stream->last_use = pf->stream_uses;
+            issue_run(cpu, address, stream->direction);
+            return;
+        }
+
+        if (!stream->valid
+            || (victim->valid && stream->last_use < victim->last_use))
+        {
+            victim = stream;
+        }
+    }
+
+    if (hit)
+    {
+        return;
+    }
+
+    /* Descending when this miss sits just below the previous one */
+    victim->valid = TRUE;
+    victim->last_address = address;
+    victim->direction = (pf->last_miss == address + 4) ? -4 : 4;
+    victim->last_use = pf->stream_uses;
+    pf->last_miss = address;
+    issue_run(cpu, address, victim->direction);
+}
+
+/*
+ * Looks the demand load of the instruction at pc up in the prefetch buffer,
+ * trains the selected prefetcher and returns the cycles the load occupies
+ * the memory stage.
+ */
+int
+APEX_prefetch_access(APEX_CPU *cpu, int pc, int address)
+{
+    APEX_Prefetcher *pf = &cpu->prefetcher;
+    Prefetch_Entry *entry;
+    int latency = cpu->config.mem_latency;
+    int slot = find_prefetch(pf, address);
+
+    if (slot >= 0)
+    {
+        entry = &pf->buffer[slot];
+        latency = entry->ready_cycle - cpu->clock;
+        if (latency < 1)
+        {
+            latency = 1;
+        }
+        entry->address = -1;
+
+        cpu->stats.pf_useful++;
+        if (latency > 1)
+        {
+            cpu->stats.pf_late++;
+        }
+        cpu->stats.pf_cycles_saved += cpu->config.mem_latency - latency;
+    }
+    else
+    {
+        cpu->stats.pf_misses++;
+    }
+
+    switch (cpu->config.prefetcher)
+    {
+        case PREFETCH_NEXT_LINE:
+            issue_run(cpu, address, 4);
+            break;
+
+        case PREFETCH_STRIDE:
+            train_stride(cpu, pc, address);
+            break;
+
+        case PREFETCH_STREAM:
+            train_stream(cpu, address, slot >= 0);
+            break;
+    }
+
+    return latency;
+}
@@ -0,0 +1,18 @@
+/*
+ * apex_prefetch.h
+ * Data prefetcher models in front of data memory
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_PREFETCH_H_
+#define _APEX_PREFETCH_H_
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+void APEX_prefetch_init(APEX_Prefetcher *pf);
+int APEX_prefetch_access(APEX_CPU *cpu, int pc, int address);
+
+#endif
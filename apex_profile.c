@@ -0,0 +1,224 @@
+/*
+ * apex_profile.c
+ * Per-pc cycle accounting. Every simulated cycle is charged to exactly one
+ * instruction: the one retiring, or the one that created the bubble reaching
+ * writeback, classified by why the bubble was created (see CYCLE_* in
+ * apex_macros.h). The report annotates the input listing with those counts,
+ * much like perf annotate.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_profile.h"
+
+static const char *class_names[NUM_CYCLE_CLASSES] = {"execs", "raw", "flush",
+                                                     "mem", "unit", "fetch",
+                                                     "icache"};
+
+APEX_Profile *
+APEX_profile_create(int code_memory_size)
+{
+    APEX_Profile *profile = calloc(1, sizeof(APEX_Profile));
+
+    if (!profile)
+    {
+        return NULL;
+    }
+
+    profile->size = code_memory_size;
+    profile->cycles = calloc(code_memory_size, sizeof(*profile->cycles));
+    if (!profile->cycles)
+    {
+        free(profile);
+        return NULL;
+    }
+
+    return profile;
+}
+
+void
+APEX_profile_free(APEX_Profile *profile)
+{
+    if (profile)
+    {
+        free(profile->cycles);
+        free(profile);
+    }
+}
+
+static unsigned long long
+sum_classes(const unsigned long long *cycles)
+{
+    unsigned long long sum = 0;
+    int c;
+
+    for (c = 0; c < NUM_CYCLE_CLASSES; ++c)
+    {
+        sum += cycles[c];
+    }
+    return sum;
+}
+
+/* Reads the input file into an array of lines, returns the line count */
+static int
+read_source(const char *filename, char ***lines_out)
+{
+    FILE *fp;
+    char *line = NULL, **lines = NULL, **grown;
+    size_t len = 0;
+    int count = 0;
+
+    fp = fopen(filename, "r");
+    if (!fp)
+    {
+        return -1;
+    }
+
+    while (getline(&line, &len, fp) != -1)
+    {
+        grown = realloc(lines, (count + 1) * sizeof(char *));
+        if (!grown)
+        {
+            break;
+        }
+        lines = grown;
+        line[strcspn(line, "\r\n")] = '\0';
+        lines[count++] = strdup(line);
+    }
+
+    free(line);
+    fclose(fp);
+    *lines_out = lines;
+    return count;
+}
+
+static void
+print_counts(FILE *out, const unsigned long long *cycles,
+             unsigned long long total)
+{
+    unsigned long long sum = sum_classes(cycles);
+    int c;
+
+    fprintf(out, "%9llu %6.2f%%", sum, total ? 100.0 * sum / total : 0.0);
+    for (c = 0; c < NUM_CYCLE_CLASSES; ++c)
+    {
+        fprintf(out, " %7llu", cycles[c]);
+    }
+}
+
+static const APEX_Profile *sort_profile;
+
+static int
+compare_hotness(const void *a, const void *b)
+{
+    unsigned long long x = sum_classes(sort_profile->cycles[*(const int *)a]);
+    unsigned long long y = sum_classes(sort_profile->cycles[*(const int *)b]);
+
+    return (x < y) - (x > y);
+}
+
+/*
+ * Prints the annotated listing of filename followed by the top_n hottest
+ * instructions. Lines without an instruction are echoed with blank counters.
+ */
+void
+APEX_profile_report(const APEX_Profile *profile, const APEX_CPU *cpu,
+                    const char *filename, FILE *out, int top_n)
+{
+    char **lines = NULL;
+    int num_lines, i, c, index, dominant;
+    int *order;
+    unsigned long long total = sum_classes(profile->total);
+
+    num_lines = read_source(filename, &lines);
+
+    fprintf(out, "----------\nProfile: %s, %llu cycles\n----------\n", filename,
+            total);
+    fprintf(out, "%9s %7s", "cycles", "%");
+    for (c = 0; c < NUM_CYCLE_CLASSES; ++c)
+    {
+        fprintf(out, " %7s", class_names[c]);
+    }
+    fprintf(out, "  line: source\n");
+
+    index = 0;
+    for (i = 0; i < num_lines; ++i)
+    {
+        while (index < profile->size && cpu->code_memory[index].line < i + 1)
+        {
+            index++;
+        }
+
+        if (index < profile->size && cpu->code_memory[index].line == i + 1)
+        {
+            print_counts(out, profile->cycles[index], total);
+        }
+        else
+        {
+            fprintf(out, "%*s", 17 + 8 * NUM_CYCLE_CLASSES, "");
+        }
+        fprintf(out, "  %4d: %s\n", i + 1, lines[i]);
+    }
+
+    if (sum_classes(profile->outside))
+    {
+        print_counts(out, profile->outside, total);
+        fprintf(out, "  ----: <outside code memory>\n");
+    }
+
+    print_counts(out, profile->total, total);
+    fprintf(out, "  ----: <total>\n");
+
+    /* Hottest instructions */
+    order = malloc(profile->size * sizeof(int));
+    if (order)
+    {
+        for (i = 0; i < profile->size; ++i)
+        {
+            order[i] = i;
+        }
+        sort_profile = profile;
+        qsort(order, profile->size, sizeof(int), compare_hotness);
+
+        fprintf(out, "\nTop %d instructions by cycles:\n", top_n);
+        for (i = 0; i < top_n && i < profile->size; ++i)
+        {
+            const unsigned long long *cycles = profile->cycles[order[i]];
+            int line = cpu->code_memory[order[i]].line;
+
+            if (!sum_classes(cycles))
+            {
+                break;
+            }
+
+            dominant = CYCLE_RAW;
+            for (c = CYCLE_RAW; c < NUM_CYCLE_CLASSES; ++c)
+            {
+                if (cycles[c] > cycles[dominant])
+                {
+                    dominant = c;
+                }
+            }
+
+            fprintf(out, "%3d. pc(%d) line %-4d", i + 1,
+                    CODE_INDEX_TO_PC(order[i]), line);
+            print_counts(out, cycles, total);
+            fprintf(out, "  top stall %-5s  %s\n",
+                    cycles[dominant] ? class_names[dominant] : "-",
+                    line >= 1 && line <= num_lines ? lines[line - 1] : "");
+        }
+        free(order);
+    }
+
+    for (i = 0; i < num_lines; ++i)
+    {
+        free(lines[i]);
+    }
+    free(lines);
+}
@@ -0,0 +1,50 @@
+/*
+ * apex_profile.h
+ * Per-pc cycle accounting and annotated source listings
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_PROFILE_H_
+#define _APEX_PROFILE_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Number of hottest instructions listed in the summary */
+#define PROFILE_TOP_N 10
+
+typedef struct APEX_Profile
+{
+    int size;                /* Instructions in code memory */
+    unsigned long long (*cycles)[NUM_CYCLE_CLASSES]; /* Per instruction */
+    unsigned long long outside[NUM_CYCLE_CLASSES];   /* pc outside code memory */
+    unsigned long long total[NUM_CYCLE_CLASSES];
+} APEX_Profile;
+
+APEX_Profile *APEX_profile_create(int code_memory_size);
+void APEX_profile_report(const APEX_Profile *profile, const APEX_CPU *cpu,
+                         const char *filename, FILE *out, int top_n);
+void APEX_profile_free(APEX_Profile *profile);
+
+/* Charges one cycle of class reason to the instruction at pc */
+static inline void
+APEX_profile_charge(APEX_Profile *profile, int pc, int reason)
+{
+    int index = PC_TO_CODE_INDEX(pc);
+
+    if (index >= 0 && index < profile->size)
+    {
+        profile->cycles[index][reason]++;
+    }
+    else
+    {
+        profile->outside[reason]++;
+    }
+    profile->total[reason]++;
+}
+
+#endif
@@ -0,0 +1,255 @@
+/*
+ * apex_recorder.c
+ * Flight recorder. Every cycle takes the next record of a ring: the pc and
+ * opcode in each latch as the cycle starts, the flags, and the register
+ * writes and data memory accesses made during the cycle. That is a few
+ * stores per cycle, so the recorder stays on in every run. Nothing is
+ * written until the run fails: on a fatal signal (an assert, a wild memory
+ * access, a kill from the farm's time limit), a data memory fault, the
+ * retirement watchdog or a co-simulation divergence the ring goes to the
+ * recorder's file, oldest record first. apex_flight prints such a file.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_recorder.h"
+
+/* Signals that end a run and get the ring written first */
+static const int fatal_signals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT,
+                                    SIGTERM, SIGINT, SIGHUP, SIGXCPU};
+
+/* The recorder the signal handler writes, NULL when none is armed, and the
+ * length of its file name, taken when armed since the handler may not call
+ * strlen() */
+static const APEX_Recorder *armed;
+static size_t armed_file_length;
+
+APEX_Recorder *
+APEX_recorder_create(int cycles, const char *file)
+{
+    APEX_Recorder *recorder;
+
+    if (cycles < 1 || strlen(file) >= sizeof(recorder->file))
+    {
+        return NULL;
+    }
+
+    recorder = calloc(1, sizeof(APEX_Recorder));
+    if (!recorder)
+    {
+        return NULL;
+    }
+
+    recorder->ring = calloc(cycles, sizeof(Flight_Record));
+    if (!recorder->ring)
+    {
+        free(recorder);
+        return NULL;
+    }
+    recorder->size = cycles;
+    strcpy(recorder->file, file);
+    return recorder;
+}
+
+void
+APEX_recorder_free(APEX_Recorder *recorder)
+{
+    if (recorder)
+    {
+        if (armed == recorder)
+        {
+            armed = NULL;
+        }
+        free(recorder->ring);
+        free(recorder);
+    }
+}
+
+/* Starts the record of the cycle cpu is about to simulate */
+void
+APEX_recorder_cycle(APEX_Recorder *recorder, const APEX_CPU *cpu)
+{
+    const CPU_Latch *latches[FLIGHT_LATCHES] = {
+        &cpu->fetch, &cpu->decode, &cpu->execute, &cpu->memory,
+        &cpu->writeback};
+    Flight_Record *r;
+    int i;
+
+    if (recorder->count)
+    {
+        recorder->head = (recorder->head + 1) % recorder->size;
+    }
+    if (recorder->count < recorder->size)
+    {
+        recorder->count++;
+    }
+
+    r = &recorder->ring[recorder->head];
+    r->clock = cpu->clock;
+    r->pc = cpu->pc;
+    r->retired = cpu->insn_completed;
+    r->flags = cpu->zero_flag | (cpu->pos_flag << 1) | (cpu->neg_flag << 2);
+    r->num_writes = 0;
+    r->num_accesses = 0;
+
+    for (i = 0; i < FLIGHT_LATCHES; ++i)
+    {
+        /* The fetch latch keeps the last fetched instruction */
+        if (i == 0 ? cpu->fetch_seq == 0 : !latches[i]->has_insn)
+        {
+            r->latches[i].pc = -1;
+            r->latches[i].opcode = 0;
+            r->latches[i].tail_pc = -1;
+            continue;
+        }
+
+        r->latches[i].pc = cpu->insns[latches[i]->insn].pc;
+        r->latches[i].opcode = cpu->insns[latches[i]->insn].opcode;
+        r->latches[i].tail_pc
+            = latches[i]->fused ? cpu->insns[latches[i]->tail].pc : -1;
+    }
+}
+
+/* write() all of size bytes */
+static int
+write_all(int fd, const void *buf, size_t size)
+{
+    const char *p = buf;
+    ssize_t n;
+
+    while (size)
+    {
+        n = write(fd, p, size);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/*
+ * Writes the ring to the recorder's file, cause naming why. Safe to call
+ * from a signal handler. Returns 0, or -1 if the file cannot be written.
+ */
+int
+APEX_recorder_dump(const APEX_Recorder *recorder, const char *cause)
+{
+    Flight_Header header;
+    int oldest, fd, status, i;
+
+    /* No stdio or string functions, a signal handler may be running */
+    for (i = 0; i < (int)sizeof(header); ++i)
+    {
+        ((char *)&header)[i] = 0;
+    }
+    for (i = 0; FLIGHT_MAGIC[i]; ++i)
+    {
+        header.magic[i] = FLIGHT_MAGIC[i];
+    }
+    for (i = 0; cause[i] && i < (int)sizeof(header.cause) - 1; ++i)
+    {
+        header.cause[i] = cause[i];
+    }
+    header.version = FLIGHT_VERSION;
+    header.record_size = sizeof(Flight_Record);
+    header.count = recorder->count;
+    header.clock = recorder->count ? recorder->ring[recorder->head].clock : 0;
+
+    fd = open(recorder->file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    /* Oldest first: the part of the ring from the oldest record on, then
+     * the part before it */
+    oldest = recorder->count < recorder->size
+                 ? 0
+                 : (recorder->head + 1) % recorder->size;
+    status = write_all(fd, &header, sizeof(header));
+    if (status == 0 && recorder->count)
+    {
+        status = write_all(fd, recorder->ring + oldest,
+                           sizeof(Flight_Record) * (recorder->count - oldest));
+    }
+    if (status == 0 && oldest)
+    {
+        status = write_all(fd, recorder->ring, sizeof(Flight_Record) * oldest);
+    }
+    return close(fd) || status ? -1 : 0;
+}
+
+/* Name of a fatal signal, without strsignal() */
+static const char *
+signal_name(int sig)
+{
+    switch (sig)
+    {
+        case SIGSEGV:
+            return "SIGSEGV";
+        case SIGBUS:
+            return "SIGBUS";
+        case SIGFPE:
+            return "SIGFPE";
+        case SIGILL:
+            return "SIGILL";
+        case SIGABRT:
+            return "SIGABRT";
+        case SIGTERM:
+            return "SIGTERM";
+        case SIGINT:
+            return "SIGINT";
+        case SIGHUP:
+            return "SIGHUP";
+        default:
+            return "SIGXCPU";
+    }
+}
+
+/* Writes the armed recorder, then lets the signal take its default course */
+static void
+on_fatal_signal(int sig)
+{
+    static const char written[] = "APEX_Error: flight recorder written to ";
+    const char *name = signal_name(sig);
+
+    if (armed && APEX_recorder_dump(armed, name) == 0)
+    {
+        write_all(STDERR_FILENO, written, sizeof(written) - 1);
+        write_all(STDERR_FILENO, armed->file, armed_file_length);
+        write_all(STDERR_FILENO, "\n", 1);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/* Has the fatal signals write recorder before the process ends */
+void
+APEX_recorder_arm(APEX_Recorder *recorder)
+{
+    struct sigaction action;
+    int i;
+
+    armed_file_length = strlen(recorder->file);
+    armed = recorder;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_fatal_signal;
+    sigemptyset(&action.sa_mask);
+    for (i = 0; i < (int)(sizeof(fatal_signals) / sizeof(fatal_signals[0]));
+         ++i)
+    {
+        sigaction(fatal_signals[i], &action, NULL);
+    }
+}
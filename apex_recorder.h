@@ -0,0 +1,113 @@
+/*
+ * apex_recorder.h
+ * Flight recorder: the last cycles of a run kept in a ring and written out
+ * in binary only when the run fails
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_RECORDER_H_
+#define _APEX_RECORDER_H_
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Default cycles kept and file written on failure */
+#define FLIGHT_CYCLES 256
+#define FLIGHT_FILE "apex_flight.bin"
+
+#define FLIGHT_MAGIC "APEXFDR"
+#define FLIGHT_VERSION 1
+#define FLIGHT_LATCHES 5     /* Fetch, decode, execute, memory, writeback */
+#define FLIGHT_WRITES 4      /* Two fused instructions, rd and a LOADP base */
+#define FLIGHT_ACCESSES 2    /* Memory stage and store buffer drain */
+
+/* An instruction in a latch, pc -1 for an empty latch */
+typedef struct Flight_Latch
+{
+    int pc;
+    int opcode;
+    int tail_pc;             /* Second of a fused pair, -1 for none */
+} Flight_Latch;
+
+/* One cycle: the latches it started with and what it wrote and accessed */
+typedef struct Flight_Record
+{
+    int clock;
+    int pc;                  /* Next fetch pc */
+    int retired;             /* Instructions retired before the cycle */
+    int flags;               /* Z, P and N in bits 0 to 2 */
+    Flight_Latch latches[FLIGHT_LATCHES];
+    int num_writes;
+    int num_accesses;
+    struct
+    {
+        int reg;
+        int value;
+    } writes[FLIGHT_WRITES]; /* Scalar register writes */
+    struct
+    {
+        int address;
+        int value;
+        int store;
+    } accesses[FLIGHT_ACCESSES]; /* Data memory, first word of a vector */
+} Flight_Record;
+
+/* Start of a dump, followed by the records oldest first, host byte order */
+typedef struct Flight_Header
+{
+    char magic[8];           /* FLIGHT_MAGIC */
+    int version;             /* FLIGHT_VERSION */
+    int record_size;         /* sizeof(Flight_Record) */
+    int count;               /* Records that follow */
+    int clock;               /* Cycle the run stopped in */
+    char cause[64];          /* Signal, failure or limit behind the dump */
+} Flight_Header;
+
+typedef struct APEX_Recorder
+{
+    int size;                /* Records the ring holds */
+    int head;                /* Record of the current cycle */
+    int count;               /* Records filled */
+    char file[256];          /* Written on failure */
+    Flight_Record *ring;
+} APEX_Recorder;
+
+APEX_Recorder *APEX_recorder_create(int cycles, const char *file);
+void APEX_recorder_arm(APEX_Recorder *recorder);
+void APEX_recorder_cycle(APEX_Recorder *recorder, const APEX_CPU *cpu);
+int APEX_recorder_dump(const APEX_Recorder *recorder, const char *cause);
+void APEX_recorder_free(APEX_Recorder *recorder);
+
+/* Records a write of value to register reg in the current cycle */
+static inline void
+APEX_recorder_write(APEX_Recorder *recorder, int reg, int value)
+{
+    Flight_Record *r = &recorder->ring[recorder->head];
+
+    if (r->num_writes < FLIGHT_WRITES)
+    {
+        r->writes[r->num_writes].reg = reg;
+        r->writes[r->num_writes].value = value;
+        r->num_writes++;
+    }
+}
+
+/* Records a load or store of value at address in the current cycle */
+static inline void
+APEX_recorder_access(APEX_Recorder *recorder, int address, int value,
+                     int store)
+{
+    Flight_Record *r = &recorder->ring[recorder->head];
+
+    if (r->num_accesses < FLIGHT_ACCESSES)
+    {
+        r->accesses[r->num_accesses].address = address;
+        r->accesses[r->num_accesses].value = value;
+        r->accesses[r->num_accesses].store = store;
+        r->num_accesses++;
+    }
+}
+
+#endif
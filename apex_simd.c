@@ -0,0 +1,1024 @@
+/*
+ * apex_simd.c
+ * Simulation server for high-volume short runs. Listens on a Unix domain
+ * socket and keeps prepared CPUs resident: a snapshot is a CPU that
+ * APEX_cpu_init() has parsed the program into for one configuration, with
+ * the BTB preloaded when the job names a warm-start file. Each job forks
+ * from its snapshot, so the child starts from the prepared CPU through
+ * copy-on-write instead of a fresh process and a parse, loads the data
+ * image, runs and writes its statistics to the client as one JSON line.
+ * A job that crashes takes only its child down; the server answers for it.
+ *
+ * Snapshots are cold: they are taken at cycle 0, before anything has run,
+ * so caches, predictors, prefetchers and queues start empty in every job.
+ * Only the BTB preload from a warm-start file carries state in. No warmup
+ * runs first, since it would have to execute the program on some data
+ * image and leave its registers and memory behind.
+ *
+ * Requests are text lines, replies come in request order, one per line:
+ *
+ *   run <program.asm> [data=<image>] [warm_load=<file>] [<param>=<value> ...]
+ *   quit
+ *
+ * Parameters are those accepted by APEX_config_set(), on top of the ones
+ * the server was started with. A job is bounded so a program that never
+ * halts cannot hold a worker: it stops at max_cycles, SIMD_MAX_CYCLES
+ * unless given, and its child is killed after -t seconds; both reply with
+ * status "limit". Snapshots and data images are cached by
+ * file name, the oldest replaced first, and reloaded when the file changes.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_warm.h"
+
+#define SIMD_SOCKET "apex_simd.sock"
+#define SIMD_MAX_CLIENTS 64
+#define SIMD_MAX_SNAPSHOTS 64
+#define SIMD_MAX_IMAGES 64
+#define SIMD_LINE_MAX 4096
+#define SIMD_NAME_MAX 256
+#define SIMD_MAX_CYCLES 10000000   /* Default cycle bound of a job */
+#define SIMD_MAX_SECONDS 60        /* Default wall-clock bound of a job */
+
+/* When a file was last changed, to notice a cached copy went stale */
+typedef struct Simd_Stamp
+{
+    struct timespec mtime;
+    off_t size;
+} Simd_Stamp;
+
+typedef struct Simd_Snapshot
+{
+    char program[SIMD_NAME_MAX];
+    char warm[SIMD_NAME_MAX];      /* Warm-start file, "" for a cold BTB */
+    Simd_Stamp program_stamp;
+    Simd_Stamp warm_stamp;
+    APEX_Config config;
+    APEX_CPU *cpu;                 /* Never run, NULL for an unused entry */
+} Simd_Snapshot;
+
+typedef struct Simd_Image
+{
+    char name[SIMD_NAME_MAX];      /* "" for an unused entry */
+    Simd_Stamp stamp;
+    int memory[DATA_MEMORY_SIZE];
+} Simd_Image;
+
+typedef struct Simd_Client
+{
+    int fd;                        /* -1 for a free slot */
+    char buf[SIMD_LINE_MAX];       /* Received, not yet served */
+    int len;
+    int closing;                   /* Sent all it will, close when served */
+    pid_t pid;                     /* Child running its job, 0 for none */
+    int done_fd;                   /* Read end of a pipe only the child holds
+                                      open, hangs up when the child exits */
+    int job;
+} Simd_Client;
+
+typedef struct Simd_Server
+{
+    APEX_Config config;            /* Parameters jobs start from */
+    int listen_fd;
+    int max_jobs;                  /* Children running at once */
+    int max_seconds;               /* Wall-clock bound of a job, 0 for none */
+    int running;
+    int jobs;                      /* Jobs received so far */
+    int snapshot_hits;
+    int snapshot_misses;
+    int snapshot_victim;           /* Next entry to replace (FIFO) */
+    int image_victim;
+    Simd_Snapshot snapshots[SIMD_MAX_SNAPSHOTS];
+    Simd_Image images[SIMD_MAX_IMAGES];
+    Simd_Client clients[SIMD_MAX_CLIENTS];
+} Simd_Server;
+
+/* Event counters in the reply, in APEX_Stats order */
+static const struct
+{
+    const char *name;
+    size_t offset;
+} stat_fields[] = {
+    {"branches", offsetof(APEX_Stats, branches)},
+    {"taken", offsetof(APEX_Stats, taken)},
+    {"mispredicts", offsetof(APEX_Stats, mispredicts)},
+    {"jumps", offsetof(APEX_Stats, jumps)},
+    {"squashed", offsetof(APEX_Stats, squashed)},
+    {"raw_stalls", offsetof(APEX_Stats, raw_stalls)},
+    {"exec_stalls", offsetof(APEX_Stats, exec_stalls)},
+    {"mem_stalls", offsetof(APEX_Stats, mem_stalls)},
+    {"flush_bubbles", offsetof(APEX_Stats, flush_bubbles)},
+    {"sb_forwards", offsetof(APEX_Stats, sb_forwards)},
+    {"sb_stalls", offsetof(APEX_Stats, sb_stalls)},
+    {"sb_occupancy", offsetof(APEX_Stats, sb_occupancy)},
+    {"sb_max", offsetof(APEX_Stats, sb_max)},
+    {"pf_issued", offsetof(APEX_Stats, pf_issued)},
+    {"pf_useful", offsetof(APEX_Stats, pf_useful)},
+    {"pf_late", offsetof(APEX_Stats, pf_late)},
+    {"pf_misses", offsetof(APEX_Stats, pf_misses)},
+    {"pf_cycles_saved", offsetof(APEX_Stats, pf_cycles_saved)},
+    {"ic_accesses", offsetof(APEX_Stats, ic_accesses)},
+    {"ic_misses", offsetof(APEX_Stats, ic_misses)},
+    {"ic_prefetches", offsetof(APEX_Stats, ic_prefetches)},
+    {"ic_stalls", offsetof(APEX_Stats, ic_stalls)},
+    {"fetch_bubbles", offsetof(APEX_Stats, fetch_bubbles)},
+    {"fq_full", offsetof(APEX_Stats, fq_full)},
+    {"fq_occupancy", offsetof(APEX_Stats, fq_occupancy)},
+    {"fq_max", offsetof(APEX_Stats, fq_max)},
+    {"ftq_occupancy", offsetof(APEX_Stats, ftq_occupancy)},
+    {"lsd_loops", offsetof(APEX_Stats, lsd_loops)},
+    {"lsd_replays", offsetof(APEX_Stats, lsd_replays)},
+    {"lvp_loads", offsetof(APEX_Stats, lvp_loads)},
+    {"lvp_predicted", offsetof(APEX_Stats, lvp_predicted)},
+    {"lvp_correct", offsetof(APEX_Stats, lvp_correct)},
+    {"lvp_replays", offsetof(APEX_Stats, lvp_replays)},
+    {"lvp_cycles_saved", offsetof(APEX_Stats, lvp_cycles_saved)},
+    {"lvp_cycles_lost", offsetof(APEX_Stats, lvp_cycles_lost)},
+    {"early_branches", offsetof(APEX_Stats, early_branches)},
+    {"early_mispredicts", offsetof(APEX_Stats, early_mispredicts)},
+    {"early_cycles_saved", offsetof(APEX_Stats, early_cycles_saved)},
+    {"fused_cmp_branch", offsetof(APEX_Stats, fused_cmp_branch)},
+    {"fused_movc_add", offsetof(APEX_Stats, fused_movc_add)},
+    {"fused_addl_load", offsetof(APEX_Stats, fused_addl_load)},
+    {NULL, 0},
+};
+
+static volatile sig_atomic_t stopping;
+
+static void
+on_stop_signal(int sig)
+{
+    (void)sig;
+    stopping = TRUE;
+}
+
+static double
+now_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* write() all of size bytes */
+static int
+write_all(int fd, const char *buf, size_t size)
+{
+    ssize_t n;
+
+    while (size)
+    {
+        n = write(fd, buf, size);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        buf += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int
+get_stamp(const char *filename, Simd_Stamp *stamp)
+{
+    struct stat st;
+
+    if (stat(filename, &st))
+    {
+        return -1;
+    }
+    stamp->mtime = st.st_mtim;
+    stamp->size = st.st_size;
+    return 0;
+}
+
+static int
+same_stamp(const Simd_Stamp *a, const Simd_Stamp *b)
+{
+    return a->mtime.tv_sec == b->mtime.tv_sec
+           && a->mtime.tv_nsec == b->mtime.tv_nsec && a->size == b->size;
+}
+
+/* Writes s as a JSON string */
+static void
+json_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            fprintf(fp, "\\%c", *s);
+        }
+        else if ((unsigned char)*s < 0x20)
+        {
+            fprintf(fp, "\\u%04x", (unsigned char)*s);
+        }
+        else
+        {
+            fputc(*s, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/* Sends the reply of a job that did not run, with the message fmt formats */
+static void
+reply_error(int fd, int job, const char *status, const char *fmt, ...)
+{
+    char message[SIMD_LINE_MAX + 64];
+    char *reply = NULL;
+    size_t size = 0;
+    va_list ap;
+    FILE *fp;
+
+    va_start(ap, fmt);
+    vsnprintf(message, sizeof(message), fmt, ap);
+    va_end(ap);
+
+    fp = open_memstream(&reply, &size);
+    if (!fp)
+    {
+        return;
+    }
+    fprintf(fp, "{\"job\": %d, \"status\": \"%s\", \"error\": ", job, status);
+    json_string(fp, message);
+    fprintf(fp, "}\n");
+    if (fclose(fp) == 0)
+    {
+        write_all(fd, reply, size);
+    }
+    free(reply);
+}
+
+/*
+ * Parses program in a throwaway child first: the parser asserts on an
+ * unknown opcode, which must not take the server down. Returns 0 if it
+ * parses.
+ */
+static int
+program_parses(const char *program)
+{
+    APEX_Instruction *code;
+    int size, status;
+    pid_t pid;
+
+    fflush(NULL);
+    pid = fork();
+    if (pid < 0)
+    {
+        return -1;
+    }
+    if (pid == 0)
+    {
+        signal(SIGABRT, SIG_DFL);
+        code = create_code_memory(program, &size);
+        _exit(code ? 0 : 1);
+    }
+
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            return -1;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/*
+ * Finds or prepares the snapshot of program under config, with the BTB
+ * preloaded from warm unless it is "". Returns NULL after sending the
+ * client an error.
+ */
+static Simd_Snapshot *
+get_snapshot(Simd_Server *server, int fd, int job, const char *program,
+             const char *warm, const APEX_Config *config)
+{
+    Simd_Snapshot *s;
+    Simd_Stamp program_stamp, warm_stamp;
+    APEX_CPU *cpu;
+    int i;
+
+    if (strlen(program) >= SIMD_NAME_MAX || strlen(warm) >= SIMD_NAME_MAX)
+    {
+        reply_error(fd, job, "error", "file name too long");
+        return NULL;
+    }
+    if (get_stamp(program, &program_stamp))
+    {
+        reply_error(fd, job, "error", "unable to read %s", program);
+        return NULL;
+    }
+    memset(&warm_stamp, 0, sizeof(warm_stamp));
+    if (*warm && get_stamp(warm, &warm_stamp))
+    {
+        reply_error(fd, job, "error", "unable to read %s", warm);
+        return NULL;
+    }
+
+    for (i = 0; i < SIMD_MAX_SNAPSHOTS; ++i)
+    {
+        s = &server->snapshots[i];
+        if (s->cpu && strcmp(s->program, program) == 0
+            && strcmp(s->warm, warm) == 0
+            && memcmp(&s->config, config, sizeof(APEX_Config)) == 0)
+        {
+            if (same_stamp(&s->program_stamp, &program_stamp)
+                && same_stamp(&s->warm_stamp, &warm_stamp))
+            {
+                server->snapshot_hits++;
+                return s;
+            }
+
+            /* A file changed, prepare this entry again */
+            break;
+        }
+    }
+
+    if (i == SIMD_MAX_SNAPSHOTS)
+    {
+        i = server->snapshot_victim;
+        server->snapshot_victim = (i + 1) % SIMD_MAX_SNAPSHOTS;
+    }
+    s = &server->snapshots[i];
+    if (s->cpu)
+    {
+        APEX_cpu_stop(s->cpu);
+        s->cpu = NULL;
+    }
+    server->snapshot_misses++;
+
+    if (program_parses(program))
+    {
+        reply_error(fd, job, "error", "unable to load %s", program);
+        return NULL;
+    }
+
+    cpu = APEX_cpu_init(program, config);
+    if (!cpu)
+    {
+        reply_error(fd, job, "error", "unable to load %s", program);
+        return NULL;
+    }
+    if (*warm && APEX_warm_load(cpu, NULL, warm))
+    {
+        APEX_cpu_stop(cpu);
+        reply_error(fd, job, "error", "bad warm-start file %s", warm);
+        return NULL;
+    }
+
+    strcpy(s->program, program);
+    strcpy(s->warm, warm);
+    s->program_stamp = program_stamp;
+    s->warm_stamp = warm_stamp;
+    s->config = *config;
+    s->cpu = cpu;
+    return s;
+}
+
+/* Finds or loads data image name. Returns NULL after sending an error */
+static const Simd_Image *
+get_image(Simd_Server *server, int fd, int job, const char *name)
+{
+    Simd_Image *image;
+    Simd_Stamp stamp;
+    int i;
+
+    if (strlen(name) >= SIMD_NAME_MAX || get_stamp(name, &stamp))
+    {
+        reply_error(fd, job, "error", "unable to read %s", name);
+        return NULL;
+    }
+
+    for (i = 0; i < SIMD_MAX_IMAGES; ++i)
+    {
+        image = &server->images[i];
+        if (strcmp(image->name, name) == 0)
+        {
+            if (same_stamp(&image->stamp, &stamp))
+            {
+                return image;
+            }
+            break;
+        }
+    }
+
+    if (i == SIMD_MAX_IMAGES)
+    {
+        i = server->image_victim;
+        server->image_victim = (i + 1) % SIMD_MAX_IMAGES;
+    }
+    image = &server->images[i];
+    image->name[0] = '\0';
+
+    if (load_data_image(name, image->memory))
+    {
+        reply_error(fd, job, "error", "bad data image %s", name);
+        return NULL;
+    }
+    strcpy(image->name, name);
+    image->stamp = stamp;
+    return image;
+}
+
+static const char *
+run_status(const APEX_CPU *cpu)
+{
+    if (cpu->diverged)
+    {
+        return "diverged";
+    }
+    if (cpu->halted)
+    {
+        return "halted";
+    }
+    if (cpu->failed == FAIL_MEMORY)
+    {
+        return "fault";
+    }
+    if (cpu->failed == FAIL_WATCHDOG)
+    {
+        return "watchdog";
+    }
+    return "limit";
+}
+
+/*
+ * Runs a job in the child forked for it and writes its reply to fd. A job
+ * still running after seconds is killed by SIGALRM, finish_job() answers
+ * for it.
+ */
+static void
+run_job(int fd, int job, APEX_CPU *cpu, const Simd_Image *image, int hit,
+        int seconds)
+{
+    double start;
+    FILE *fp;
+    int i;
+
+    if (image)
+    {
+        APEX_cpu_set_data_memory(cpu, image->memory);
+    }
+
+    signal(SIGALRM, SIG_DFL);
+    alarm(seconds);
+    start = now_seconds();
+    APEX_cpu_run(cpu);
+
+    fp = fdopen(fd, "w");
+    if (!fp)
+    {
+        _exit(1);
+    }
+
+    fprintf(fp,
+            "{\"job\": %d, \"status\": \"%s\", \"cycles\": %d, "
+            "\"instructions\": %d, \"cpi\": %.4f, \"run_us\": %.1f, "
+            "\"snapshot\": \"%s\", \"variant\": ",
+            job, run_status(cpu), cpu->clock, cpu->insn_completed,
+            cpu->insn_completed ? (double)cpu->clock / cpu->insn_completed
+                                : 0.0,
+            (now_seconds() - start) * 1e6, hit ? "hit" : "miss");
+    if (cpu->variant)
+    {
+        json_string(fp, cpu->variant);
+    }
+    else
+    {
+        fprintf(fp, "null");
+    }
+
+    fprintf(fp, ", \"stats\": {");
+    for (i = 0; stat_fields[i].name; ++i)
+    {
+        fprintf(fp, "%s\"%s\": %llu", i ? ", " : "", stat_fields[i].name,
+                *(const unsigned long long *)((const char *)&cpu->stats
+                                              + stat_fields[i].offset));
+    }
+
+    fprintf(fp, "}, \"regs\": [");
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        fprintf(fp, "%s%d", i ? ", " : "", cpu->regs[i]);
+    }
+    fprintf(fp, "]}\n");
+
+    _exit(fclose(fp) ? 1 : 0);
+}
+
+/*
+ * Serves "run <program> ...": checks the request, finds the snapshot and
+ * image and forks the job from the snapshot. Replies itself when the job
+ * cannot start.
+ */
+static void
+start_job(Simd_Server *server, Simd_Client *c, char *args)
+{
+    APEX_Config config = server->config;
+    Simd_Snapshot *snapshot;
+    const Simd_Image *image = NULL;
+    const char *program = NULL, *data = NULL, *warm = "";
+    char *arg, *save;
+    int hits = server->snapshot_hits;
+    int done[2], i;
+    pid_t pid;
+
+    c->job = server->jobs++;
+    for (arg = strtok_r(args, " \t\r\n", &save); arg;
+         arg = strtok_r(NULL, " \t\r\n", &save))
+    {
+        if (strncmp(arg, "data=", 5) == 0)
+        {
+            data = arg + 5;
+        }
+        else if (strncmp(arg, "warm_load=", 10) == 0)
+        {
+            warm = arg + 10;
+        }
+        else if (strchr(arg, '='))
+        {
+            if (APEX_config_parse(&config, arg))
+            {
+                reply_error(c->fd, c->job, "error", "invalid parameter '%s'",
+                            arg);
+                return;
+            }
+        }
+        else if (!program)
+        {
+            program = arg;
+        }
+        else
+        {
+            reply_error(c->fd, c->job, "error", "unexpected '%s'", arg);
+            return;
+        }
+    }
+
+    if (!program)
+    {
+        reply_error(c->fd, c->job, "error",
+                    "expected run <program.asm> [data=<image>] "
+                    "[warm_load=<file>] [<param>=<value> ...]");
+        return;
+    }
+    config.debug_messages = FALSE;
+    config.single_step = FALSE;
+
+    snapshot = get_snapshot(server, c->fd, c->job, program, warm, &config);
+    if (!snapshot || (data && !(image = get_image(server, c->fd, c->job, data))))
+    {
+        return;
+    }
+
+    if (pipe(done))
+    {
+        reply_error(c->fd, c->job, "error", "pipe: %s", strerror(errno));
+        return;
+    }
+
+    fflush(NULL);
+    pid = fork();
+    if (pid < 0)
+    {
+        close(done[0]);
+        close(done[1]);
+        reply_error(c->fd, c->job, "error", "fork: %s", strerror(errno));
+        return;
+    }
+    if (pid == 0)
+    {
+        /* Other clients must see their connection close when the server
+         * closes it */
+        for (i = 0; i < SIMD_MAX_CLIENTS; ++i)
+        {
+            if (server->clients[i].fd >= 0 && &server->clients[i] != c)
+            {
+                close(server->clients[i].fd);
+            }
+        }
+        close(server->listen_fd);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        close(done[0]);
+        run_job(c->fd, c->job, snapshot->cpu, image,
+                server->snapshot_hits != hits, server->max_seconds);
+    }
+
+    close(done[1]);
+    c->pid = pid;
+    c->done_fd = done[0];
+    server->running++;
+}
+
+static void
+close_client(Simd_Client *c)
+{
+    close(c->fd);
+    c->fd = -1;
+    c->len = 0;
+    c->closing = FALSE;
+}
+
+/*
+ * Serves the complete lines c sent, up to the first that starts a job: the
+ * next one waits for its reply, to keep replies in order
+ */
+static void
+serve_lines(Simd_Server *server, Simd_Client *c)
+{
+    char *end, *cmd;
+    int used;
+
+    while (c->fd >= 0 && !c->pid
+           && (end = memchr(c->buf, '\n', c->len)))
+    {
+        *end = '\0';
+        used = end + 1 - c->buf;
+        cmd = c->buf + strspn(c->buf, " \t\r");
+
+        if (strncmp(cmd, "run", 3) == 0 && strchr(" \t", cmd[3]))
+        {
+            start_job(server, c, cmd + 3);
+        }
+        else if (strncmp(cmd, "quit", 4) == 0 && strchr(" \t\r", cmd[4]))
+        {
+            close_client(c);
+            return;
+        }
+        else if (*cmd)
+        {
+            reply_error(c->fd, server->jobs++, "error",
+                        "unknown request, expected run or quit");
+        }
+
+        c->len -= used;
+        memmove(c->buf, c->buf + used, c->len);
+    }
+
+    if (c->fd >= 0 && !c->pid)
+    {
+        if (c->closing)
+        {
+            close_client(c);
+        }
+        else if (c->len == SIMD_LINE_MAX)
+        {
+            reply_error(c->fd, server->jobs++, "error",
+                        "request longer than %d bytes", SIMD_LINE_MAX - 1);
+            close_client(c);
+        }
+    }
+}
+
+/* Reaps the child of c's job; answers for it if it died without replying */
+static void
+finish_job(Simd_Server *server, Simd_Client *c)
+{
+    int status;
+
+    while (waitpid(c->pid, &status, 0) < 0 && errno == EINTR)
+    {
+    }
+
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM)
+    {
+        reply_error(c->fd, c->job, "limit", "killed after %d seconds",
+                    server->max_seconds);
+    }
+    else if (WIFSIGNALED(status))
+    {
+        reply_error(c->fd, c->job, "crashed", "killed by signal %d",
+                    WTERMSIG(status));
+    }
+    else if (!WIFEXITED(status) || WEXITSTATUS(status))
+    {
+        reply_error(c->fd, c->job, "crashed", "exited with status %d",
+                    WEXITSTATUS(status));
+    }
+
+    close(c->done_fd);
+    c->pid = 0;
+    server->running--;
+    serve_lines(server, c);
+}
+
+static void
+read_client(Simd_Server *server, Simd_Client *c)
+{
+    ssize_t n = read(c->fd, c->buf + c->len, SIMD_LINE_MAX - c->len);
+
+    if (n < 0 && errno == EINTR)
+    {
+        return;
+    }
+    if (n <= 0)
+    {
+        c->closing = TRUE;
+    }
+    else
+    {
+        c->len += n;
+    }
+    serve_lines(server, c);
+}
+
+static void
+accept_client(Simd_Server *server)
+{
+    int fd = accept(server->listen_fd, NULL, NULL);
+    int i;
+
+    if (fd < 0)
+    {
+        return;
+    }
+
+    for (i = 0; i < SIMD_MAX_CLIENTS; ++i)
+    {
+        if (server->clients[i].fd < 0)
+        {
+            server->clients[i].fd = fd;
+            return;
+        }
+    }
+    close(fd);
+}
+
+/*
+ * Binds the listening socket at path. A socket file no server answers on
+ * is left over from one that died and is replaced.
+ */
+static int
+listen_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "APEX_Error: socket path %s is too long\n", path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+    {
+        fprintf(stderr, "APEX_Error: a server is already listening on %s\n",
+                path);
+        close(fd);
+        return -1;
+    }
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))
+        || listen(fd, SIMD_MAX_CLIENTS))
+    {
+        fprintf(stderr, "APEX_Error: Unable to listen on %s: %s\n", path,
+                strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Serves clients until SIGTERM or SIGINT */
+static void
+serve(Simd_Server *server)
+{
+    struct pollfd fds[SIMD_MAX_CLIENTS + 1];
+    Simd_Client *owner[SIMD_MAX_CLIENTS + 1];
+    Simd_Client *c;
+    int n, i;
+
+    while (!stopping || server->running)
+    {
+        /* The listening socket, children to reap, and clients whose next
+         * request can start a job */
+        n = 0;
+        if (!stopping)
+        {
+            fds[n].fd = server->listen_fd;
+            fds[n].events = POLLIN;
+            owner[n++] = NULL;
+        }
+        for (i = 0; i < SIMD_MAX_CLIENTS; ++i)
+        {
+            c = &server->clients[i];
+            if (c->fd >= 0 && c->pid)
+            {
+                fds[n].fd = c->done_fd;
+            }
+            else if (c->fd >= 0 && !stopping
+                     && server->running < server->max_jobs)
+            {
+                fds[n].fd = c->fd;
+            }
+            else
+            {
+                continue;
+            }
+            fds[n].events = POLLIN;
+            owner[n++] = c;
+        }
+
+        if (poll(fds, n, -1) < 0)
+        {
+            if (errno != EINTR)
+            {
+                perror("poll");
+                return;
+            }
+            continue;
+        }
+
+        for (i = 0; i < n; ++i)
+        {
+            c = owner[i];
+            if (!fds[i].revents)
+            {
+                continue;
+            }
+            if (!c)
+            {
+                accept_client(server);
+            }
+            else if (c->pid)
+            {
+                finish_job(server, c);
+            }
+            else if (c->fd >= 0 && server->running < server->max_jobs)
+            {
+                read_client(server, c);
+            }
+        }
+    }
+}
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "APEX_Help: Usage %s [-s <socket>] [-j <jobs>] [-t <seconds>] "
+            "[<param>=<value> ...]\n",
+            prog);
+    fprintf(stderr,
+            "APEX_Help: -j limits the jobs run at once, all cores by "
+            "default\n");
+    fprintf(stderr,
+            "APEX_Help: -t kills a job after <seconds>, %d by default, 0 for "
+            "no limit; jobs stop at max_cycles=%d unless given another\n",
+            SIMD_MAX_SECONDS, SIMD_MAX_CYCLES);
+    fprintf(stderr,
+            "APEX_Help: snapshots are cold, jobs start at cycle 0 with only "
+            "the BTB warm_load preloads\n");
+}
+
+int
+main(int argc, char const *argv[])
+{
+    Simd_Server *server;
+    struct sigaction action;
+    const char *path = SIMD_SOCKET;
+    int null_fd, i;
+
+    server = calloc(1, sizeof(Simd_Server));
+    if (!server)
+    {
+        exit(1);
+    }
+    APEX_config_defaults(&server->config);
+    server->config.max_cycles = SIMD_MAX_CYCLES;
+    server->max_jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    server->max_seconds = SIMD_MAX_SECONDS;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            server->max_jobs = atoi(argv[++i]);
+            if (server->max_jobs < 1)
+            {
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            server->max_seconds = atoi(argv[++i]);
+            if (server->max_seconds < 0)
+            {
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strchr(argv[i], '=') && argv[i][0] != '-')
+        {
+            if (APEX_config_parse(&server->config, argv[i]))
+            {
+                fprintf(stderr, "apex_simd: invalid parameter '%s'\n",
+                        argv[i]);
+                exit(1);
+            }
+        }
+        else
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (server->max_jobs < 1)
+    {
+        server->max_jobs = 1;
+    }
+    for (i = 0; i < SIMD_MAX_CLIENTS; ++i)
+    {
+        server->clients[i].fd = -1;
+    }
+
+    server->listen_fd = listen_socket(path);
+    if (server->listen_fd < 0)
+    {
+        exit(1);
+    }
+
+    /* A client that goes away must not end the server, and the pipeline
+     * reports completion on stdout, keep it out of the way */
+    signal(SIGPIPE, SIG_IGN);
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stop_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0)
+    {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+
+    fprintf(stderr, "apex_simd: listening on %s with %d workers\n", path,
+            server->max_jobs);
+    serve(server);
+
+    fprintf(stderr, "apex_simd: %d jobs, %d snapshot hits, %d misses\n",
+            server->jobs, server->snapshot_hits, server->snapshot_misses);
+    close(server->listen_fd);
+    unlink(path);
+    for (i = 0; i < SIMD_MAX_SNAPSHOTS; ++i)
+    {
+        if (server->snapshots[i].cpu)
+        {
+            APEX_cpu_stop(server->snapshots[i].cpu);
+        }
+    }
+    for (i = 0; i < SIMD_MAX_CLIENTS; ++i)
+    {
+        if (server->clients[i].fd >= 0)
+        {
+            close(server->clients[i].fd);
+        }
+    }
+    free(server);
+    return 0;
+}
@@ -0,0 +1,411 @@
+/*
+ * apex_trace.c
+ * Streams the life of every instruction through the pipeline to a log that
+ * the Konata viewer (https://github.com/shioyadan/Konata) can open, either in
+ * its native Kanata format or in gem5's O3PipeView format.
+ *
+ * The pipeline reports events as they happen: fetch, a move into the next
+ * latch, a cycle lost to a stall, retirement and squashing. A move made in
+ * cycle t means the instruction works in the next stage from cycle t + 1, so
+ * moves are held back and written at the start of the next cycle. Output is
+ * collected in a buffer and written out in large blocks, and only events of
+ * instructions fetched inside the cycle window are kept.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_trace.h"
+
+static const char *stage_names[NUM_TRACE_STAGES] = {"F", "D", "X", "M", "W"};
+
+/* Lane 1 marker shown under a stalled stage, indexed by CYCLE_* */
+static const char *stall_names[NUM_CYCLE_CLASSES] = {"execs", "raw", "flush",
+                                                     "mem", "unit", "fetch",
+                                                     "icache"};
+
+static void
+flush_buffer(APEX_Trace *trace)
+{
+    if (trace->used)
+    {
+        fwrite(trace->buf, 1, trace->used, trace->fp);
+        trace->used = 0;
+    }
+}
+
+static void
+trace_printf(APEX_Trace *trace, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    /* Room for the longest line, a disassembly is well under this */
+    if (trace->used > TRACE_BUFFER_SIZE - 512)
+    {
+        flush_buffer(trace);
+    }
+
+    va_start(ap, fmt);
+    n = vsnprintf(trace->buf + trace->used, TRACE_BUFFER_SIZE - trace->used,
+                  fmt, ap);
+    va_end(ap);
+
+    if (n > 0)
+    {
+        trace->used += n < TRACE_BUFFER_SIZE - trace->used
+                           ? n
+                           : TRACE_BUFFER_SIZE - trace->used - 1;
+    }
+}
+
+/* Returns the record of a traced instruction, NULL when it is not traced */
+static Trace_Record *
+find_record(APEX_Trace *trace, int seq)
+{
+    Trace_Record *rec = &trace->records[seq % TRACE_RECORDS];
+
+    return (trace->active && rec->seq == seq) ? rec : NULL;
+}
+
+/* Advances the Kanata log clock to the current cycle */
+static void
+sync_cycle(APEX_Trace *trace)
+{
+    if (trace->written_cycle < 0)
+    {
+        trace_printf(trace, "C=\t%d\n", trace->cycle);
+    }
+    else if (trace->cycle != trace->written_cycle)
+    {
+        trace_printf(trace, "C\t%d\n", trace->cycle - trace->written_cycle);
+    }
+    trace->written_cycle = trace->cycle;
+}
+
+static void
+format_disasm(const CPU_Stage *stage, char *buf, int size)
+{
+    int len;
+
+    APEX_format_instruction(stage, buf, size);
+    len = strlen(buf);
+    while (len > 0 && buf[len - 1] == ' ')
+    {
+        buf[--len] = '\0';
+    }
+}
+
+static unsigned long long
+o3_ticks(const Trace_Record *rec, int stage)
+{
+    return rec->cycle[stage] < 0
+               ? 0
+               : (unsigned long long)rec->cycle[stage] * TRACE_O3_TICKS;
+}
+
+/* Writes the O3PipeView block of an instruction leaving the pipeline */
+static void
+write_o3(APEX_Trace *trace, Trace_Record *rec, const CPU_Stage *stage,
+         int flushed)
+{
+    char disasm[160];
+    unsigned long long decode = o3_ticks(rec, TRACE_DECODE);
+
+    format_disasm(stage, disasm, sizeof(disasm));
+    trace_printf(trace, "O3PipeView:fetch:%llu:0x%08x:0:%d:%s\n",
+                 o3_ticks(rec, TRACE_FETCH), stage->pc, rec->seq, disasm);
+    trace_printf(trace, "O3PipeView:decode:%llu\n", decode);
+    trace_printf(trace, "O3PipeView:rename:%llu\n", decode);
+    trace_printf(trace, "O3PipeView:dispatch:%llu\n", decode);
+    trace_printf(trace, "O3PipeView:issue:%llu\n",
+                 o3_ticks(rec, TRACE_EXECUTE));
+    trace_printf(trace, "O3PipeView:complete:%llu\n",
+                 o3_ticks(rec, TRACE_MEMORY));
+    trace_printf(trace, "O3PipeView:retire:%llu:store:%llu\n",
+                 flushed ? 0 : o3_ticks(rec, TRACE_WRITEBACK),
+                 !flushed && (stage->opcode == OPCODE_STORE
+                              || stage->opcode == OPCODE_STOREP)
+                     ? o3_ticks(rec, TRACE_MEMORY)
+                     : 0);
+    rec->seq = -1;
+}
+
+static void
+add_pending(APEX_Trace *trace, int seq, int stage, int flushed)
+{
+    Trace_Event *ev;
+
+    if (trace->num_pending < TRACE_MAX_PENDING)
+    {
+        ev = &trace->pending[trace->num_pending++];
+        ev->seq = seq;
+        ev->stage = stage;
+        ev->flushed = flushed;
+    }
+}
+
+/* Writes the Kanata events held back from the previous cycle */
+static void
+write_pending(APEX_Trace *trace)
+{
+    Trace_Record *rec;
+    Trace_Event *ev;
+    int i, id;
+
+    for (i = 0; i < trace->num_pending; ++i)
+    {
+        ev = &trace->pending[i];
+        rec = find_record(trace, ev->seq);
+        if (!rec)
+        {
+            continue;
+        }
+
+        id = ev->seq - trace->first_seq;
+        sync_cycle(trace);
+
+        if (rec->stall >= 0)
+        {
+            trace_printf(trace, "E\t%d\t1\t%s\n", id, stall_names[rec->stall]);
+            rec->stall = -1;
+        }
+
+        if (ev->stage >= 0)
+        {
+            trace_printf(trace, "S\t%d\t0\t%s\n", id, stage_names[ev->stage]);
+        }
+        else
+        {
+            trace_printf(trace, "R\t%d\t%d\t%d\n", id,
+                         ev->flushed ? 0 : trace->retired++, ev->flushed);
+            rec->seq = -1;
+        }
+    }
+
+    trace->num_pending = 0;
+}
+
+/*
+ * Opens a trace of the cycles first_cycle to last_cycle, a negative
+ * last_cycle runs to the end of the simulation. filename "-" is stdout.
+ */
+APEX_Trace *
+APEX_trace_open(const char *filename, int format, int first_cycle,
+                int last_cycle)
+{
+    APEX_Trace *trace = calloc(1, sizeof(APEX_Trace));
+    int i;
+
+    if (!trace)
+    {
+        return NULL;
+    }
+
+    trace->fp = strcmp(filename, "-") ? fopen(filename, "w") : stdout;
+    if (!trace->fp)
+    {
+        free(trace);
+        return NULL;
+    }
+
+    trace->format = format;
+    trace->first_cycle = first_cycle;
+    trace->last_cycle = last_cycle;
+    trace->first_seq = -1;
+    trace->written_cycle = -1;
+    for (i = 0; i < TRACE_RECORDS; ++i)
+    {
+        trace->records[i].seq = -1;
+    }
+
+    if (format == TRACE_KANATA)
+    {
+        trace_printf(trace, "Kanata\t0004\n");
+    }
+
+    return trace;
+}
+
+void
+APEX_trace_close(APEX_Trace *trace)
+{
+    if (!trace)
+    {
+        return;
+    }
+
+    /* Moves made in the final cycle */
+    APEX_trace_cycle(trace, trace->cycle + 1);
+    flush_buffer(trace);
+
+    if (trace->fp != stdout)
+    {
+        fclose(trace->fp);
+    }
+    else
+    {
+        fflush(stdout);
+    }
+    free(trace);
+}
+
+/* Called at the start of every simulated cycle */
+void
+APEX_trace_cycle(APEX_Trace *trace, int cycle)
+{
+    trace->cycle = cycle;
+    trace->active = cycle >= trace->first_cycle
+                    && (trace->last_cycle < 0 || cycle <= trace->last_cycle);
+
+    if (trace->active)
+    {
+        write_pending(trace);
+    }
+    else
+    {
+        trace->num_pending = 0;
+    }
+}
+
+/* stage was fetched this cycle and now waits in the decode latch */
+void
+APEX_trace_fetch(APEX_Trace *trace, const CPU_Stage *stage)
+{
+    Trace_Record *rec;
+    char disasm[160];
+    int i, id;
+
+    if (!trace->active)
+    {
+        return;
+    }
+
+    if (trace->first_seq < 0)
+    {
+        trace->first_seq = stage->seq;
+    }
+
+    rec = &trace->records[stage->seq % TRACE_RECORDS];
+    rec->seq = stage->seq;
+    rec->stall = -1;
+    for (i = 0; i < NUM_TRACE_STAGES; ++i)
+    {
+        rec->cycle[i] = -1;
+    }
+    rec->cycle[TRACE_FETCH] = trace->cycle;
+
+    if (trace->format == TRACE_O3)
+    {
+        if (stage->opcode == OPCODE_NOP)
+        {
+            write_o3(trace, rec, stage, FALSE);
+        }
+        else
+        {
+            rec->cycle[TRACE_DECODE] = trace->cycle + 1;
+        }
+        return;
+    }
+
+    id = stage->seq - trace->first_seq;
+    format_disasm(stage, disasm, sizeof(disasm));
+    sync_cycle(trace);
+    trace_printf(trace, "I\t%d\t%d\t0\n", id, stage->seq);
+    trace_printf(trace, "L\t%d\t0\t%d: %s\n", id, stage->pc, disasm);
+    trace_printf(trace, "S\t%d\t0\t%s\n", id, stage_names[TRACE_FETCH]);
+
+    /* NOPs are dropped by fetch and complete right away */
+    if (stage->opcode == OPCODE_NOP)
+    {
+        add_pending(trace, stage->seq, -1, FALSE);
+    }
+    else
+    {
+        add_pending(trace, stage->seq, TRACE_DECODE, FALSE);
+    }
+}
+
+/* stage moved into the latch of pipeline stage next this cycle */
+void
+APEX_trace_stage(APEX_Trace *trace, const CPU_Stage *stage, int next)
+{
+    Trace_Record *rec = find_record(trace, stage->seq);
+
+    if (!rec)
+    {
+        return;
+    }
+
+    rec->cycle[next] = trace->cycle + 1;
+    if (trace->format == TRACE_KANATA)
+    {
+        add_pending(trace, stage->seq, next, FALSE);
+    }
+}
+
+/* stage could not leave its stage this cycle for a reason of class CYCLE_* */
+void
+APEX_trace_stall(APEX_Trace *trace, const CPU_Stage *stage, int reason)
+{
+    Trace_Record *rec = find_record(trace, stage->seq);
+
+    if (!rec || rec->stall >= 0 || trace->format != TRACE_KANATA)
+    {
+        return;
+    }
+
+    sync_cycle(trace);
+    trace_printf(trace, "S\t%d\t1\t%s\n", stage->seq - trace->first_seq,
+                 stall_names[reason]);
+    rec->stall = reason;
+}
+
+/* stage completed writeback this cycle */
+void
+APEX_trace_retire(APEX_Trace *trace, const CPU_Stage *stage)
+{
+    Trace_Record *rec = find_record(trace, stage->seq);
+
+    if (!rec)
+    {
+        return;
+    }
+
+    if (trace->format == TRACE_O3)
+    {
+        rec->cycle[TRACE_WRITEBACK] = trace->cycle;
+        write_o3(trace, rec, stage, FALSE);
+    }
+    else
+    {
+        add_pending(trace, stage->seq, -1, FALSE);
+    }
+}
+
+/* stage was squashed by a redirect this cycle */
+void
+APEX_trace_flush(APEX_Trace *trace, const CPU_Stage *stage)
+{
+    Trace_Record *rec = find_record(trace, stage->seq);
+
+    if (!rec)
+    {
+        return;
+    }
+
+    if (trace->format == TRACE_O3)
+    {
+        write_o3(trace, rec, stage, TRUE);
+    }
+    else
+    {
+        add_pending(trace, stage->seq, -1, TRUE);
+    }
+}
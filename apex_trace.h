@@ -0,0 +1,83 @@
+/*
+ * apex_trace.h
+ * Streaming pipeline traces for the Konata pipeline viewer
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Output formats */
+#define TRACE_KANATA 0 /* Konata native log, includes stall and flush events */
+#define TRACE_O3 1     /* gem5 O3PipeView, one block per instruction */
+
+/* Pipeline stages an instruction is traced through */
+#define TRACE_FETCH 0
+#define TRACE_DECODE 1
+#define TRACE_EXECUTE 2
+#define TRACE_MEMORY 3
+#define TRACE_WRITEBACK 4
+#define NUM_TRACE_STAGES 5
+
+/* O3PipeView timestamps are in ticks, one cycle is a nanosecond in ps */
+#define TRACE_O3_TICKS 1000
+
+/* In-flight instructions tracked at once, must exceed the pipeline depth */
+#define TRACE_RECORDS 64
+
+/* Events buffered until the start of the next cycle */
+#define TRACE_MAX_PENDING 32
+
+/* Bytes of output collected before each write to the file */
+#define TRACE_BUFFER_SIZE (1 << 16)
+
+typedef struct Trace_Record
+{
+    int seq;                      /* Instruction occupying this slot */
+    int stall;                    /* Open CYCLE_* stall marker, -1 for none */
+    int cycle[NUM_TRACE_STAGES];  /* Cycle each stage was entered, -1 if not */
+} Trace_Record;
+
+typedef struct Trace_Event
+{
+    int seq;
+    int stage;                    /* Stage entered, or -1 to retire/flush */
+    int flushed;
+} Trace_Event;
+
+typedef struct APEX_Trace
+{
+    FILE *fp;
+    int format;                   /* One of TRACE_* formats */
+    int first_cycle;              /* Cycle window, last_cycle < 0 for no end */
+    int last_cycle;
+    int cycle;                    /* Cycle being simulated */
+    int active;                   /* cycle lies inside the window */
+    int first_seq;                /* First instruction fetched in the window */
+    int written_cycle;            /* Last cycle announced to the log, or -1 */
+    int retired;                  /* Retire order of traced instructions */
+    int num_pending;
+    Trace_Event pending[TRACE_MAX_PENDING];
+    Trace_Record records[TRACE_RECORDS];
+    int used;                     /* Bytes waiting in buf */
+    char buf[TRACE_BUFFER_SIZE];
+} APEX_Trace;
+
+APEX_Trace *APEX_trace_open(const char *filename, int format, int first_cycle,
+                            int last_cycle);
+void APEX_trace_close(APEX_Trace *trace);
+void APEX_trace_cycle(APEX_Trace *trace, int cycle);
+void APEX_trace_fetch(APEX_Trace *trace, const CPU_Stage *stage);
+void APEX_trace_stage(APEX_Trace *trace, const CPU_Stage *stage, int next);
+void APEX_trace_stall(APEX_Trace *trace, const CPU_Stage *stage, int reason);
+void APEX_trace_retire(APEX_Trace *trace, const CPU_Stage *stage);
+void APEX_trace_flush(APEX_Trace *trace, const CPU_Stage *stage);
+
+#endif
@@ -0,0 +1,263 @@
+/*
+ * apex_vector.c
+ * Functional kernels of the vector instructions. Registers are always
+ * MAX_VECTOR_LENGTH lanes wide and VLOAD zeroes the lanes past the vector
+ * length, so VADD, VMUL and VRED work on whole registers without masks.
+ * Elements sit one word (4 addresses) apart in data memory, like the arrays
+ * LOADP walks, and VLOAD gathers them.
+ *
+ * The kernels are picked once from what the host supports: AVX2 handles a
+ * register per instruction, SSE4.1 half of one, and plain C covers other
+ * hosts. The build needs no special flags.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <string.h>
+
+#include "apex_vector.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define VECTOR_X86 1
+#endif
+
+#define ISA_UNKNOWN 0
+#define ISA_SCALAR 1
+#define ISA_SSE41 2
+#define ISA_AVX2 3
+
+static int host_isa = ISA_UNKNOWN;
+
+static int
+select_isa(void)
+{
+#ifdef VECTOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return ISA_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        return ISA_SSE41;
+    }
+#endif
+    return ISA_SCALAR;
+}
+
+static inline int
+isa(void)
+{
+    if (host_isa == ISA_UNKNOWN)
+    {
+        host_isa = select_isa();
+    }
+    return host_isa;
+}
+
+const char *
+APEX_vector_isa(void)
+{
+    static const char *names[] = {"unknown", "scalar", "sse4.1", "avx2"};
+
+    return names[isa()];
+}
+
+#ifdef VECTOR_X86
+__attribute__((target("avx2"))) static void
+load_avx2(int *dst, const int *memory, int address, int length)
+{
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(length), lanes);
+    __m256i index = _mm256_slli_epi32(lanes, 2);
+
+    /* Masked off lanes read nothing and come back as zero */
+    _mm256_storeu_si256(
+        (__m256i *)dst,
+        _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), memory + address,
+                                    index, mask, 4));
+}
+
+__attribute__((target("avx2"))) static void
+add_avx2(int *dst, const int *a, const int *b)
+{
+    _mm256_storeu_si256(
+        (__m256i *)dst,
+        _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)a),
+                         _mm256_loadu_si256((const __m256i *)b)));
+}
+
+__attribute__((target("avx2"))) static void
+mul_avx2(int *dst, const int *a, const int *b)
+{
+    _mm256_storeu_si256(
+        (__m256i *)dst,
+        _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)a),
+                           _mm256_loadu_si256((const __m256i *)b)));
+}
+
+__attribute__((target("avx2"))) static int
+reduce_avx2(const int *a)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i *)a);
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),
+                              _mm256_extracti128_si256(v, 1));
+
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("sse4.1"))) static void
+add_sse41(int *dst, const int *a, const int *b)
+{
+    int i;
+
+    for (i = 0; i < MAX_VECTOR_LENGTH; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm_add_epi32(_mm_loadu_si128((const __m128i *)(a + i)),
+                                       _mm_loadu_si128((const __m128i *)(b + i))));
+    }
+}
+
+__attribute__((target("sse4.1"))) static void
+mul_sse41(int *dst, const int *a, const int *b)
+{
+    int i;
+
+    for (i = 0; i < MAX_VECTOR_LENGTH; i += 4)
+    {
+        _mm_storeu_si128(
+            (__m128i *)(dst + i),
+            _mm_mullo_epi32(_mm_loadu_si128((const __m128i *)(a + i)),
+                            _mm_loadu_si128((const __m128i *)(b + i))));
+    }
+}
+
+__attribute__((target("sse4.1"))) static int
+reduce_sse41(const int *a)
+{
+    __m128i s = _mm_setzero_si128();
+    int i;
+
+    for (i = 0; i < MAX_VECTOR_LENGTH; i += 4)
+    {
+        s = _mm_add_epi32(s, _mm_loadu_si128((const __m128i *)(a + i)));
+    }
+
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+#endif
+
+/* Lane i of dst <- memory[address + 4i] for i < length, zero past it */
+void
+APEX_vector_load(int *dst, const int *memory, int address, int length)
+{
+    int i;
+
+#ifdef VECTOR_X86
+    if (isa() == ISA_AVX2 && MAX_VECTOR_LENGTH == 8)
+    {
+        load_avx2(dst, memory, address, length);
+        return;
+    }
+#endif
+
+    for (i = 0; i < length; ++i)
+    {
+        dst[i] = memory[address + 4 * i];
+    }
+    memset(dst + length, 0, (MAX_VECTOR_LENGTH - length) * sizeof(int));
+}
+
+/* memory[address + 4i] <- lane i of src for i < length. There is no scatter
+ * below AVX-512, so this stays scalar everywhere */
+void
+APEX_vector_store(int *memory, int address, const int *src, int length)
+{
+    int i;
+
+    for (i = 0; i < length; ++i)
+    {
+        memory[address + 4 * i] = src[i];
+    }
+}
+
+/* Integer lanes wrap like the scalar ALU, computed as unsigned to keep the
+ * fallbacks well defined */
+void
+APEX_vector_add(int *dst, const int *a, const int *b)
+{
+    int i;
+
+#ifdef VECTOR_X86
+    if (isa() == ISA_AVX2 && MAX_VECTOR_LENGTH == 8)
+    {
+        add_avx2(dst, a, b);
+        return;
+    }
+    if (isa() == ISA_SSE41 && MAX_VECTOR_LENGTH % 4 == 0)
+    {
+        add_sse41(dst, a, b);
+        return;
+    }
+#endif
+
+    for (i = 0; i < MAX_VECTOR_LENGTH; ++i)
+    {
+        dst[i] = (int)((unsigned int)a[i] + (unsigned int)b[i]);
+    }
+}
+
+void
+APEX_vector_mul(int *dst, const int *a, const int *b)
+{
+    int i;
+
+#ifdef VECTOR_X86
+    if (isa() == ISA_AVX2 && MAX_VECTOR_LENGTH == 8)
+    {
+        mul_avx2(dst, a, b);
+        return;
+    }
+    if (isa() == ISA_SSE41 && MAX_VECTOR_LENGTH % 4 == 0)
+    {
+        mul_sse41(dst, a, b);
+        return;
+    }
+#endif
+
+    for (i = 0; i < MAX_VECTOR_LENGTH; ++i)
+    {
+        dst[i] = (int)((unsigned int)a[i] * (unsigned int)b[i]);
+    }
+}
+
+int
+APEX_vector_reduce(const int *a)
+{
+    unsigned int sum = 0;
+    int i;
+
+#ifdef VECTOR_X86
+    if (isa() == ISA_AVX2 && MAX_VECTOR_LENGTH == 8)
+    {
+        return reduce_avx2(a);
+    }
+    if (isa() == ISA_SSE41 && MAX_VECTOR_LENGTH % 4 == 0)
+    {
+        return reduce_sse41(a);
+    }
+#endif
+
+    for (i = 0; i < MAX_VECTOR_LENGTH; ++i)
+    {
+        sum += (unsigned int)a[i];
+    }
+    return (int)sum;
+}
@@ -0,0 +1,22 @@
+/*
+ * apex_vector.h
+ * Host SIMD kernels behind the vector instructions
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_VECTOR_H_
+#define _APEX_VECTOR_H_
+
+#include "apex_macros.h"
+
+/* Every vector operand holds MAX_VECTOR_LENGTH ints */
+void APEX_vector_load(int *dst, const int *memory, int address, int length);
+void APEX_vector_store(int *memory, int address, const int *src, int length);
+void APEX_vector_add(int *dst, const int *a, const int *b);
+void APEX_vector_mul(int *dst, const int *a, const int *b);
+int APEX_vector_reduce(const int *a);
+const char *APEX_vector_isa(void);
+
+#endif
@@ -0,0 +1,349 @@
+/*
+ * apex_warm.c
+ * Predictor warm-start files. A run with warm_save writes the BTB as it
+ * stands at the end, oldest entry first, and how often each conditional
+ * branch went each way; a run with warm_load starts from them instead of an
+ * empty BTB, so that short runs measure the predictor in its steady state.
+ *
+ * The file is text, one record per line, '#' starts a comment:
+ *
+ *   predictor <predictor>                BTB entries below were trained by
+ *   btb <pc> <target> <history bits>     one BTB entry
+ *   branch <pc> <not taken> <taken>      outcome profile of one branch
+ *
+ * The BTB entries are loaded when the predictor matches the run's, the
+ * youngest first up to btb_size. Otherwise, the history bits meaning
+ * something else, the BTB is seeded from the profile: the most executed
+ * branches get an entry each, with history bits for their bias. Records for
+ * pcs that hold no conditional branch in the program are skipped, so a file
+ * still loads after the program changed. Loaded profiles add up with the
+ * run's own, a saved file covers all the runs it was loaded into.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_warm.h"
+
+/* A branch of the profile, for picking the most executed ones */
+typedef struct Warm_Branch
+{
+    int index;
+    unsigned long long count;
+} Warm_Branch;
+
+APEX_Warm *
+APEX_warm_create(int code_memory_size)
+{
+    APEX_Warm *warm = calloc(1, sizeof(APEX_Warm));
+
+    if (!warm)
+    {
+        return NULL;
+    }
+
+    warm->size = code_memory_size;
+    warm->outcomes = calloc(code_memory_size ? code_memory_size : 1,
+                            sizeof(*warm->outcomes));
+    if (!warm->outcomes)
+    {
+        free(warm);
+        return NULL;
+    }
+    return warm;
+}
+
+void
+APEX_warm_free(APEX_Warm *warm)
+{
+    if (warm)
+    {
+        free(warm->outcomes);
+        free(warm);
+    }
+}
+
+/* Code memory index of the conditional branch at pc, -1 if there is none */
+static int
+branch_index(const APEX_CPU *cpu, int pc)
+{
+    int index = PC_TO_CODE_INDEX(pc);
+
+    if (pc % 4 || index < 0 || index >= cpu->code_memory_size)
+    {
+        return -1;
+    }
+
+    switch (cpu->code_memory[index].opcode)
+    {
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+            return index;
+        default:
+            return -1;
+    }
+}
+
+/* Most executed first */
+static int
+compare_branches(const void *a, const void *b)
+{
+    const Warm_Branch *x = a, *y = b;
+
+    if (x->count != y->count)
+    {
+        return x->count < y->count ? 1 : -1;
+    }
+    return x->index - y->index;
+}
+
+/*
+ * Fills the BTB with the most executed branches of profile, the hottest
+ * youngest, each with the history bits the predictor would settle on for
+ * its bias
+ */
+static void
+seed_from_profile(APEX_CPU *cpu, const APEX_Warm *profile)
+{
+    Warm_Branch *branches;
+    BTB_Entry *entry;
+    unsigned long long taken, total;
+    int count = 0, i;
+
+    branches = malloc(sizeof(Warm_Branch) * (profile->size ? profile->size : 1));
+    if (!branches)
+    {
+        return;
+    }
+
+    for (i = 0; i < profile->size; ++i)
+    {
+        total = profile->outcomes[i][0] + profile->outcomes[i][1];
+        if (total)
+        {
+            branches[count].index = i;
+            branches[count].count = total;
+            count++;
+        }
+    }
+    qsort(branches, count, sizeof(Warm_Branch), compare_branches);
+    if (count > cpu->config.btb_size)
+    {
+        count = cpu->config.btb_size;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        entry = &cpu->btb[i];
+        taken = profile->outcomes[branches[count - 1 - i].index][1];
+        total = branches[count - 1 - i].count;
+
+        entry->instruction_address
+            = CODE_INDEX_TO_PC(branches[count - 1 - i].index);
+        entry->target_address
+            = entry->instruction_address
+              + cpu->code_memory[branches[count - 1 - i].index].imm;
+        if (cpu->config.predictor == PREDICTOR_BIMODAL)
+        {
+            /* Counter nearest the taken rate */
+            entry->history_bits = (int)((3 * taken + total / 2) / total);
+        }
+        else
+        {
+            /* Last two outcomes of the more frequent direction */
+            entry->history_bits = 2 * taken >= total ? 0b11 : 0b00;
+        }
+    }
+    cpu->btb_victim = count % cpu->config.btb_size;
+    free(branches);
+}
+
+/*
+ * Preloads the BTB of cpu, before the first cycle, from filename and adds
+ * its profile to warm's, if warm is not NULL. Returns 0, or -1 after
+ * reporting a bad file.
+ */
+int
+APEX_warm_load(APEX_CPU *cpu, APEX_Warm *warm, const char *filename)
+{
+    APEX_Warm *profile = warm ? warm : APEX_warm_create(cpu->code_memory_size);
+    BTB_Entry loaded[MAX_BTB_SIZE];
+    char predictor[32], name[32];
+    char *line = NULL, *p;
+    size_t len = 0;
+    unsigned long long not_taken, taken;
+    int pc, target, history, used, index;
+    int matches = FALSE, count = 0, line_num = 0, status = 0, i;
+    FILE *fp;
+
+    if (!profile)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the branch profile\n");
+        return -1;
+    }
+
+    fp = fopen(filename, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to read %s\n", filename);
+        if (profile != warm)
+        {
+            APEX_warm_free(profile);
+        }
+        return -1;
+    }
+
+    APEX_config_format(&cpu->config, "predictor", predictor, sizeof(predictor));
+    while (getline(&line, &len, fp) != -1)
+    {
+        line_num++;
+        if ((p = strchr(line, '#')))
+        {
+            *p = '\0';
+        }
+
+        if (line[strspn(line, " \t\r\n")] == '\0')
+        {
+            continue;
+        }
+
+        if (sscanf(line, " predictor %31s %n", name, &used) == 1
+            && line[used] == '\0')
+        {
+            matches = strcmp(name, predictor) == 0;
+        }
+        else if (sscanf(line, " btb %d %d %d %n", &pc, &target, &history,
+                        &used)
+                     == 3
+                 && line[used] == '\0')
+        {
+            /* Keep the youngest MAX_BTB_SIZE, in order */
+            index = branch_index(cpu, pc);
+            if (index >= 0 && target == pc + cpu->code_memory[index].imm
+                && history >= 0 && history <= 3)
+            {
+                if (count == MAX_BTB_SIZE)
+                {
+                    memmove(loaded, loaded + 1,
+                            sizeof(BTB_Entry) * (MAX_BTB_SIZE - 1));
+                    count--;
+                }
+                loaded[count].instruction_address = pc;
+                loaded[count].target_address = target;
+                loaded[count].history_bits = history;
+                count++;
+            }
+        }
+        else if (sscanf(line, " branch %d %llu %llu %n", &pc, &not_taken,
+                        &taken, &used)
+                     == 3
+                 && line[used] == '\0')
+        {
+            index = branch_index(cpu, pc);
+            if (index >= 0)
+            {
+                profile->outcomes[index][0] += not_taken;
+                profile->outcomes[index][1] += taken;
+            }
+        }
+        else
+        {
+            fprintf(stderr,
+                    "APEX_Error: %s:%d: expected predictor <name>, btb <pc> "
+                    "<target> <history> or branch <pc> <not taken> <taken>\n",
+                    filename, line_num);
+            status = -1;
+            break;
+        }
+    }
+    free(line);
+    fclose(fp);
+
+    if (status == 0 && cpu->config.predictor != PREDICTOR_NONE)
+    {
+        if (matches && count)
+        {
+            /* Youngest btb_size entries, oldest of them first */
+            i = count > cpu->config.btb_size ? count - cpu->config.btb_size
+                                             : 0;
+            memcpy(cpu->btb, loaded + i, sizeof(BTB_Entry) * (count - i));
+            cpu->btb_victim = (count - i) % cpu->config.btb_size;
+        }
+        else
+        {
+            seed_from_profile(cpu, profile);
+        }
+    }
+
+    if (profile != warm)
+    {
+        APEX_warm_free(profile);
+    }
+    return status;
+}
+
+/*
+ * Writes the BTB of cpu and warm's profile, if warm is not NULL, to
+ * filename. Returns 0, or -1 if the file cannot be written.
+ */
+int
+APEX_warm_save(const APEX_CPU *cpu, const APEX_Warm *warm,
+               const char *filename)
+{
+    const BTB_Entry *entry;
+    char predictor[32];
+    FILE *fp;
+    int i;
+
+    fp = fopen(filename, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", filename);
+        return -1;
+    }
+
+    APEX_config_format(&cpu->config, "predictor", predictor, sizeof(predictor));
+    fprintf(fp, "# APEX predictor warm-start state after %d cycles\n",
+            cpu->clock);
+    fprintf(fp, "predictor %s\n", predictor);
+
+    /* Oldest first, the next victim leads */
+    if (cpu->config.predictor != PREDICTOR_NONE)
+    {
+        for (i = 0; i < cpu->config.btb_size; ++i)
+        {
+            entry = &cpu->btb[(cpu->btb_victim + i) % cpu->config.btb_size];
+            if (entry->instruction_address != -1)
+            {
+                fprintf(fp, "btb %d %d %d\n", entry->instruction_address,
+                        entry->target_address, entry->history_bits);
+            }
+        }
+    }
+
+    for (i = 0; warm && i < warm->size; ++i)
+    {
+        if (warm->outcomes[i][0] || warm->outcomes[i][1])
+        {
+            fprintf(fp, "branch %d %llu %llu\n", CODE_INDEX_TO_PC(i),
+                    warm->outcomes[i][0], warm->outcomes[i][1]);
+        }
+    }
+
+    if (fclose(fp))
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", filename);
+        return -1;
+    }
+    return 0;
+}
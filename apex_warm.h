@@ -0,0 +1,40 @@
+/*
+ * apex_warm.h
+ * Predictor warm-start files: trained BTB state and per-branch outcome
+ * profiles saved at the end of one run and preloaded by a later one
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_WARM_H_
+#define _APEX_WARM_H_
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+typedef struct APEX_Warm
+{
+    int size;                          /* Instructions in code memory */
+    unsigned long long (*outcomes)[2]; /* Per instruction: not taken, taken */
+} APEX_Warm;
+
+APEX_Warm *APEX_warm_create(int code_memory_size);
+int APEX_warm_load(APEX_CPU *cpu, APEX_Warm *warm, const char *filename);
+int APEX_warm_save(const APEX_CPU *cpu, const APEX_Warm *warm,
+                   const char *filename);
+void APEX_warm_free(APEX_Warm *warm);
+
+/* Counts one resolution of the conditional branch at pc */
+static inline void
+APEX_warm_branch(APEX_Warm *warm, int pc, int taken)
+{
+    int index = PC_TO_CODE_INDEX(pc);
+
+    if (index >= 0 && index < warm->size)
+    {
+        warm->outcomes[index][taken != 0]++;
+    }
+}
+
+#endif
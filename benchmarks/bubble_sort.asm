@@ -0,0 +1,39 @@
+; bubble_sort.asm
+; Bubble sort of 48 pseudo-random words ((i * 97) & 255) stored at address
+; 0, elements 4 apart. Data-dependent compare-and-swap branches dominate.
+; Weighted checksum sum(i * a[i]) in R12 (= 190402).
+MOVC R1,#0
+MOVC R2,#0
+MOVC R9,#255
+MOVC R10,#97
+MUL R3,R2,R10
+AND R3,R3,R9
+STOREP R1,R3,#0
+ADDL R2,R2,#1
+CML R2,#48
+BN #-20
+MOVC R8,#47
+MOVC R1,#0
+MOVC R2,#0
+LOAD R3,R1,#0
+LOAD R4,R1,#4
+CMP R3,R4
+BNP #12
+STORE R1,R4,#0
+STORE R1,R3,#4
+ADDL R1,R1,#4
+ADDL R2,R2,#1
+CMP R2,R8
+BN #-36
+SUBL R8,R8,#1
+BP #-52
+MOVC R1,#0
+MOVC R2,#0
+MOVC R12,#0
+LOADP R3,R1,#0
+MUL R3,R3,R2
+ADD R12,R12,R3
+ADDL R2,R2,#1
+CML R2,#48
+BN #-20
+HALT
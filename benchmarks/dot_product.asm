@@ -0,0 +1,26 @@
+; dot_product.asm
+; Dot product of two 64 element vectors. A[i] = i + 1 at address 0,
+; B[i] = 2i + 1 at address 1024, elements 4 apart. LOADP walks both
+; vectors. Result in R5 (= 176800).
+MOVC R1,#0
+MOVC R2,#1024
+MOVC R3,#1
+MOVC R4,#64
+STOREP R1,R3,#0
+ADD R6,R3,R3
+SUBL R6,R6,#1
+STOREP R2,R6,#0
+ADDL R3,R3,#1
+SUBL R4,R4,#1
+BNZ #-24
+MOVC R1,#0
+MOVC R2,#1024
+MOVC R4,#64
+MOVC R5,#0
+LOADP R6,R1,#0
+LOADP R7,R2,#0
+MUL R8,R6,R7
+ADD R5,R5,R8
+SUBL R4,R4,#1
+BNZ #-20
+HALT
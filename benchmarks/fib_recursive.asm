@@ -0,0 +1,27 @@
+; fib_recursive.asm
+; Naive recursive Fibonacci, fib(15), with calls through JALR and a
+; memory stack in R14. R13 holds the function address, R15 the link.
+; Result in R2 (= 610).
+MOVC R14,#4000
+MOVC R1,#15
+MOVC R13,#4020
+JALR R15,R13,#0
+HALT
+CML R1,#2
+BN #60
+SUBL R14,R14,#8
+STORE R14,R15,#0
+STORE R14,R1,#4
+SUBL R1,R1,#1
+JALR R15,R13,#0
+LOAD R1,R14,#4
+STORE R14,R2,#4
+SUBL R1,R1,#2
+JALR R15,R13,#0
+LOAD R3,R14,#4
+ADD R2,R2,R3
+LOAD R15,R14,#0
+ADDL R14,R14,#8
+JUMP R15,#0
+ADDL R2,R1,#0
+JUMP R15,#0
@@ -0,0 +1,43 @@
+; linked_list.asm
+; Builds a 128 node singly linked list whose nodes are scattered through
+; memory (node k at address ((k * 37) & 127) * 8), each node holding
+; {next, value = k}, then walks it three times summing the values.
+; Every load address depends on the previous load. Sum in R6 (= 24384).
+MOVC R1,#0
+MOVC R9,#127
+MOVC R10,#37
+MUL R2,R1,R10
+AND R2,R2,R9
+ADD R2,R2,R2
+ADD R2,R2,R2
+ADD R2,R2,R2
+ADDL R3,R1,#1
+MUL R4,R3,R10
+AND R4,R4,R9
+ADD R4,R4,R4
+ADD R4,R4,R4
+ADD R4,R4,R4
+STORE R2,R4,#0
+STORE R2,R1,#4
+ADDL R1,R1,#1
+CML R1,#127
+BN #-60
+MUL R2,R1,R10
+AND R2,R2,R9
+ADD R2,R2,R2
+ADD R2,R2,R2
+ADD R2,R2,R2
+MOVC R4,#-1
+STORE R2,R4,#0
+STORE R2,R1,#4
+MOVC R6,#0
+MOVC R8,#3
+MOVC R5,#0
+LOAD R7,R5,#4
+ADD R6,R6,R7
+LOAD R5,R5,#0
+CML R5,#0
+BNN #-16
+SUBL R8,R8,#1
+BNZ #-28
+HALT
@@ -0,0 +1,20 @@
+; long_loop.asm
+; Synthetic 100000 iteration loop of independent and dependent ALU work,
+; a long steady-state run for host simulation speed. Accumulators end in
+; R2 (= 300000), R4 and R6.
+MOVC R1,#100000
+MOVC R2,#0
+MOVC R3,#7
+MOVC R4,#0
+MOVC R5,#3
+MOVC R6,#1
+ADDL R2,R2,#3
+ADD R4,R4,R3
+EXOR R6,R6,R4
+AND R7,R6,R5
+OR R8,R7,R3
+SUB R9,R8,R5
+ADD R4,R4,R9
+SUBL R1,R1,#1
+BNZ #-32
+HALT
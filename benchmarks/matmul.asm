@@ -0,0 +1,50 @@
+; matmul.asm
+; 8x8 integer matrix multiply C = A * B. A[i][j] = i + j at address 0,
+; B[i][j] = i - j at address 256, C at address 512, row-major with
+; elements 4 apart. Checksum of C in R12 (= 2688).
+MOVC R1,#0
+MOVC R2,#0
+MOVC R3,#0
+ADD R4,R1,R3
+SUB R5,R1,R3
+STOREP R2,R4,#0
+STORE R2,R5,#252
+ADDL R3,R3,#1
+CML R3,#8
+BN #-24
+ADDL R1,R1,#1
+CML R1,#8
+BN #-40
+MOVC R1,#0
+MOVC R9,#512
+MOVC R12,#0
+MOVC R2,#0
+MOVC R11,#0
+MOVC R4,#8
+ADDL R6,R1,#0
+ADD R6,R6,R6
+ADD R6,R6,R6
+ADD R6,R6,R6
+ADD R6,R6,R6
+ADD R6,R6,R6
+MOVC R7,#256
+ADD R7,R7,R2
+ADD R7,R7,R2
+ADD R7,R7,R2
+ADD R7,R7,R2
+LOADP R5,R6,#0
+LOAD R8,R7,#0
+ADDL R7,R7,#32
+MUL R5,R5,R8
+ADD R11,R11,R5
+SUBL R4,R4,#1
+BNZ #-24
+STOREP R9,R11,#0
+ADD R12,R12,R11
+ADDL R2,R2,#1
+CML R2,#8
+BN #-96
+ADDL R1,R1,#1
+CML R1,#8
+BN #-112
+HALT
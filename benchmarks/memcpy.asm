@@ -0,0 +1,25 @@
+; memcpy.asm
+; Copies 256 words from address 0 to address 2048 with LOADP/STOREP after
+; filling the source with i * 3. Sum of the copy in R7 (= 97920).
+MOVC R1,#0
+MOVC R2,#0
+MOVC R3,#256
+STOREP R1,R2,#0
+ADDL R2,R2,#3
+SUBL R3,R3,#1
+BNZ #-12
+MOVC R1,#0
+MOVC R2,#2048
+MOVC R3,#256
+LOADP R4,R1,#0
+STOREP R2,R4,#0
+SUBL R3,R3,#1
+BNZ #-12
+MOVC R2,#2048
+MOVC R3,#256
+MOVC R7,#0
+LOADP R4,R2,#0
+ADD R7,R7,R4
+SUBL R3,R3,#1
+BNZ #-12
+HALT
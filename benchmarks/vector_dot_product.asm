@@ -0,0 +1,29 @@
+; vector_dot_product.asm
+; dot_product.asm with the vector extension, for vector_length=4 (the
+; default). The same A and B are built with STOREP, then each iteration
+; multiplies four element pairs and accumulates them in V4. VRED folds the
+; lanes at the end. Result in R5 (= 176800).
+MOVC R1,#0
+MOVC R2,#1024
+MOVC R3,#1
+MOVC R4,#64
+STOREP R1,R3,#0
+ADD R6,R3,R3
+SUBL R6,R6,#1
+STOREP R2,R6,#0
+ADDL R3,R3,#1
+SUBL R4,R4,#1
+BNZ #-24
+MOVC R1,#0
+MOVC R2,#1024
+MOVC R4,#16
+VLOAD V1,R1,#0
+VLOAD V2,R2,#0
+VMUL V3,V1,V2
+VADD V4,V4,V3
+ADDL R1,R1,#16
+ADDL R2,R2,#16
+SUBL R4,R4,#1
+BNZ #-28
+VRED R5,V4
+HALT
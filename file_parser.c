@@ -8,6 +8,7 @@
  * State University of New York at Binghamton
  */
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,6 +37,21 @@ get_num_from_string(const char *buffer)
     return atoi(str);
 }
 
+/* Assembly mnemonics indexed by opcode */
+static const char *opcode_names[NUM_OPCODES] = {
+    "ADD", "SUB", "MUL", "DIV", "AND", "OR", "EXOR", "MOVC", "LOAD",
+    "STORE", "BZ", "BNZ", "HALT", "LOADP", "STOREP", "ADDL", "SUBL", "CMP",
+    "JUMP", "JALR", "CML", "BP", "BNP", "BN", "BNN", "NOP", "VLOAD",
+    "VSTORE", "VADD", "VMUL", "VRED",
+};
+
+/* Mnemonic of opcode, NULL when there is no such opcode */
+const char *
+APEX_opcode_name(int opcode)
+{
+    return (opcode >= 0 && opcode < NUM_OPCODES) ? opcode_names[opcode] : NULL;
+}
+
 /*
  * This function sets the numeric opcode to an instruction based on string value
  *
@@ -174,6 +190,31 @@ set_opcode_str(const char *opcode_str)
         return OPCODE_NOP;
     }
 
+    if (strcmp(opcode_str, "VLOAD") == 0)
+    {
+        return OPCODE_VLOAD;
+    }
+
+    if (strcmp(opcode_str, "VSTORE") == 0)
+    {
+        return OPCODE_VSTORE;
+    }
+
+    if (strcmp(opcode_str, "VADD") == 0)
+    {
+        return OPCODE_VADD;
+    }
+
+    if (strcmp(opcode_str, "VMUL") == 0)
+    {
+        return OPCODE_VMUL;
+    }
+
+    if (strcmp(opcode_str, "VRED") == 0)
+    {
+        return OPCODE_VRED;
+    }
+
     assert(0 && "Invalid opcode");
     return 0;
 }
@@ -205,6 +246,10 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
     char tokens[6][128];
     char top_level_tokens[2][128];
 
+    /* Drop comments and the line terminator so the last token compares
+     * cleanly */
+    buffer[strcspn(buffer, ";\r\n")] = '\0';
+
     for (i = 0; i < 2; ++i)
     {
         strcpy(top_level_tokens[i], "");
@@ -233,6 +278,8 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
         case OPCODE_AND:
         case OPCODE_OR:
         case OPCODE_XOR:
+        case OPCODE_VADD:
+        case OPCODE_VMUL:
         {
             ins->rd = get_num_from_string(tokens[0]);
             ins->rs1 = get_num_from_string(tokens[1]);
@@ -279,6 +326,7 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
         }
 
         case OPCODE_LOADP:
+        case OPCODE_VLOAD:
         {
             ins->rd = get_num_from_string(tokens[0]);
             ins->rs1 = get_num_from_string(tokens[1]);
@@ -288,6 +336,7 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
 
         case OPCODE_STORE:
         case OPCODE_STOREP:
+        case OPCODE_VSTORE:
         {
             ins->rs1 = get_num_from_string(tokens[0]);
             ins->rs2 = get_num_from_string(tokens[1]);
@@ -321,10 +370,71 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
             break;
         }
 
+        case OPCODE_VRED:
+        {
+            ins->rd = get_num_from_string(tokens[0]);
+            ins->rs1 = get_num_from_string(tokens[1]);
+            break;
+        }
+
     }
     /* Fill in rest of the instructions accordingly */
 }
 
+/* Blank and comment-only (';') lines carry no instruction and do not occupy
+ * code memory */
+static int
+is_blank_line(const char *line)
+{
+    line += strspn(line, " \t\r\n");
+    return *line == '\0' || *line == ';';
+}
+
+/* Reads the rest of a binary program file, see APEX_BINARY_MAGIC */
+static APEX_Instruction *
+load_binary(FILE *fp, int *size)
+{
+    APEX_Instruction *code_memory;
+    int32_t count, fields[5];
+    int i;
+
+    if (fread(&count, sizeof(count), 1, fp) != 1 || count <= 0)
+    {
+        return NULL;
+    }
+
+    code_memory = calloc(count, sizeof(APEX_Instruction));
+    if (!code_memory)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        if (fread(fields, sizeof(fields), 1, fp) != 1
+            || !APEX_opcode_name(fields[0]) || fields[1] < 0
+            || fields[1] >= REG_FILE_SIZE || fields[2] < 0
+            || fields[2] >= REG_FILE_SIZE || fields[3] < 0
+            || fields[3] >= REG_FILE_SIZE)
+        {
+            fprintf(stderr, "APEX_Error: Bad binary instruction %d\n", i);
+            free(code_memory);
+            return NULL;
+        }
+
+        code_memory[i].opcode = fields[0];
+        code_memory[i].rd = fields[1];
+        code_memory[i].rs1 = fields[2];
+        code_memory[i].rs2 = fields[3];
+        code_memory[i].imm = fields[4];
+        code_memory[i].line = i + 1;
+        strcpy(code_memory[i].opcode_str, opcode_names[fields[0]]);
+    }
+
+    *size = count;
+    return code_memory;
+}
+
 /*
  * This function is related to parsing input file
  *
@@ -339,6 +449,8 @@ create_code_memory(const char *filename, int *size)
     char *line = NULL;
     int code_memory_size = 0;
     int current_instruction = 0;
+    int line_num = 0;
+    char magic[APEX_BINARY_MAGIC_SIZE];
     APEX_Instruction *code_memory;
 
     if (!filename)
@@ -352,9 +464,22 @@ create_code_memory(const char *filename, int *size)
         return NULL;
     }
 
+    /* Binary programs, as written by apex_gen -B */
+    if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic)
+        && memcmp(magic, APEX_BINARY_MAGIC, sizeof(magic)) == 0)
+    {
+        code_memory = load_binary(fp, size);
+        fclose(fp);
+        return code_memory;
+    }
+    rewind(fp);
+
     while ((nread = getline(&line, &len, fp)) != -1)
     {
-        code_memory_size++;
+        if (!is_blank_line(line))
+        {
+            code_memory_size++;
+        }
     }
     *size = code_memory_size;
     if (!code_memory_size)
@@ -373,6 +498,13 @@ create_code_memory(const char *filename, int *size)
     rewind(fp);
     while ((nread = getline(&line, &len, fp)) != -1)
     {
+        line_num++;
+        if (is_blank_line(line))
+        {
+            continue;
+        }
+
+        code_memory[current_instruction].line = line_num;
         create_APEX_instruction(&code_memory[current_instruction], line);
         current_instruction++;
     }
@@ -380,4 +512,54 @@ create_code_memory(const char *filename, int *size)
     free(line);
     fclose(fp);
     return code_memory;
-}
\ No newline at end of file
+}
+/*
+ * Reads a data memory image into data_memory: one "<address> <value>" pair
+ * per line, '#' starts a comment. Locations the image leaves out are zero.
+ * Returns 0, or -1 after reporting a bad file.
+ */
+int
+load_data_image(const char *filename, int *data_memory)
+{
+    FILE *fp;
+    size_t len = 0;
+    char *line = NULL, *p;
+    int address, value, used, line_num = 0, status = 0;
+
+    fp = fopen(filename, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to read %s\n", filename);
+        return -1;
+    }
+
+    memset(data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
+    while (getline(&line, &len, fp) != -1)
+    {
+        line_num++;
+        if ((p = strchr(line, '#')))
+        {
+            *p = '\0';
+        }
+
+        if (line[strspn(line, " \t\r\n")] == '\0')
+        {
+            continue;
+        }
+
+        if (sscanf(line, "%d %d %n", &address, &value, &used) != 2
+            || line[used] != '\0' || address < 0
+            || address >= DATA_MEMORY_SIZE)
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: expected <address> <value>\n",
+                    filename, line_num);
+            status = -1;
+            break;
+        }
+        data_memory[address] = value;
+    }
+
+    free(line);
+    fclose(fp);
+    return status;
+}
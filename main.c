@@ -7,30 +7,323 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "apex_cpu.h"
+#include "apex_debug.h"
+#include "apex_interval.h"
+#include "apex_profile.h"
+#include "apex_recorder.h"
+#include "apex_trace.h"
+#include "apex_warm.h"
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "APEX_Help: Usage %s <input_file> [single_step | display <cycles> "
+            "| simulate <cycles>] [profile=<file>|-] [trace=<file>|-] "
+            "[trace_format=kanata|o3] [trace_window=<first>:<last>] "
+            "[interval=<cycles>] [interval_csv=<file>|-] "
+            "[interval_prom=<file>] [data=<file>] [warm_load=<file>] "
+            "[warm_save=<file>] [flight=<file>] [flight_cycles=<cycles>] "
+            "[<param>=<value> ...]\n",
+            prog);
+    fprintf(stderr, "APEX_Help: params btb_size, predictor "
+                    "(none|history|bimodal), forwarding, mul_latency, "
+                    "mem_latency, vector_length, vector_latency, store_buffer, "
+                    "prefetcher (none|next_line|stride|stream), "
+                    "prefetch_degree, prefetch_distance, icache_sets, "
+                    "icache_ways, icache_line, icache_latency, fetch_queue, "
+                    "ftq_size, loop_buffer, fetch_stages, execute_stages, "
+                    "memory_stages, value_predictor (none|last|stride), "
+                    "lvp_size, lvp_confidence, branch_stage "
+                    "(execute|decode), fusion (none|cmp_branch+movc_add+"
+                    "addl_load), max_cycles, cosim, watchdog, variants, "
+                    "snapshot_interval, history_mb\n");
+}
 
 int
 main(int argc, char const *argv[])
 {
     APEX_CPU *cpu;
+    APEX_Debugger *dbg;
+    APEX_Config config;
+    const char *profile_file = NULL;
+    const char *trace_file = NULL;
+    int trace_format = TRACE_KANATA;
+    int trace_first = 0, trace_last = -1;
+    const char *interval_csv = NULL;
+    const char *interval_prom = NULL;
+    const char *data_file = NULL;
+    const char *warm_load = NULL;
+    const char *warm_save = NULL;
+    const char *flight_file = FLIGHT_FILE;
+    int flight_cycles = FLIGHT_CYCLES;
+    APEX_Recorder *recorder = NULL;
+    int interval = INTERVAL_CYCLES;
+    int *image;
+    char *end;
+    FILE *fp;
+    int status, limited;
+    int i;
 
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
 
-    if (argc != 2)
+    if (argc < 2)
     {
-        fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
+        print_usage(argv[0]);
         exit(1);
     }
 
-    cpu = APEX_cpu_init(argv[1]);
+    APEX_config_defaults(&config);
+
+    for (i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "single_step") == 0)
+        {
+            config.debug_messages = TRUE;
+            config.single_step = TRUE;
+        }
+        else if ((strcmp(argv[i], "display") == 0
+                  || strcmp(argv[i], "simulate") == 0)
+                 && i + 1 < argc)
+        {
+            config.debug_messages = (strcmp(argv[i], "display") == 0);
+            config.single_step = FALSE;
+            if (APEX_config_set(&config, "max_cycles", argv[++i]))
+            {
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "profile=", 8) == 0 && argv[i][8])
+        {
+            profile_file = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "trace=", 6) == 0 && argv[i][6])
+        {
+            trace_file = argv[i] + 6;
+        }
+        else if (strcmp(argv[i], "trace_format=kanata") == 0)
+        {
+            trace_format = TRACE_KANATA;
+        }
+        else if (strcmp(argv[i], "trace_format=o3") == 0)
+        {
+            trace_format = TRACE_O3;
+        }
+        else if (strncmp(argv[i], "trace_window=", 13) == 0)
+        {
+            /* <first>:<last>, either end may be left out */
+            trace_first = strtol(argv[i] + 13, &end, 10);
+            trace_last = -1;
+            if (*end != ':' || trace_first < 0)
+            {
+                fprintf(stderr, "APEX_Error: Invalid argument '%s'\n", argv[i]);
+                print_usage(argv[0]);
+                exit(1);
+            }
+            if (end[1])
+            {
+                trace_last = strtol(end + 1, &end, 10);
+                if (*end || trace_last < trace_first)
+                {
+                    fprintf(stderr, "APEX_Error: Invalid argument '%s'\n",
+                            argv[i]);
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            }
+        }
+        else if (strncmp(argv[i], "interval=", 9) == 0)
+        {
+            interval = strtol(argv[i] + 9, &end, 10);
+            if (*end || interval < 1)
+            {
+                fprintf(stderr, "APEX_Error: Invalid argument '%s'\n", argv[i]);
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "flight_cycles=", 14) == 0)
+        {
+            flight_cycles = strtol(argv[i] + 14, &end, 10);
+            if (*end || flight_cycles < 0)
+            {
+                fprintf(stderr, "APEX_Error: Invalid argument '%s'\n", argv[i]);
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "flight=", 7) == 0 && argv[i][7])
+        {
+            flight_file = argv[i] + 7;
+        }
+        else if (strncmp(argv[i], "interval_csv=", 13) == 0 && argv[i][13])
+        {
+            interval_csv = argv[i] + 13;
+        }
+        else if (strncmp(argv[i], "interval_prom=", 14) == 0 && argv[i][14])
+        {
+            interval_prom = argv[i] + 14;
+        }
+        else if (strncmp(argv[i], "data=", 5) == 0 && argv[i][5])
+        {
+            data_file = argv[i] + 5;
+        }
+        else if (strncmp(argv[i], "warm_load=", 10) == 0 && argv[i][10])
+        {
+            warm_load = argv[i] + 10;
+        }
+        else if (strncmp(argv[i], "warm_save=", 10) == 0 && argv[i][10])
+        {
+            warm_save = argv[i] + 10;
+        }
+        else if (APEX_config_parse(&config, argv[i]))
+        {
+            fprintf(stderr, "APEX_Error: Invalid argument '%s'\n", argv[i]);
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    /* Armed before the input file is parsed, which may assert */
+    if (flight_cycles)
+    {
+        recorder = APEX_recorder_create(flight_cycles, flight_file);
+        if (!recorder)
+        {
+            fprintf(stderr,
+                    "APEX_Error: Unable to start the flight recorder\n");
+            exit(1);
+        }
+        APEX_recorder_arm(recorder);
+    }
+
+    cpu = APEX_cpu_init(argv[1], &config);
     if (!cpu)
     {
         fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
         exit(1);
     }
+    cpu->recorder = recorder;
+
+    if (data_file)
+    {
+        image = malloc(sizeof(int) * DATA_MEMORY_SIZE);
+        if (!image || load_data_image(data_file, image))
+        {
+            exit(1);
+        }
+        APEX_cpu_set_data_memory(cpu, image);
+        free(image);
+    }
+
+    if (warm_save)
+    {
+        cpu->warm = APEX_warm_create(cpu->code_memory_size);
+        if (!cpu->warm)
+        {
+            fprintf(stderr, "APEX_Error: Unable to allocate the branch "
+                            "profile\n");
+            exit(1);
+        }
+    }
+
+    if (warm_load && APEX_warm_load(cpu, cpu->warm, warm_load))
+    {
+        exit(1);
+    }
+
+    if (profile_file)
+    {
+        cpu->profile = APEX_profile_create(cpu->code_memory_size);
+    }
+
+    if (trace_file)
+    {
+        cpu->trace = APEX_trace_open(trace_file, trace_format, trace_first,
+                                     trace_last);
+        if (!cpu->trace)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write %s\n", trace_file);
+        }
+    }
+
+    if (interval_csv || interval_prom)
+    {
+        cpu->interval = APEX_interval_open(interval, interval_csv,
+                                           interval_prom, argv[1]);
+        if (!cpu->interval)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write %s\n",
+                    interval_csv ? interval_csv : interval_prom);
+        }
+    }
+
+    if (config.single_step)
+    {
+        dbg = APEX_debug_create(cpu);
+        if (!dbg)
+        {
+            fprintf(stderr, "APEX_Error: Unable to start the debugger\n");
+            exit(1);
+        }
+        APEX_debug_console(dbg, stdin);
+        APEX_debug_free(dbg);
+    }
+    else
+    {
+        APEX_cpu_run(cpu);
+    }
+    APEX_cpu_print_stats(cpu, stdout);
+
+    if (cpu->profile)
+    {
+        fp = strcmp(profile_file, "-") ? fopen(profile_file, "w") : stdout;
+        if (!fp)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write %s\n", profile_file);
+        }
+        else
+        {
+            APEX_profile_report(cpu->profile, cpu, argv[1], fp, PROFILE_TOP_N);
+            if (fp != stdout)
+            {
+                fclose(fp);
+            }
+        }
+    }
+
+    if (warm_save)
+    {
+        APEX_warm_save(cpu, cpu->warm, warm_save);
+    }
+
+    /* Runs that failed leave their last cycles behind, and so do runs the
+     * cycle limit stopped short of HALT, which may be stuck in a loop */
+    limited = !cpu->halted && cpu->config.max_cycles
+              && cpu->clock >= cpu->config.max_cycles;
+    if (cpu->recorder && (cpu->failed || cpu->diverged || limited))
+    {
+        if (APEX_recorder_dump(cpu->recorder,
+                               cpu->diverged ? "co-simulation divergence"
+                               : cpu->failed == FAIL_MEMORY
+                                   ? "data memory fault"
+                               : cpu->failed ? "watchdog"
+                                             : "cycle limit"))
+        {
+            fprintf(stderr, "APEX_Error: Unable to write %s\n", flight_file);
+        }
+        else
+        {
+            fprintf(stderr, "APEX_Error: flight recorder written to %s\n",
+                    flight_file);
+        }
+    }
 
-    APEX_cpu_run(cpu);
+    status = cpu->diverged ? 2 : cpu->failed ? 3 : 0;
     APEX_cpu_stop(cpu);
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
@@ -0,0 +1,9 @@
+; div_overflow.asm
+; Divides M[0] by M[4] into R3 and multiplies them into R4. INT_MIN / -1
+; and the overflowing product wrap instead of trapping, a zero divisor
+; gives zero.
+LOAD R1,R0,#0
+LOAD R2,R0,#4
+DIV R3,R1,R2
+MUL R4,R1,R2
+HALT
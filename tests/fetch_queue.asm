@@ -0,0 +1,29 @@
+; fetch_queue.asm
+; Fifty passes over a 22 instruction loop, a load every other instruction.
+; The loop spans more lines than a two line I-cache holds, so fetch misses
+; every pass while loads hold the back end up.
+MOVC R1,#0
+MOVC R3,#50
+LOAD R4,R1,#0
+ADDL R8,R8,#1
+LOAD R5,R1,#4
+ADDL R9,R9,#1
+LOAD R6,R1,#8
+ADDL R10,R10,#1
+LOAD R7,R1,#12
+ADDL R11,R11,#1
+LOAD R4,R1,#16
+ADDL R8,R8,#1
+LOAD R5,R1,#20
+ADDL R9,R9,#1
+LOAD R6,R1,#24
+ADDL R10,R10,#1
+LOAD R7,R1,#28
+ADDL R11,R11,#1
+LOAD R4,R1,#32
+ADDL R8,R8,#1
+LOAD R5,R1,#36
+ADDL R9,R9,#1
+SUBL R3,R3,#1
+BNZ #-84
+HALT